@@ -0,0 +1,908 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "lcaTree.hpp"
+#include "lcaMultilevel.hpp"
+#include "lcaArena.hpp"
+#include "lcaEulerTour.hpp"
+#include "generateRandTrees.hpp"
+#include "taskScheduler.hpp"
+#include "lcaStats.hpp"
+
+/*
+ * Benchmark driver: builds one tree and runs one query workload on it,
+ * then prints the results as JSON (to stdout, or to the file given by --out).
+ *
+ *   ./bench --structure=multilevel --shape=recursive --nodes=1000000 \
+ *           --order=id --queries=uniform --numQueries=1000000
+ *
+ * The static EulerTourLca is either built from the parent array
+ * (eulerTour), or converted from a MultilevelTreeNode tree built with
+ * add_leaf (eulerTourFromMultilevel), the conversion being the "finish"
+ * time of the build.
+ *
+ * With --mode=memory, it instead builds static and incremental
+ * ExpensiveTreeNode trees, MultilevelTreeNode trees and EulerTourLca
+ * structures of 10^3, 10^4, ...
+ * nodes (--minNodes to --maxNodes), and reports their memoryUsage()
+ * alongside the growth of the heap measured by the allocator. With
+ * --mode=width, it runs the ops workload on BasicMultilevelTreeNode with
+ * 32, 64, 128, 256 and 512-bit 2-subtrees, and reports each one's memoryUsage().
+ * With --mode=ancestor, it builds ExpensiveTreeNode and MultilevelTreeNode
+ * trees with add_leaf, and compares the throughput of depth, levelAncestor
+ * and distance with walking up the parent pointers. With --mode=batch, it
+ * inserts the first half of the nodes with add_leaf, and times inserting
+ * the second half with add_leaf against add_leaves in batches of 10, 100,
+ * ... nodes.
+ *
+ * Latencies come from one clock read per operation (the interval between
+ * consecutive reads, minus the measured cost of a read), collected in a
+ * log-linear histogram, so percentiles stay accurate without storing every
+ * sample. Throughput is measured over batches of `--batch` operations.
+ */
+
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/*-------------------------------*/
+/*      Latency Measurements     */
+/*-------------------------------*/
+
+/* Median cost of one clock read, subtracted from every latency sample */
+static uint64_t timerOverheadNs() {
+    vector<uint64_t> deltas(100001);
+    uint64_t prev = nowNs();
+    for (uint64_t& delta : deltas) {
+        uint64_t now = nowNs();
+        delta = now - prev;
+        prev = now;
+    }
+    std::nth_element(deltas.begin(), deltas.begin() + deltas.size() / 2, deltas.end());
+    return deltas[deltas.size() / 2];
+}
+
+/* Operations per second over batches: the whole run, and the spread between batches */
+struct Throughput {
+    double overall;
+    double medianBatch;
+    double minBatch;
+    double maxBatch;
+};
+
+static Throughput summarize(const vector<double>& batchRates, uint64_t ops, uint64_t ns) {
+    Throughput result = {0, 0, 0, 0};
+    if (batchRates.empty() || ns == 0) {
+        return result;
+    }
+    vector<double> sorted = batchRates;
+    std::sort(sorted.begin(), sorted.end());
+    result.overall = ops * 1e9 / ns;
+    result.medianBatch = sorted[sorted.size() / 2];
+    result.minBatch = sorted.front();
+    result.maxBatch = sorted.back();
+    return result;
+}
+
+/*-------------------------------*/
+/*     Structures Under Test     */
+/*-------------------------------*/
+
+/*
+ * Every structure is driven through the same calls: `addRoot` and
+ * `addLeaf` in insertion order, `finish` once all nodes are added, then
+ * queries on node ids. Static structures only link nodes in `addLeaf` and
+ * preprocess in `finish`; `dynamic` tells whether add_leaf latencies mean
+ * anything. `prepareBatch` translates queries for `runBatch` outside of
+ * the timed region.
+ */
+template <typename Node>
+struct BasicMultilevelBench {
+    static const bool dynamic = true;
+    vector<Node*> nodes;
+    vector<std::pair<Node*, Node*>> batch;
+    vector<Node*> batchResults;
+    int root;
+
+    BasicMultilevelBench(const vector<int>& parents) : nodes(parents.size(), NULL), root(-1) {}
+    ~BasicMultilevelBench() {if (root >= 0) {nodes[root]->deleteNode();}}
+
+    void addRoot(int id) {
+        nodes[id] = new Node(id);
+        root = id;
+    }
+    void addLeaf(int parent, int child) {
+        nodes[child] = new Node(child);
+        nodes[parent]->add_leaf(nodes[child]);
+    }
+    void addLeaves(const std::pair<int, int>* leaves, size_t n) {
+        vector<std::pair<Node*, Node*>> leafBatch;
+        for (size_t k = 0; k < n; ++k) {
+            nodes[leaves[k].second] = new Node(leaves[k].second);
+            leafBatch.push_back(std::make_pair(nodes[leaves[k].first], nodes[leaves[k].second]));
+        }
+        Node::add_leaves(leafBatch.data(), n);
+    }
+    void finish() {}
+
+    NodeId lca(int x, int y) {return Node::lca(nodes[x], nodes[y])->payload();}
+    MemoryUsage memoryUsage() {return nodes[root]->memoryUsage();}
+
+    void prepareBatch(const vector<std::pair<int, int>>& queries) {
+        batch.clear();
+        for (const std::pair<int, int>& q : queries) {
+            batch.push_back(std::make_pair(nodes[q.first], nodes[q.second]));
+        }
+        batchResults.resize(batch.size());
+    }
+    long long runBatch(size_t first, size_t count) {
+        Node::lcaBatch(batch.data() + first, batchResults.data() + first, count);
+        return batchResults[first + count - 1]->payload();
+    }
+};
+
+/* The 64-bit variant, which the other modes use */
+typedef BasicMultilevelBench<MultilevelTreeNode> MultilevelBench;
+
+/* MultilevelTreeNode::buildFromParents (insertion order does not apply) */
+struct MultilevelBulkBench : MultilevelBench {
+    static const bool dynamic = false;
+    const vector<int>& parents;
+
+    MultilevelBulkBench(const vector<int>& parents) : MultilevelBench(parents), parents(parents) {}
+
+    void addRoot(int) {}
+    void addLeaf(int, int) {}
+    void finish() {
+        MultilevelTreeNode* rootNode = MultilevelTreeNode::buildFromParents(parents, nodes);
+        root = rootNode ? rootNode->payload() : -1;
+    }
+};
+
+struct ExpensiveBench {
+    static const bool dynamic = true;
+    vector<ExpensiveTreeNode*> nodes;
+    vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> batch;
+    vector<ExpensiveTreeNode*> batchResults;
+    int root;
+
+    ExpensiveBench(const vector<int>& parents) : nodes(parents.size(), NULL), root(-1) {}
+    ~ExpensiveBench() {if (root >= 0) {nodes[root]->deleteNode();}}
+
+    void addRoot(int id) {
+        nodes[id] = new ExpensiveTreeNode(id);
+        root = id;
+    }
+    void addLeaf(int parent, int child) {
+        nodes[child] = new ExpensiveTreeNode(child);
+        nodes[parent]->add_leaf(nodes[child]);
+    }
+    void addLeaves(const std::pair<int, int>* leaves, size_t n) {
+        vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> leafBatch;
+        for (size_t k = 0; k < n; ++k) {
+            nodes[leaves[k].second] = new ExpensiveTreeNode(leaves[k].second);
+            leafBatch.push_back(std::make_pair(nodes[leaves[k].first], nodes[leaves[k].second]));
+        }
+        ExpensiveTreeNode::add_leaves(leafBatch.data(), n);
+    }
+    void finish() {}
+
+    NodeId lca(int x, int y) {return ExpensiveTreeNode::lca(nodes[x], nodes[y])->payload();}
+    MemoryUsage memoryUsage() {return nodes[root]->memoryUsage();}
+
+    void prepareBatch(const vector<std::pair<int, int>>& queries) {
+        batch.clear();
+        for (const std::pair<int, int>& q : queries) {
+            batch.push_back(std::make_pair(nodes[q.first], nodes[q.second]));
+        }
+        batchResults.resize(batch.size());
+    }
+    long long runBatch(size_t first, size_t count) {
+        ExpensiveTreeNode::lcaBatch(batch.data() + first, batchResults.data() + first, count);
+        return batchResults[first + count - 1]->payload();
+    }
+};
+
+struct ExpensiveStaticBench : ExpensiveBench {
+    static const bool dynamic = false;
+
+    ExpensiveStaticBench(const vector<int>& parents) : ExpensiveBench(parents) {}
+
+    void addLeaf(int parent, int child) {
+        nodes[child] = new ExpensiveTreeNode(child);
+        nodes[parent]->addLeafNoPreprocessing(nodes[child]);
+    }
+    void finish() {nodes[root]->preprocess();}
+};
+
+/* ArenaTree has no batched queries: `runBatch` loops over `lca` */
+struct ArenaBench {
+    static const bool dynamic = true;
+    ArenaTree tree;
+    const vector<std::pair<int, int>>* batch;
+    int root;
+
+    ArenaBench(const vector<int>& parents) : tree(parents.size()), batch(NULL), root(-1) {
+        for (size_t i = 0; i < parents.size(); ++i) {
+            tree.newNode();
+        }
+    }
+
+    void addRoot(int id) {root = id;}
+    void addLeaf(int parent, int child) {tree.add_leaf(parent, child);}
+    void finish() {}
+
+    NodeId lca(int x, int y) {return tree.lca(x, y);}
+
+    void prepareBatch(const vector<std::pair<int, int>>& queries) {batch = &queries;}
+    long long runBatch(size_t first, size_t count) {
+        long long checksum = 0;
+        for (size_t k = first; k < first + count; ++k) {
+            checksum += tree.lca((*batch)[k].first, (*batch)[k].second);
+        }
+        return checksum;
+    }
+};
+
+struct ArenaStaticBench : ArenaBench {
+    static const bool dynamic = false;
+
+    ArenaStaticBench(const vector<int>& parents) : ArenaBench(parents) {}
+
+    void addLeaf(int parent, int child) {tree.addLeafNoPreprocessing(parent, child);}
+    void finish() {tree.preprocess(root);}
+};
+
+/* EulerTourLca, built from the parent array in `finish` */
+struct EulerTourBench {
+    static const bool dynamic = false;
+    const vector<int>& parents;
+    EulerTourLca euler;
+    vector<std::pair<NodeId, NodeId>> batch;
+    vector<NodeId> batchResults;
+
+    EulerTourBench(const vector<int>& parents) : parents(parents) {}
+
+    void addRoot(int) {}
+    void addLeaf(int, int) {}
+    void finish() {euler.build(parents);}
+
+    NodeId lca(int x, int y) {return euler.lca(x, y);}
+    MemoryUsage memoryUsage() {return euler.memoryUsage();}
+
+    void prepareBatch(const vector<std::pair<int, int>>& queries) {
+        batch.assign(queries.begin(), queries.end());
+        batchResults.resize(batch.size());
+    }
+    long long runBatch(size_t first, size_t count) {
+        euler.lcaBatch(batch.data() + first, batchResults.data() + first, count);
+        return batchResults[first + count - 1];
+    }
+};
+
+/*
+ * A MultilevelTreeNode tree built with add_leaf, converted to an
+ * EulerTourLca in `finish` (which the queries then run on)
+ */
+struct EulerTourFromMultilevelBench : EulerTourBench {
+    static const bool dynamic = true;
+    MultilevelBench multilevel;
+
+    EulerTourFromMultilevelBench(const vector<int>& parents) : EulerTourBench(parents), multilevel(parents) {}
+
+    void addRoot(int id) {multilevel.addRoot(id);}
+    void addLeaf(int parent, int child) {multilevel.addLeaf(parent, child);}
+    void finish() {euler.build(multilevel.nodes[multilevel.root]);}
+};
+
+/*-------------------------------*/
+/*            Driver             */
+/*-------------------------------*/
+
+struct Config {
+    string structure;
+    string shape;
+    int numNodes;
+    int arity;
+    string order;
+    string queries;
+    int numQueries;
+    double zipfExponent;
+    int batch;
+    unsigned long long seed;
+    int threads;
+    string saveWorkload;
+    string loadWorkload;
+    string mode;
+    string metrics;
+    int minNodes;
+    int maxNodes;
+    string out;
+};
+
+static void writeLatency(std::ostream& json, const LatencyHistogram& latency) {
+    json << "{\"count\": " << latency.count()
+         << ", \"meanNs\": " << latency.mean()
+         << ", \"p50Ns\": " << latency.percentile(0.5)
+         << ", \"p99Ns\": " << latency.percentile(0.99)
+         << ", \"p999Ns\": " << latency.percentile(0.999)
+         << ", \"maxNs\": " << latency.max() << "}";
+}
+
+static void writeThroughput(std::ostream& json, const Throughput& throughput) {
+    json << "{\"overall\": " << throughput.overall
+         << ", \"medianBatch\": " << throughput.medianBatch
+         << ", \"minBatch\": " << throughput.minBatch
+         << ", \"maxBatch\": " << throughput.maxBatch << "}";
+}
+
+template <typename Bench>
+static void run(const Config& config, const vector<int>& parents, const vector<int>& order,
+                const vector<std::pair<int, int>>& queries, std::ostream& json) {
+    uint64_t overhead = timerOverheadNs();
+    Bench bench(parents);
+
+    // Build, timing every add_leaf, and throughput over batches of insertions
+    std::cerr << "Building " << config.structure << " tree" << std::endl;
+    LatencyHistogram addLeafLatency;
+    vector<double> addLeafRates;
+    uint64_t buildStart = nowNs();
+    bench.addRoot(order[0]);
+    uint64_t prev = nowNs();
+    uint64_t batchStart = prev;
+    for (size_t k = 1; k < order.size(); ++k) {
+        bench.addLeaf(parents[order[k]], order[k]);
+        uint64_t now = nowNs();
+        addLeafLatency.record(now - prev > overhead ? now - prev - overhead : 0);
+        prev = now;
+        if (k % config.batch == 0) {
+            addLeafRates.push_back(config.batch * 1e9 / std::max<uint64_t>(1, now - batchStart));
+            batchStart = now;
+        }
+    }
+    uint64_t insertEnd = nowNs();
+    bench.finish();
+    uint64_t buildEnd = nowNs();
+
+    // Single queries: latency pass, then throughput over batches
+    std::cerr << "Running " << queries.size() << " queries" << std::endl;
+    long long checksum = 0;
+    LatencyHistogram lcaLatency;
+    prev = nowNs();
+    for (const std::pair<int, int>& q : queries) {
+        checksum += bench.lca(q.first, q.second);
+        uint64_t now = nowNs();
+        lcaLatency.record(now - prev > overhead ? now - prev - overhead : 0);
+        prev = now;
+    }
+
+    vector<double> lcaRates;
+    uint64_t lcaStart = nowNs();
+    for (size_t first = 0; first < queries.size(); first += config.batch) {
+        size_t count = std::min(queries.size() - first, (size_t) config.batch);
+        uint64_t start = nowNs();
+        for (size_t k = first; k < first + count; ++k) {
+            checksum += bench.lca(queries[k].first, queries[k].second);
+        }
+        lcaRates.push_back(count * 1e9 / std::max<uint64_t>(1, nowNs() - start));
+    }
+    uint64_t lcaEnd = nowNs();
+
+    // The batched API, over the same batches
+    bench.prepareBatch(queries);
+    vector<double> batchRates;
+    uint64_t batchApiStart = nowNs();
+    for (size_t first = 0; first < queries.size(); first += config.batch) {
+        size_t count = std::min(queries.size() - first, (size_t) config.batch);
+        uint64_t start = nowNs();
+        checksum += bench.runBatch(first, count);
+        batchRates.push_back(count * 1e9 / std::max<uint64_t>(1, nowNs() - start));
+    }
+    uint64_t batchApiEnd = nowNs();
+
+    json << "{\n  \"config\": {"
+         << "\"structure\": \"" << config.structure << "\", "
+         << "\"shape\": \"" << config.shape << "\", "
+         << "\"nodes\": " << config.numNodes << ", "
+         << "\"arity\": " << config.arity << ", "
+         << "\"order\": \"" << config.order << "\", "
+         << "\"queries\": \"" << config.queries << "\", "
+         << "\"numQueries\": " << config.numQueries << ", "
+         << "\"zipfExponent\": " << config.zipfExponent << ", "
+         << "\"batch\": " << config.batch << ", "
+         << "\"seed\": " << config.seed << ", "
+         << "\"workload\": \"" << config.loadWorkload << "\"},\n";
+    json << "  \"timerOverheadNs\": " << overhead << ",\n";
+    json << "  \"build\": {\"seconds\": " << (buildEnd - buildStart) * 1e-9
+         << ", \"finishSeconds\": " << (buildEnd - insertEnd) * 1e-9;
+    if (Bench::dynamic) {
+        json << ",\n    \"addLeaf\": ";
+        writeLatency(json, addLeafLatency);
+        json << ",\n    \"addLeafPerSecond\": ";
+        writeThroughput(json, summarize(addLeafRates, order.size() - 1, insertEnd - buildStart));
+    }
+    json << "},\n";
+    json << "  \"lca\": {\"latency\": ";
+    writeLatency(json, lcaLatency);
+    json << ",\n    \"perSecond\": ";
+    writeThroughput(json, summarize(lcaRates, queries.size(), lcaEnd - lcaStart));
+    json << "},\n";
+    json << "  \"lcaBatch\": {\"perSecond\": ";
+    writeThroughput(json, summarize(batchRates, queries.size(), batchApiEnd - batchApiStart));
+    json << "},\n";
+    json << "  \"checksum\": " << checksum << "\n}\n";
+}
+
+/*-------------------------------*/
+/*          Memory Mode          */
+/*-------------------------------*/
+
+/* Bytes in use according to the allocator (glibc only, 0 elsewhere) */
+static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+template <typename Bench>
+static void buildTree(Bench& bench, const vector<int>& parents, const vector<int>& order) {
+    bench.addRoot(order[0]);
+    for (size_t k = 1; k < order.size(); ++k) {
+        bench.addLeaf(parents[order[k]], order[k]);
+    }
+    bench.finish();
+}
+
+/* Builds one tree and writes its footprint as a JSON object */
+template <typename Bench>
+static void measureMemory(const char* name, const vector<int>& parents, const vector<int>& order, std::ostream& json) {
+    Bench bench(parents);
+    size_t heapBefore = heapInUse();
+    buildTree(bench, parents, order);
+    size_t heapBytes = heapInUse() - heapBefore;
+    MemoryUsage usage = bench.memoryUsage();
+
+    std::cerr << name << ", " << usage.numNodes << " nodes: " << usage.perNode() << " bytes per node" << std::endl;
+    json << "    {\"structure\": \"" << name << "\", \"nodes\": " << usage.numNodes
+         << ", \"bytes\": {\"nodes\": " << usage.nodes
+         << ", \"childLists\": " << usage.childLists
+         << ", \"ancestorTables\": " << usage.ancestorTables
+         << ", \"subtreeIndex\": " << usage.subtreeIndex
+         << ", \"summaryNodes\": " << usage.summaryNodes
+         << ", \"total\": " << usage.total() << "}"
+         << ", \"bytesPerNode\": " << usage.perNode()
+         << ", \"allocations\": " << usage.allocations
+         << ", \"heapBytes\": " << heapBytes
+         << ", \"heapBytesPerNode\": " << (double) heapBytes / usage.numNodes << "}";
+}
+
+static void runMemory(const Config& config, TreeShape shape, InsertionOrder order, std::ostream& json) {
+    json << "{\n  \"config\": {"
+         << "\"mode\": \"memory\", "
+         << "\"shape\": \"" << config.shape << "\", "
+         << "\"arity\": " << config.arity << ", "
+         << "\"order\": \"" << config.order << "\", "
+         << "\"seed\": " << config.seed << ", "
+         << "\"minNodes\": " << config.minNodes << ", "
+         << "\"maxNodes\": " << config.maxNodes << "},\n";
+    json << "  \"rows\": [\n";
+    for (long long n = config.minNodes; n <= config.maxNodes; n *= 10) {
+        vector<int> parents = shapeParents(shape, n, config.arity, config.seed);
+        vector<int> insertions = insertionOrder(parents, order, config.seed + 1);
+        measureMemory<ExpensiveStaticBench>("expensiveStatic", parents, insertions, json);
+        json << ",\n";
+        measureMemory<ExpensiveBench>("expensive", parents, insertions, json);
+        json << ",\n";
+        measureMemory<MultilevelBench>("multilevel", parents, insertions, json);
+        json << ",\n";
+        measureMemory<EulerTourBench>("eulerTour", parents, insertions, json);
+        json << ((n * 10 <= config.maxNodes) ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+}
+
+/*-------------------------------*/
+/*          Width Mode           */
+/*-------------------------------*/
+
+template <typename Word>
+static void measureWidth(const Config& config, const vector<int>& parents, const vector<int>& order,
+                         const vector<std::pair<int, int>>& queries, std::ostream& json) {
+    typedef BasicMultilevelBench<BasicMultilevelTreeNode<Word>> Bench;
+    Config widthConfig = config;
+    widthConfig.structure = "multilevel" + std::to_string(MicroWord<Word>::bits);
+    json << "    {\"width\": " << MicroWord<Word>::bits << ",\n    \"ops\": ";
+    run<Bench>(widthConfig, parents, order, queries, json);
+    json << ",\n    \"memory\":\n";
+    measureMemory<Bench>(widthConfig.structure.c_str(), parents, order, json);
+    json << "}";
+}
+
+static void runWidth(const Config& config, const vector<int>& parents, const vector<int>& order,
+                     const vector<std::pair<int, int>>& queries, std::ostream& json) {
+    json << "{\n  \"config\": {\"mode\": \"width\"},\n";
+    json << "  \"rows\": [\n";
+    measureWidth<uint32_t>(config, parents, order, queries, json);
+    json << ",\n";
+    measureWidth<uint64_t>(config, parents, order, queries, json);
+    json << ",\n";
+    measureWidth<unsigned __int128>(config, parents, order, queries, json);
+    json << ",\n";
+    measureWidth<Word256>(config, parents, order, queries, json);
+    json << ",\n";
+    measureWidth<Word512>(config, parents, order, queries, json);
+    json << "\n  ]\n}\n";
+}
+
+/*-------------------------------*/
+/*         Ancestor Mode         */
+/*-------------------------------*/
+
+static ExpensiveTreeNode* parentOf(ExpensiveTreeNode* node) {return node->uncompressedParent;}
+static MultilevelTreeNode* parentOf(MultilevelTreeNode* node) {return node->parent;}
+
+template <typename Node>
+static int walkDepth(Node* node) {
+    int depth = 0;
+    for (; parentOf(node); node = parentOf(node)) {
+        depth++;
+    }
+    return depth;
+}
+
+/* Queries per second of `query(k)` for k from 0 to count - 1 */
+template <typename Query>
+static double queriesPerSecond(size_t count, long long& checksum, const Query& query) {
+    uint64_t start = nowNs();
+    for (size_t k = 0; k < count; ++k) {
+        checksum += query(k);
+    }
+    return count * 1e9 / std::max<uint64_t>(1, nowNs() - start);
+}
+
+/*
+ * Query k asks for the ancestor steps[k] levels above queries[k].first, and
+ * for the distance between the two nodes. Walks only run on the first
+ * `walkQueries` queries.
+ */
+template <typename Bench, typename Node>
+static void measureAncestors(const char* name, const vector<int>& parents, const vector<int>& order,
+                             const vector<std::pair<int, int>>& queries, const vector<int>& steps,
+                             size_t walkQueries, std::ostream& json) {
+    Bench bench(parents);
+    buildTree(bench, parents, order);
+    const vector<Node*>& nodes = bench.nodes;
+    std::cerr << "Running " << name << " ancestor queries" << std::endl;
+
+    long long checksum = 0;
+    double depthRate = queriesPerSecond(queries.size(), checksum, [&](size_t k) {
+        return nodes[queries[k].first]->depth();
+    });
+    double levelAncestorRate = queriesPerSecond(queries.size(), checksum, [&](size_t k) {
+        return (long long) (size_t) Node::levelAncestor(nodes[queries[k].first], steps[k]);
+    });
+    double distanceRate = queriesPerSecond(queries.size(), checksum, [&](size_t k) {
+        return Node::distance(nodes[queries[k].first], nodes[queries[k].second]);
+    });
+    double lcaRate = queriesPerSecond(queries.size(), checksum, [&](size_t k) {
+        return (long long) (size_t) Node::lca(nodes[queries[k].first], nodes[queries[k].second]);
+    });
+
+    double walkLevelAncestorRate = queriesPerSecond(walkQueries, checksum, [&](size_t k) {
+        Node* node = nodes[queries[k].first];
+        for (int step = 0; step < steps[k]; ++step) {
+            node = parentOf(node);
+        }
+        return (long long) (size_t) node;
+    });
+    double walkDistanceRate = queriesPerSecond(walkQueries, checksum, [&](size_t k) {
+        Node* x = nodes[queries[k].first];
+        Node* y = nodes[queries[k].second];
+        int xDepth = walkDepth(x);
+        int yDepth = walkDepth(y);
+        int distance = 0;
+        for (; xDepth > yDepth; --xDepth, ++distance) {x = parentOf(x);}
+        for (; yDepth > xDepth; --yDepth, ++distance) {y = parentOf(y);}
+        for (; x != y; distance += 2) {
+            x = parentOf(x);
+            y = parentOf(y);
+        }
+        return distance;
+    });
+
+    json << "    {\"structure\": \"" << name << "\", \"walkQueries\": " << walkQueries
+         << ", \"perSecond\": {\"depth\": " << depthRate
+         << ", \"levelAncestor\": " << levelAncestorRate
+         << ", \"distance\": " << distanceRate
+         << ", \"lca\": " << lcaRate
+         << ", \"walkLevelAncestor\": " << walkLevelAncestorRate
+         << ", \"walkDistance\": " << walkDistanceRate
+         << "}, \"checksum\": " << checksum << "}";
+}
+
+static void runAncestor(const Config& config, const vector<int>& parents, const vector<int>& order,
+                        const vector<std::pair<int, int>>& queries, std::ostream& json) {
+    // Steps are uniform between 0 and the depth of the node
+    vector<int> depth(parents.size(), 0);
+    for (int id : insertionOrder(parents, bfsOrder, config.seed)) {
+        depth[id] = (parents[id] < 0) ? 0 : depth[parents[id]] + 1;
+    }
+    std::mt19937_64 random(config.seed + 3);
+    vector<int> steps;
+    for (const std::pair<int, int>& q : queries) {
+        steps.push_back(random() % (depth[q.first] + 1));
+    }
+    // Walks stop after about 10^9 parent steps, as each is linear in the depth
+    size_t walkQueries = 0;
+    for (long long walkSteps = 0; walkQueries < queries.size() && walkSteps < 1000000000; ++walkQueries) {
+        const std::pair<int, int>& q = queries[walkQueries];
+        walkSteps += 3 * depth[q.first] + 2 * depth[q.second] + 1;
+    }
+
+    json << "{\n  \"config\": {"
+         << "\"mode\": \"ancestor\", "
+         << "\"shape\": \"" << config.shape << "\", "
+         << "\"nodes\": " << config.numNodes << ", "
+         << "\"order\": \"" << config.order << "\", "
+         << "\"queries\": \"" << config.queries << "\", "
+         << "\"numQueries\": " << config.numQueries << ", "
+         << "\"seed\": " << config.seed << "},\n";
+    json << "  \"rows\": [\n";
+    measureAncestors<ExpensiveBench, ExpensiveTreeNode>("expensive", parents, order, queries, steps, walkQueries, json);
+    json << ",\n";
+    measureAncestors<MultilevelBench, MultilevelTreeNode>("multilevel", parents, order, queries, steps, walkQueries, json);
+    json << "\n  ]\n}\n";
+}
+
+/*-------------------------------*/
+/*           Batch Mode          */
+/*-------------------------------*/
+
+/*
+ * Nanoseconds per leaf to insert the second half of `order` into a tree of
+ * its first half, one add_leaf at a time if `batchSize` is 0, and with
+ * add_leaves on consecutive batches of `batchSize` leaves otherwise
+ */
+template <typename Bench>
+static double insertSecondHalf(const vector<int>& parents, const vector<int>& order, size_t batchSize) {
+    size_t half = order.size() / 2;
+    Bench bench(parents);
+    bench.addRoot(order[0]);
+    for (size_t k = 1; k < half; ++k) {
+        bench.addLeaf(parents[order[k]], order[k]);
+    }
+    vector<std::pair<int, int>> leaves;
+    for (size_t k = half; k < order.size(); ++k) {
+        leaves.push_back(std::make_pair(parents[order[k]], order[k]));
+    }
+
+    uint64_t start = nowNs();
+    if (batchSize == 0) {
+        for (const std::pair<int, int>& leaf : leaves) {
+            bench.addLeaf(leaf.first, leaf.second);
+        }
+    } else {
+        for (size_t first = 0; first < leaves.size(); first += batchSize) {
+            bench.addLeaves(leaves.data() + first, std::min(batchSize, leaves.size() - first));
+        }
+    }
+    return (double) (nowNs() - start) / std::max<size_t>(1, leaves.size());
+}
+
+template <typename Bench>
+static void measureBatches(const char* name, const vector<int>& parents, const vector<int>& order, std::ostream& json) {
+    std::cerr << "Running " << name << " add_leaf" << std::endl;
+    double perLeaf = insertSecondHalf<Bench>(parents, order, 0);
+    json << "    {\"structure\": \"" << name << "\", \"addLeafNsPerLeaf\": " << perLeaf << ", \"addLeaves\": [";
+    size_t leaves = order.size() - order.size() / 2;
+    for (size_t batchSize = 10; ; batchSize *= 10) {
+        std::cerr << "Running " << name << " add_leaves in batches of " << batchSize << std::endl;
+        double batched = insertSecondHalf<Bench>(parents, order, batchSize);
+        json << (batchSize > 10 ? ", " : "") << "{\"batchSize\": " << std::min(batchSize, leaves)
+             << ", \"nsPerLeaf\": " << batched << ", \"speedup\": " << perLeaf / batched << "}";
+        if (batchSize >= leaves) {
+            break;
+        }
+    }
+    json << "]}";
+}
+
+static void runBatch(const Config& config, const vector<int>& parents, const vector<int>& order, std::ostream& json) {
+    json << "{\n  \"config\": {"
+         << "\"mode\": \"batch\", "
+         << "\"shape\": \"" << config.shape << "\", "
+         << "\"nodes\": " << config.numNodes << ", "
+         << "\"order\": \"" << config.order << "\", "
+         << "\"seed\": " << config.seed << "},\n";
+    json << "  \"rows\": [\n";
+    measureBatches<ExpensiveBench>("expensive", parents, order, json);
+    json << ",\n";
+    measureBatches<MultilevelBench>("multilevel", parents, order, json);
+    json << "\n  ]\n}\n";
+}
+
+static int writeOutput(const Config& config, const string& json) {
+    if (!config.metrics.empty()) {
+        std::ofstream metrics(config.metrics.c_str());
+        metrics << LcaStats::snapshot();
+    }
+    if (config.out.empty()) {
+        std::cout << json;
+        return 0;
+    }
+    std::ofstream file(config.out.c_str());
+    file << json;
+    return file ? 0 : 1;
+}
+
+static void usage() {
+    std::cerr << "Usage: ./bench [--option=value ...]\n"
+              << "  --structure=multilevel|multilevelBulk|expensive|expensiveStatic|arena|arenaStatic|\n"
+              << "              eulerTour|eulerTourFromMultilevel\n"
+              << "  --shape=path|star|caterpillar|kary|recursive|prufer\n"
+              << "  --nodes=N (up to 10^8)   --arity=K (k-ary trees)\n"
+              << "  --order=id|bfs|dfs|random (insertion order)\n"
+              << "  --queries=uniform|zipf|subtree   --numQueries=Q   --zipfExponent=S\n"
+              << "  --batch=B (operations per throughput batch)   --seed=SEED   --out=FILE\n"
+              << "  --threads=T (threads generating the workload)\n"
+              << "  --saveWorkload=PREFIX   writes the generated PREFIX.insertions and PREFIX.queries\n"
+              << "  --loadWorkload=PREFIX   runs a saved workload instead of generating one\n"
+              << "  --mode=ops|memory|width|ancestor|batch   --minNodes=N   --maxNodes=N (sizes for the memory mode)\n"
+              << "    (width runs the ops workload on 32, 64, 128, 256 and 512-bit multilevel 2-subtrees,\n"
+              << "     ancestor compares depth, levelAncestor and distance with parent-pointer walks,\n"
+              << "     batch times add_leaves against add_leaf on the second half of the nodes)\n"
+              << "  --metrics=FILE   writes LcaStats::snapshot() after the run (build with make STATS=1)\n";
+}
+
+/* Returns the position of `name` in `names`, or -1 */
+static int lookup(const string& name, const vector<string>& names) {
+    for (size_t k = 0; k < names.size(); ++k) {
+        if (names[k] == name) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    Config config = {"multilevel", "recursive", 1000000, 2, "id", "uniform", 1000000, 1.0, 4096, 1, 1, "", "", "ops", "",
+                     1000, 1000000, ""};
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--help") {
+            usage();
+            return 0;
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+            usage();
+            return 1;
+        }
+        string key = arg.substr(2, eq - 2);
+        string value = arg.substr(eq + 1);
+        if (key == "structure") {config.structure = value;}
+        else if (key == "shape") {config.shape = value;}
+        else if (key == "nodes") {config.numNodes = atoi(value.c_str());}
+        else if (key == "arity") {config.arity = atoi(value.c_str());}
+        else if (key == "order") {config.order = value;}
+        else if (key == "queries") {config.queries = value;}
+        else if (key == "numQueries") {config.numQueries = atoi(value.c_str());}
+        else if (key == "zipfExponent") {config.zipfExponent = atof(value.c_str());}
+        else if (key == "batch") {config.batch = atoi(value.c_str());}
+        else if (key == "seed") {config.seed = strtoull(value.c_str(), NULL, 10);}
+        else if (key == "threads") {config.threads = atoi(value.c_str());}
+        else if (key == "saveWorkload") {config.saveWorkload = value;}
+        else if (key == "loadWorkload") {config.loadWorkload = value;}
+        else if (key == "mode") {config.mode = value;}
+        else if (key == "metrics") {config.metrics = value;}
+        else if (key == "minNodes") {config.minNodes = atoi(value.c_str());}
+        else if (key == "maxNodes") {config.maxNodes = atoi(value.c_str());}
+        else if (key == "out") {config.out = value;}
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    vector<string> structures = {"multilevel", "multilevelBulk", "expensive", "expensiveStatic", "arena", "arenaStatic",
+                                  "eulerTour", "eulerTourFromMultilevel"};
+    vector<string> shapes = {"path", "star", "caterpillar", "kary", "recursive", "prufer"};
+    vector<string> orders = {"id", "bfs", "dfs", "random"};
+    vector<string> distributions = {"uniform", "zipf", "subtree"};
+    int structure = lookup(config.structure, structures);
+    int shape = lookup(config.shape, shapes);
+    int order = lookup(config.order, orders);
+    int distribution = lookup(config.queries, distributions);
+    if (structure < 0 || shape < 0 || order < 0 || distribution < 0 ||
+        config.numNodes < 1 || config.arity < 1 || config.numQueries < 1 || config.batch < 1 || config.threads < 1 ||
+        (config.mode != "ops" && config.mode != "memory" && config.mode != "width" && config.mode != "ancestor" &&
+         config.mode != "batch") || config.minNodes < 1 || config.maxNodes < config.minNodes) {
+        usage();
+        return 1;
+    }
+
+    if (config.mode == "memory") {
+        std::ostringstream json;
+        runMemory(config, (TreeShape) shape, (InsertionOrder) order, json);
+        return writeOutput(config, json.str());
+    }
+
+    vector<int> parents;
+    vector<int> insertions;
+    vector<std::pair<int, int>> queries;
+    if (!config.loadWorkload.empty()) {
+        std::cerr << "Reading workload " << config.loadWorkload << std::endl;
+        int queryNodes = 0;
+        if (!readInsertions((config.loadWorkload + ".insertions").c_str(), parents, insertions) ||
+            !readQueries((config.loadWorkload + ".queries").c_str(), queries, queryNodes) ||
+            queryNodes != (int) parents.size() || parents.empty() || queries.empty()) {
+            std::cerr << "Invalid workload " << config.loadWorkload << std::endl;
+            return 1;
+        }
+        config.numNodes = parents.size();
+        config.numQueries = queries.size();
+        config.shape = config.order = config.queries = "workload";
+    } else {
+        std::cerr << "Generating " << config.numNodes << "-node " << config.shape << " tree" << std::endl;
+        TaskScheduler scheduler(config.threads);
+        TaskScheduler* generator = (config.threads > 1) ? &scheduler : NULL;
+        parents = shapeParents((TreeShape) shape, config.numNodes, config.arity, config.seed, generator);
+        insertions = insertionOrder(parents, (InsertionOrder) order, config.seed + 1);
+        queries = generateQueries(parents, (QueryDistribution) distribution, config.numQueries,
+                                  config.zipfExponent, config.seed + 2, generator);
+    }
+    if (config.loadWorkload.empty() && !config.saveWorkload.empty() &&
+        (!writeInsertions((config.saveWorkload + ".insertions").c_str(), parents, insertions, config.seed + 1) ||
+         !streamQueries((config.saveWorkload + ".queries").c_str(), parents, (QueryDistribution) distribution,
+                        config.numQueries, config.zipfExponent, config.seed + 2))) {
+        std::cerr << "Cannot write workload " << config.saveWorkload << std::endl;
+        return 1;
+    }
+
+    std::ostringstream json;
+    if (config.mode == "width") {
+        runWidth(config, parents, insertions, queries, json);
+        return writeOutput(config, json.str());
+    }
+    if (config.mode == "ancestor") {
+        runAncestor(config, parents, insertions, queries, json);
+        return writeOutput(config, json.str());
+    }
+    if (config.mode == "batch") {
+        runBatch(config, parents, insertions, json);
+        return writeOutput(config, json.str());
+    }
+    switch (structure) {
+        case 0: run<MultilevelBench>(config, parents, insertions, queries, json); break;
+        case 1: run<MultilevelBulkBench>(config, parents, insertions, queries, json); break;
+        case 2: run<ExpensiveBench>(config, parents, insertions, queries, json); break;
+        case 3: run<ExpensiveStaticBench>(config, parents, insertions, queries, json); break;
+        case 4: run<ArenaBench>(config, parents, insertions, queries, json); break;
+        case 5: run<ArenaStaticBench>(config, parents, insertions, queries, json); break;
+        case 6: run<EulerTourBench>(config, parents, insertions, queries, json); break;
+        default: run<EulerTourFromMultilevelBench>(config, parents, insertions, queries, json); break;
+    }
+
+    return writeOutput(config, json.str());
+}
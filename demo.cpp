@@ -2,10 +2,10 @@
 #include <iostream>
 
 int main(){
-    MultilevelTreeNode* root = new MultilevelTreeNode("root");
-    MultilevelTreeNode* node1 = new MultilevelTreeNode("node1");
-    MultilevelTreeNode* node2 = new MultilevelTreeNode("node2");
-    MultilevelTreeNode* node3 = new MultilevelTreeNode("node3");
+    MultilevelTreeNode* root = new MultilevelTreeNode(0);
+    MultilevelTreeNode* node1 = new MultilevelTreeNode(1);
+    MultilevelTreeNode* node2 = new MultilevelTreeNode(2);
+    MultilevelTreeNode* node3 = new MultilevelTreeNode(3);
 
     root->add_leaf(node1);
     root->add_leaf(node2);
@@ -14,7 +14,7 @@ int main(){
     root->print();
 
     MultilevelTreeNode* lcaNode = MultilevelTreeNode::lca(node1, node3);
-    std::cout << "LCA of node1 and node3: " << lcaNode->data << std::endl;
+    std::cout << "LCA of node1 and node3: " << lcaNode->payload() << std::endl;
 
     root->deleteNode();
 
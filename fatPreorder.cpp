@@ -0,0 +1,50 @@
+#include "fatPreorder.hpp"
+#include <math.h>
+
+FatPreorder::Coord FatPreorder::thresholds[maxBuckets + 1];
+unsigned char FatPreorder::bucketAtBitLength[128];
+bool FatPreorder::initialized = FatPreorder::initTables();
+
+static_assert(FatPreorder::intervalLength(FatPreorder::maxSize) > 0, "intervals of maxSize nodes must fit in a Coord");
+
+bool FatPreorder::initTables() {
+    const Coord maxCoord = ~((unsigned __int128) 1 << 127);
+
+    // Past 2^64, ceil(beta^i) is only as exact as a long double; the
+    // thresholds stay increasing, which is all the structure relies on
+    long double power = 1;
+    for (int i = 0; i <= maxBuckets; ++i)
+    {
+        // Thresholds past the largest Coord can never be reached
+        if (power >= ldexpl(1, 127)) {
+            thresholds[i] = maxCoord;
+        } else {
+            thresholds[i] = (Coord) ceill(power);
+        }
+        power *= (long double) beta;
+    }
+
+    int i = 0;
+    for (int b = 0; b < 128; ++b)
+    {
+        Coord lowest = (b == 127) ? maxCoord : ((Coord) 1 << b);
+        while (i + 1 <= maxBuckets && thresholds[i + 1] <= lowest) {
+            i++;
+        }
+        bucketAtBitLength[b] = i;
+    }
+    return true;
+}
+
+std::string FatPreorder::toString(Coord x) {
+    if (x < 0) {
+        return "-" + toString(-x);
+    }
+    // 18 digits at a time, so that most values take no 128-bit division
+    const long long int chunk = 1000000000000000000LL;
+    if (x < chunk) {
+        return std::to_string((long long int) x);
+    }
+    std::string low = std::to_string((long long int) (x % chunk));
+    return toString(x / chunk) + std::string(18 - low.size(), '0') + low;
+}
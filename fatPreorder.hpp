@@ -0,0 +1,93 @@
+#ifndef FATPREORDER_H
+#define FATPREORDER_H
+
+#include <string>
+
+/*
+ * FatPreorder
+ * Integer-only arithmetic for Gabow's fat preordering, shared by
+ * ExpensiveTreeNode and ArenaTree.
+ *
+ * Every comparison the structure makes against a power of beta has the
+ * form "x < beta^i" or "beta^i <= x" for an integer x, which is equivalent
+ * to comparing x against ceil(beta^i). Those thresholds are tabulated once,
+ * so queries and rebuilds never call pow or log.
+ *
+ * Intervals grow as c * size^e, which passes 2^63 at about 36,000 nodes, so
+ * coordinates are 128-bit integers: c * size^e < 2^127 for any size up to
+ * `maxSize` (about 2^31). That is the size limit of a tree: ExpensiveTreeNode
+ * and ArenaTree refuse to grow past it, and a BasicMultilevelTreeNode, whose
+ * summary tree is bounded by it instead, reaches maxSize times its word width
+ * (over 2^40 nodes with Word512, see lcaMultilevel.hpp). 2^40 nodes in a
+ * single fat preorder would take 5 * 2^160, beyond any 128-bit coordinate.
+ */
+class FatPreorder {
+    public:
+        /* Interval endpoints, lengths and weights */
+        typedef __int128 Coord;
+
+        /* Parameters for the fat preordering proposed by Gabow */
+        static constexpr float beta = 10.0/7.0;
+        static const int e = 4;
+        static const int c = 5;
+        static constexpr float alpha = 6.0/5.0;
+
+        /* Largest subtree size whose interval fits in a Coord */
+        static const long long int maxSize = 2400000000LL;
+
+        /* Enough buckets for every Coord value (log_beta 2^127 < 247) */
+        static const int maxBuckets = 256;
+
+        /* Returns size^e */
+        static constexpr Coord power(Coord size, int exponent = e) {
+            return exponent == 0 ? 1 : size * power(size, exponent - 1);
+        }
+
+        /* Returns (c - 2) * size^e, the weight compared against thresholds */
+        static constexpr Coord weight(long long int size) {
+            return (c - 2) * power(size);
+        }
+
+        /* Returns c * size^e, the length of a buffered interval */
+        static constexpr Coord intervalLength(long long int size) {
+            return c * power(size);
+        }
+
+        /* Returns |x - y| */
+        static Coord distance(Coord x, Coord y) {return x < y ? y - x : x - y;}
+
+        /* Returns ceil(beta^i) */
+        static Coord threshold(int i) {return thresholds[i];}
+
+        /* Returns floor(log_beta(x)) for x >= 1 */
+        static inline int bucket(Coord x);
+
+        /* Returns the smallest i such that x < beta^i */
+        static int firstBucketAbove(Coord x) {return x < 1 ? 0 : bucket(x) + 1;}
+
+        /* Returns the ancestor table size for a tree with `rootSize` compressed nodes */
+        static int tableWidth(long long int rootSize) {return 1 + bucket(intervalLength(rootSize));}
+
+        /* Decimal representation of a coordinate (for printing) */
+        static std::string toString(Coord x);
+
+    private:
+        static Coord thresholds[maxBuckets + 1]; // padded with a sentinel
+        static unsigned char bucketAtBitLength[128]; // floor(log_beta(2^b))
+        static bool initialized;
+        static bool initTables();
+};
+
+inline int FatPreorder::bucket(Coord x) {
+    // Start from the bucket of the highest set bit: since beta > sqrt(2),
+    // at most two more thresholds fit before the next power of two.
+    unsigned long long high = (unsigned long long) (x >> 64);
+    int bitLength = high ? 127 - __builtin_clzll(high) : 63 - __builtin_clzll((unsigned long long) x);
+    int i = bucketAtBitLength[bitLength];
+    while (thresholds[i + 1] <= x) {
+        i++;
+    }
+    return i;
+}
+
+#endif
@@ -1,6 +1,14 @@
 #include "lcaTree.hpp"
 #include "generateRandTrees.hpp"
+#include "taskScheduler.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <iostream>
+#include <random>
 
 using namespace std;
 
@@ -8,116 +16,255 @@ using namespace std;
 /*   Private Function Declarations  */
 /*----------------------------------*/
 
-/*
- * Returns the tree corresponding to the input Prufer sequence
- * Pseudocode taken from:
- * https://en.wikipedia.org/wiki/Pr%C3%BCfer_sequence
- */
-treeAndNodes<ExpensiveTreeNode> treeFromSeq(vector<int> seq);
+/* Random numbers are drawn in chunks of this many items, each with its own generator */
+static const int chunkSize = 1 << 16;
 
-/* Converts an adjacency list representation into an ExpensiveTreeNode*/
-treeAndNodes<ExpensiveTreeNode> treeFromAdj(vector<vector<int>> adjList);
+/* Chunks generated in memory at a time when streaming to a file */
+static const int chunksPerWrite = 64;
 
-/* Given an adjacency list, runs DFS to add children to an ExpensiveTreeNode
-   representation*/
-void assignChildrenDFS(int currNode, vector<ExpensiveTreeNode*> nodes,
-                        vector<vector<int>> adjList, vector<bool> discovered);
-/*
- * Returns a representation of a sequence of "add_leaf" operations
- * that can be used to construct the input tree.
- * Note: This destroys the input and frees all memory associated with it.
- */
-vector<vector<int>> randInsertionsFromTree(ExpensiveTreeNode* root);
+/* Seed of the generator for chunk `chunk` (splitmix64 of the two) */
+static unsigned long long chunkSeed(unsigned long long seed, long long chunk);
 
-/* Returns a random leaf in the input tree */
-ExpensiveTreeNode* getRandLeaf(ExpensiveTreeNode* root);
+/* A double uniform in [0, 1), computed the same way on every platform */
+static double unitInterval(std::mt19937_64& rng);
+
+/* Calls fill(chunk) for every chunk, in parallel if a scheduler is given */
+template <typename Fill>
+static void forEachChunk(long long firstChunk, long long numChunks, TaskScheduler* scheduler, const Fill& fill);
 
 /*----------------------------------*/
 /*      Function Implementations    */
 /*----------------------------------*/
 
+static unsigned long long chunkSeed(unsigned long long seed, long long chunk) {
+    unsigned long long z = seed + 0x9E3779B97F4A7C15ULL * (chunk + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-///// Methods to implement generateStaticTree //////
+static double unitInterval(std::mt19937_64& rng) {
+    return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
 
-vector<vector<int>> randInsertionSeq(int numNodes) {
-    treeAndNodes<ExpensiveTreeNode> randTree = generateStaticTree(numNodes);
-    vector<vector<int>> insertions = randInsertionsFromTree(randTree.tree);
-    return insertions;
+template <typename Fill>
+static void forEachChunk(long long firstChunk, long long numChunks, TaskScheduler* scheduler, const Fill& fill) {
+    if (scheduler == NULL || numChunks <= 1) {
+        for (long long chunk = firstChunk; chunk < firstChunk + numChunks; ++chunk) {
+            fill(chunk);
+        }
+        return;
+    }
+    TaskGroup group(scheduler);
+    for (long long chunk = firstChunk; chunk < firstChunk + numChunks; ++chunk) {
+        group.run([&fill, chunk]() {fill(chunk);});
+    }
+    group.wait();
 }
 
-treeAndNodes<ExpensiveTreeNode> generateStaticTree(int numNodes) {
-    vector<int> seq;
-    for (int i = 0; i < numNodes - 2; ++i)
-    {
-        seq.push_back(rand() % numNodes);
+///// Random trees for tests //////
+
+vector<vector<int>> randInsertionSeq(int numNodes, unsigned long long seed) {
+    vector<int> parentOf = shapeParents(pruferShape, numNodes, 0, seed);
+    vector<int> order = insertionOrder(parentOf, randomOrder, seed + 1);
+
+    // Insertions are read from the back
+    vector<int> leaves;
+    vector<int> parents;
+    for (int k = numNodes - 1; k > 0; --k) {
+        leaves.push_back(order[k]);
+        parents.push_back(parentOf[order[k]]);
     }
-    
-    return treeFromSeq(seq);
+    return {leaves, parents};
 }
 
+vector<vector<int>> caterpillarInsertionSeq(int spineLength, int legLength) {
+    vector<int> parentOf;
+    int prevSpine = -1;
+    for (int i = 0; i < spineLength; ++i) {
+        int spine = parentOf.size();
+        parentOf.push_back(prevSpine);
+        for (int j = 0; j < legLength; ++j) {
+            parentOf.push_back(j == 0 ? spine : parentOf.size() - 1);
+        }
+        prevSpine = spine;
+    }
+
+    // Insertions are read from the back
+    vector<int> leaves;
+    vector<int> parents;
+    for (int i = parentOf.size() - 1; i > 0; --i) {
+        leaves.push_back(i);
+        parents.push_back(parentOf[i]);
+    }
+    return {leaves, parents};
+}
 
-treeAndNodes<ExpensiveTreeNode> treeFromSeq(vector<int> seq) {
-    // Construct an adjacency list representation of the tree,
-    // then convert that into an ExpensiveTreeNode tree.
-    int treeSize = seq.size() + 2;
-    vector<int> degree(treeSize);
-    vector<vector<int>> adjList;
-    adjList.resize(treeSize, vector<int>());
+///// Shapes and insertion orders for benchmarks //////
 
-    for (int i = 0; i < treeSize; ++i)
-    {
-        degree[i] = 1;
+/* Lists the children of each node in CSR form (see MultilevelTreeNode::buildFromCsr) */
+static void childrenCsr(const vector<int>& parents, vector<int>& childStart, vector<int>& childIds) {
+    int numNodes = parents.size();
+    childStart.assign(numNodes + 1, 0);
+    for (int i = 0; i < numNodes; ++i) {
+        if (parents[i] >= 0) {
+            childStart[parents[i] + 1] += 1;
+        }
+    }
+    for (int i = 0; i < numNodes; ++i) {
+        childStart[i + 1] += childStart[i];
     }
+    childIds.resize(childStart[numNodes]);
+    vector<int> nextSlot(childStart.begin(), childStart.end() - 1);
+    for (int i = 0; i < numNodes; ++i) {
+        if (parents[i] >= 0) {
+            childIds[nextSlot[parents[i]]++] = i;
+        }
+    }
+}
 
-    for (int i : seq) {
-        degree[i] += 1;
+/*
+ * Decodes a random Prüfer sequence in linear time, rooting the tree at
+ * node n - 1 (which is never removed as a leaf), then renumbers it level
+ * by level so that parents come first.
+ */
+static vector<int> randomPruferParents(int numNodes, unsigned long long seed, TaskScheduler* scheduler) {
+    vector<int> parents(numNodes, -1);
+    if (numNodes <= 2) {
+        if (numNodes == 2) {parents[1] = 0;}
+        return parents;
     }
 
-    for (int i : seq) {
-        for (int j = 0; j < treeSize; ++j)
-        {
-            if (degree[j] == 1) {
-                //Insert edge [i,j]
-                adjList[i].push_back(j);
-                adjList[j].push_back(i);
-                degree[i] += -1;
-                degree[j] += -1;
-                break;
-            }
+    vector<int> seq(numNodes - 2);
+    long long numChunks = (seq.size() + chunkSize - 1) / chunkSize;
+    forEachChunk(0, numChunks, scheduler, [&](long long chunk) {
+        std::mt19937_64 rng(chunkSeed(seed, chunk));
+        size_t end = std::min(seq.size(), (size_t) (chunk + 1) * chunkSize);
+        for (size_t k = chunk * chunkSize; k < end; ++k) {
+            seq[k] = rng() % numNodes;
         }
+    });
+    vector<int> degree(numNodes, 1);
+    for (int v : seq) {
+        degree[v] += 1;
     }
 
-    int u = -1, v = -1;
-    for (int i = 0; i < treeSize; ++i)
-    {
-        if (degree[i] == 1) {
-            if (u == -1) {
-                u = i;
-            } else {
-                v = i;
-                break;
-            }
+    int ptr = 0;
+    while (degree[ptr] != 1) {ptr++;}
+    int leaf = ptr;
+    vector<int> labeledParents(numNodes, -1);
+    for (int v : seq) {
+        labeledParents[leaf] = v;
+        if (--degree[v] == 1 && v < ptr) {
+            leaf = v;
+        } else {
+            ptr++;
+            while (degree[ptr] != 1) {ptr++;}
+            leaf = ptr;
+        }
+    }
+    labeledParents[leaf] = numNodes - 1;
+
+    vector<int> childStart;
+    vector<int> childIds;
+    childrenCsr(labeledParents, childStart, childIds);
+
+    // Breadth-first renumbering from the root n - 1
+    vector<int> newId(numNodes);
+    vector<int> queue(1, numNodes - 1);
+    queue.reserve(numNodes);
+    newId[numNodes - 1] = 0;
+    for (size_t head = 0; head < queue.size(); ++head) {
+        int node = queue[head];
+        for (int k = childStart[node]; k < childStart[node + 1]; ++k) {
+            newId[childIds[k]] = queue.size();
+            parents[queue.size()] = newId[node];
+            queue.push_back(childIds[k]);
         }
     }
+    return parents;
+}
 
-    adjList[u].push_back(v);
-    adjList[v].push_back(u);
+vector<int> shapeParents(TreeShape shape, int numNodes, int arity, unsigned long long seed, TaskScheduler* scheduler) {
+    if (shape == pruferShape) {
+        return randomPruferParents(numNodes, seed, scheduler);
+    }
 
-    return (treeFromAdj(adjList));
+    vector<int> parents(numNodes, -1);
+    long long numChunks = ((long long) numNodes + chunkSize - 1) / chunkSize;
+    forEachChunk(0, numChunks, scheduler, [&](long long chunk) {
+        std::mt19937_64 rng(chunkSeed(seed, chunk));
+        int end = std::min((long long) numNodes, (chunk + 1) * chunkSize);
+        for (int i = std::max(1LL, chunk * chunkSize); i < end; ++i) {
+            switch (shape) {
+                case pathShape:        parents[i] = i - 1; break;
+                case starShape:        parents[i] = 0; break;
+                case caterpillarShape: parents[i] = (i % 2 == 1) ? i - 1 : i - 2; break; // odd nodes are legs
+                case karyShape:        parents[i] = (i - 1) / arity; break;
+                default:               parents[i] = rng() % i; break;
+            }
+        }
+    });
+    return parents;
 }
 
-treeAndNodes<ExpensiveTreeNode> treeFromAdj(vector<vector<int>> adjList) {
-    int treeSize = adjList.size();
+vector<int> insertionOrder(const vector<int>& parents, InsertionOrder order, unsigned long long seed) {
+    int numNodes = parents.size();
+    vector<int> result;
+    result.reserve(numNodes);
+    if (order == idOrder) {
+        for (int i = 0; i < numNodes; ++i) {
+            result.push_back(i);
+        }
+        return result;
+    }
+
+    vector<int> childStart;
+    vector<int> childIds;
+    childrenCsr(parents, childStart, childIds);
+    int root = 0;
+    while (root < numNodes && parents[root] >= 0) {root++;}
+    if (root == numNodes) {
+        return result;
+    }
+
+    if (order == bfsOrder) {
+        result.push_back(root);
+        for (size_t head = 0; head < result.size(); ++head) {
+            int node = result[head];
+            result.insert(result.end(), childIds.begin() + childStart[node], childIds.begin() + childStart[node + 1]);
+        }
+        return result;
+    }
 
-    vector<ExpensiveTreeNode*> nodes(treeSize);
-    vector<bool> discovered(treeSize);
-    for (int i = 0; i < treeSize; ++i)
-    {
-        nodes[i] = new ExpensiveTreeNode(to_string(i));
-        discovered[i] = false;
+    // Depth-first takes the newest available node, random order a random one
+    std::mt19937_64 rng(seed);
+    vector<int> available(1, root);
+    while (!available.empty()) {
+        if (order == randomOrder) {
+            std::swap(available[rng() % available.size()], available.back());
+        }
+        int node = available.back();
+        available.pop_back();
+        result.push_back(node);
+        for (int k = childStart[node + 1] - 1; k >= childStart[node]; --k) {
+            available.push_back(childIds[k]);
+        }
     }
+    return result;
+}
 
-    assignChildrenDFS(0, nodes, adjList, discovered);
+
+treeAndNodes<ExpensiveTreeNode> generateStaticTree(int numNodes, unsigned long long seed) {
+    vector<int> parents = shapeParents(pruferShape, numNodes, 0, seed);
+
+    vector<ExpensiveTreeNode*> nodes(numNodes);
+    for (int i = 0; i < numNodes; ++i) {
+        nodes[i] = new ExpensiveTreeNode(i);
+        if (parents[i] >= 0) {
+            nodes[parents[i]]->addLeafNoPreprocessing(nodes[i]);
+        }
+    }
 
     treeAndNodes<ExpensiveTreeNode> toReturn;
     toReturn.tree = nodes[0];
@@ -125,92 +272,306 @@ treeAndNodes<ExpensiveTreeNode> treeFromAdj(vector<vector<int>> adjList) {
     return toReturn;
 }
 
-void assignChildrenDFS(int currNode, vector<ExpensiveTreeNode*> nodes, vector<vector<int>> adjList, vector<bool> discovered) {
-    discovered[currNode] = true;
-    for (int childNode : adjList[currNode]) {
-        if (!discovered[childNode]) {
-            nodes[currNode]->addLeafNoPreprocessing(nodes[childNode]);
-            assignChildrenDFS(childNode, nodes, adjList, discovered);
-        }
+///// Generalizations of getStaticTree for other types of trees //////
+
+/* Builds the tree of a random Prüfer sequence with add_leaf, in random order */
+template <typename T>
+static treeAndNodes<T> incrementalTree(int numNodes, unsigned long long seed) {
+    vector<int> parents = shapeParents(pruferShape, numNodes, 0, seed);
+    vector<int> order = insertionOrder(parents, randomOrder, seed + 1);
+
+    vector<T*> nodes(numNodes);
+    for (int i = 0; i < numNodes; ++i) {
+        nodes[i] = new T(i);
     }
+    for (int k = 1; k < numNodes; ++k) {
+        nodes[parents[order[k]]]->add_leaf(nodes[order[k]]);
+    }
+
+    treeAndNodes<T> toReturn;
+    toReturn.tree = nodes[0];
+    toReturn.nodes = nodes;
+    return toReturn;
 }
 
-vector<vector<int>> randInsertionsFromTree(ExpensiveTreeNode* root) {
-    vector<int> leafIds;
-    vector<int> parentIds;
+treeAndNodes<ExpensiveTreeNode> generateIncrementalTree(int numNodes, unsigned long long seed) {
+    return incrementalTree<ExpensiveTreeNode>(numNodes, seed);
+}
 
-    while(root->uncompressedChildren.size() > 0) {
-        ExpensiveTreeNode* leaf = getRandLeaf(root);
-        leafIds.push_back(stoi(leaf->nodeId));
-        if (leaf->uncompressedParent){
-            parentIds.push_back(stoi(leaf->uncompressedParent->nodeId));
-        }
-        leaf->deleteNode();
-    }
+treeAndNodes<MultilevelTreeNode> generateIncrementalMultilevelTree(int numNodes, unsigned long long seed) {
+    return incrementalTree<MultilevelTreeNode>(numNodes, seed);
+}
 
-    root->deleteNode();
+///// Query workloads //////
+
+/* Draws the queries of one chunk; shared by generateQueries and streamQueries */
+class QuerySampler {
+    public:
+        QuerySampler(const vector<int>& parents, QueryDistribution distribution, double zipfExponent)
+                : parents(parents), distribution(distribution), zipfExponent(zipfExponent), numNodes(parents.size()) {
+            if (distribution == subtreeQueries) {
+                // Subtrees are contiguous ranges of the preorder
+                preorder = insertionOrder(parents, dfsOrder, 0);
+                position.resize(numNodes);
+                for (int k = 0; k < numNodes; ++k) {
+                    position[preorder[k]] = k;
+                }
+                subtreeSize.assign(numNodes, 1);
+                for (int k = numNodes - 1; k > 0; --k) {
+                    subtreeSize[parents[preorder[k]]] += subtreeSize[preorder[k]];
+                }
+            }
+        }
 
-    // The root has no parent - just assume it has been initialized already
+        void fill(long long chunk, unsigned long long seed, std::pair<int, int>* queries, int count) const {
+            std::mt19937_64 rng(chunkSeed(seed, chunk));
+            for (int k = 0; k < count; ++k) {
+                if (distribution == uniformQueries) {
+                    queries[k].first = rng() % numNodes;
+                    queries[k].second = rng() % numNodes;
+                } else if (distribution == zipfQueries) {
+                    queries[k].first = zipfNode(rng);
+                    queries[k].second = zipfNode(rng);
+                } else {
+                    int x = rng() % numNodes;
+                    int top = x;
+                    for (int steps = 1 + rng() % 8; steps > 0 && parents[top] >= 0; --steps) {
+                        top = parents[top];
+                    }
+                    queries[k] = std::make_pair(x, preorder[position[top] + rng() % subtreeSize[top]]);
+                }
+            }
+        }
 
-    return {leafIds, parentIds};
+    private:
+        const vector<int>& parents;
+        QueryDistribution distribution;
+        double zipfExponent;
+        int numNodes;
+        vector<int> preorder;
+        vector<int> position;
+        vector<int> subtreeSize;
+
+        /*
+         * Inverse of the continuous approximation of the Zipf CDF. Ranks are
+         * scattered over the ids by a fixed bijection (1000000007 is prime,
+         * so coprime with any int-sized `numNodes`).
+         */
+        int zipfNode(std::mt19937_64& rng) const {
+            double u = unitInterval(rng);
+            double rank;
+            if (fabs(zipfExponent - 1.0) < 1e-9) {
+                rank = exp(u * log(numNodes + 1.0)) - 1;
+            } else {
+                double oneMinusS = 1.0 - zipfExponent;
+                rank = pow(u * (pow(numNodes + 1.0, oneMinusS) - 1) + 1, 1 / oneMinusS) - 1;
+            }
+            unsigned long long r = std::min((double) numNodes - 1, std::max(0.0, floor(rank)));
+            return (r * 1000000007ULL + 12345) % numNodes;
+        }
+};
+
+vector<std::pair<int, int>> generateQueries(const vector<int>& parents, QueryDistribution distribution, int numQueries,
+                                            double zipfExponent, unsigned long long seed, TaskScheduler* scheduler) {
+    QuerySampler sampler(parents, distribution, zipfExponent);
+    vector<std::pair<int, int>> queries(numQueries);
+    long long numChunks = ((long long) numQueries + chunkSize - 1) / chunkSize;
+    forEachChunk(0, numChunks, scheduler, [&](long long chunk) {
+        long long first = chunk * chunkSize;
+        sampler.fill(chunk, seed, &queries[first], std::min((long long) chunkSize, numQueries - first));
+    });
+    return queries;
 }
 
-ExpensiveTreeNode* getRandLeaf(ExpensiveTreeNode* root) {
-    ExpensiveTreeNode* currNode = root;
-    std::list<ExpensiveTreeNode*> children = currNode->uncompressedChildren;
-    while (children.size() > 0) {
-        size_t childNum = rand() % children.size();
-        std::list<ExpensiveTreeNode*>::iterator it = std::next(children.begin(), childNum);
-        currNode = *it;
-        children = currNode->uncompressedChildren;
+///// Workload files //////
+
+/*
+ * Header of a workload file, stored as little-endian fields:
+ *   magic "LCAWORK\0", version (4 bytes), kind (4 bytes),
+ *   number of records, number of nodes, seed (8 bytes each)
+ */
+static const char workloadMagic[8] = {'L', 'C', 'A', 'W', 'O', 'R', 'K', '\0'};
+static const uint32_t workloadVersion = 1;
+static const int workloadHeaderSize = 40;
+static const int workloadRecordSize = 8;
+static const size_t recordsPerBuffer = 1 << 16;
+
+static void putLittleEndian(unsigned char* out, unsigned long long value, int bytes) {
+    for (int b = 0; b < bytes; ++b) {
+        out[b] = (value >> (8 * b)) & 0xFF;
     }
-    return currNode;
 }
 
-///// Generalizations of getStaticTree for other types of trees //////
+static unsigned long long getLittleEndian(const unsigned char* in, int bytes) {
+    unsigned long long value = 0;
+    for (int b = bytes - 1; b >= 0; --b) {
+        value = (value << 8) | in[b];
+    }
+    return value;
+}
 
-treeAndNodes<ExpensiveTreeNode> generateIncrementalTree(int numNodes) {
-    vector<vector<int>> sequences = randInsertionSeq(numNodes);
-    vector<int> leaves = sequences[0];
-    vector<int> parents = sequences[1];
+static bool writeWorkloadHeader(FILE* file, WorkloadKind kind, unsigned long long numRecords,
+                                unsigned long long numNodes, unsigned long long seed) {
+    unsigned char header[workloadHeaderSize];
+    memcpy(header, workloadMagic, 8);
+    putLittleEndian(header + 8, workloadVersion, 4);
+    putLittleEndian(header + 12, kind, 4);
+    putLittleEndian(header + 16, numRecords, 8);
+    putLittleEndian(header + 24, numNodes, 8);
+    putLittleEndian(header + 32, seed, 8);
+    return fwrite(header, 1, workloadHeaderSize, file) == (size_t) workloadHeaderSize;
+}
 
-    vector<ExpensiveTreeNode*> nodes(numNodes);
-    for (int i = 0; i < numNodes; ++i)
-    {
-        nodes[i] = new ExpensiveTreeNode(std::to_string(i));
+/* Reads and checks the header. Returns false if the file is not a workload of this kind. */
+static bool readWorkloadHeader(FILE* file, WorkloadKind kind, unsigned long long& numRecords, unsigned long long& numNodes) {
+    unsigned char header[workloadHeaderSize];
+    if (fread(header, 1, workloadHeaderSize, file) != (size_t) workloadHeaderSize ||
+        memcmp(header, workloadMagic, 8) != 0 ||
+        getLittleEndian(header + 8, 4) != workloadVersion ||
+        getLittleEndian(header + 12, 4) != (unsigned long long) kind) {
+        return false;
+    }
+    numRecords = getLittleEndian(header + 16, 8);
+    numNodes = getLittleEndian(header + 24, 8);
+
+    // The file must hold exactly the records the header announces, checked
+    // before the readers allocate room for them
+    struct stat info;
+    if (fstat(fileno(file), &info) != 0 || info.st_size < workloadHeaderSize ||
+        numRecords != (unsigned long long) (info.st_size - workloadHeaderSize) / workloadRecordSize ||
+        (info.st_size - workloadHeaderSize) % workloadRecordSize != 0) {
+        return false;
     }
+    return numNodes <= 0x7FFFFFFF;
+}
 
-    ExpensiveTreeNode* root = nodes[parents[parents.size() - 1]];
+/* Writes records (first[k], second[k]); -1 is stored as 0xFFFFFFFF */
+static bool writeRecords(FILE* file, const std::pair<int, int>* records, size_t count) {
+    vector<unsigned char> buffer(std::min(count, recordsPerBuffer) * workloadRecordSize);
+    for (size_t first = 0; first < count; first += recordsPerBuffer) {
+        size_t n = std::min(count - first, recordsPerBuffer);
+        for (size_t k = 0; k < n; ++k) {
+            putLittleEndian(&buffer[k * workloadRecordSize], (uint32_t) records[first + k].first, 4);
+            putLittleEndian(&buffer[k * workloadRecordSize + 4], (uint32_t) records[first + k].second, 4);
+        }
+        if (fwrite(buffer.data(), workloadRecordSize, n, file) != n) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    for (int i = leaves.size() - 1; i >= 0; --i) {
-        nodes[parents[i]]->add_leaf(nodes[leaves[i]]);
+static bool readRecords(FILE* file, std::pair<int, int>* records, size_t count) {
+    vector<unsigned char> buffer(std::min(count, recordsPerBuffer) * workloadRecordSize);
+    for (size_t first = 0; first < count; first += recordsPerBuffer) {
+        size_t n = std::min(count - first, recordsPerBuffer);
+        if (fread(buffer.data(), workloadRecordSize, n, file) != n) {
+            return false;
+        }
+        for (size_t k = 0; k < n; ++k) {
+            records[first + k].first = (int32_t) getLittleEndian(&buffer[k * workloadRecordSize], 4);
+            records[first + k].second = (int32_t) getLittleEndian(&buffer[k * workloadRecordSize + 4], 4);
+        }
     }
-    
-    treeAndNodes<ExpensiveTreeNode> toReturn;
-    toReturn.tree = root;
-    toReturn.nodes = nodes;
-    return toReturn;
+    return true;
+}
+
+/* Closes the file, and checks that nothing follows the records */
+static bool finishReading(FILE* file, bool ok) {
+    ok = ok && fgetc(file) == EOF;
+    fclose(file);
+    return ok;
 }
 
-treeAndNodes<MultilevelTreeNode> generateIncrementalMultilevelTree(int numNodes) {
-    std::vector<std::vector<int>> sequences = randInsertionSeq(numNodes);
-    std::vector<int> leaves = sequences[0];
-    std::vector<int> parents = sequences[1];
+bool writeInsertions(const char* path, const vector<int>& parents, const vector<int>& order, unsigned long long seed) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = writeWorkloadHeader(file, insertionWorkload, order.size(), parents.size(), seed);
+    vector<std::pair<int, int>> records;
+    for (size_t first = 0; ok && first < order.size(); first += recordsPerBuffer) {
+        size_t end = std::min(order.size(), first + recordsPerBuffer);
+        records.clear();
+        for (size_t k = first; k < end; ++k) {
+            records.push_back(std::make_pair(order[k], parents[order[k]]));
+        }
+        ok = writeRecords(file, records.data(), records.size());
+    }
+    return fclose(file) == 0 && ok;
+}
 
-    std::vector<MultilevelTreeNode*> nodes(numNodes);
-    for (int i = 0; i < numNodes; ++i)
-    {
-        nodes[i] = new MultilevelTreeNode(std::to_string(i));
+bool readInsertions(const char* path, vector<int>& parents, vector<int>& order) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
     }
+    unsigned long long numRecords, numNodes;
+    if (!readWorkloadHeader(file, insertionWorkload, numRecords, numNodes) || numRecords != numNodes) {
+        return finishReading(file, false);
+    }
+    vector<std::pair<int, int>> records(numRecords);
+    bool ok = readRecords(file, records.data(), records.size());
+
+    // Every node is inserted once, after its parent; only the first one is a root
+    vector<bool> present(numNodes, false);
+    parents.assign(numNodes, -1);
+    order.clear();
+    for (size_t k = 0; ok && k < records.size(); ++k) {
+        int child = records[k].first;
+        int parent = records[k].second;
+        ok = child >= 0 && child < (int) numNodes && !present[child] &&
+             ((k == 0) ? parent == -1 : (parent >= 0 && parent < (int) numNodes && present[parent]));
+        if (ok) {
+            present[child] = true;
+            parents[child] = parent;
+            order.push_back(child);
+        }
+    }
+    return finishReading(file, ok);
+}
 
-    MultilevelTreeNode* root = nodes[parents[parents.size() - 1]];
+bool streamQueries(const char* path, const vector<int>& parents, QueryDistribution distribution, long long numQueries,
+                   double zipfExponent, unsigned long long seed, TaskScheduler* scheduler) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = writeWorkloadHeader(file, queryWorkload, numQueries, parents.size(), seed);
+
+    // Same chunks as generateQueries, a window of them at a time
+    QuerySampler sampler(parents, distribution, zipfExponent);
+    long long numChunks = (numQueries + chunkSize - 1) / chunkSize;
+    vector<std::pair<int, int>> window;
+    for (long long firstChunk = 0; ok && firstChunk < numChunks; firstChunk += chunksPerWrite) {
+        long long windowChunks = std::min((long long) chunksPerWrite, numChunks - firstChunk);
+        long long firstQuery = firstChunk * chunkSize;
+        long long windowQueries = std::min(windowChunks * chunkSize, numQueries - firstQuery);
+        window.resize(windowQueries);
+        forEachChunk(firstChunk, windowChunks, scheduler, [&](long long chunk) {
+            long long first = chunk * chunkSize;
+            sampler.fill(chunk, seed, &window[first - firstQuery], std::min((long long) chunkSize, numQueries - first));
+        });
+        ok = writeRecords(file, window.data(), window.size());
+    }
+    return fclose(file) == 0 && ok;
+}
 
-    for (int i = leaves.size() - 1; i >= 0; --i) {
-        nodes[parents[i]]->add_leaf(nodes[leaves[i]]);
+bool readQueries(const char* path, vector<std::pair<int, int>>& queries, int& numNodes) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
     }
-    
-    treeAndNodes<MultilevelTreeNode> toReturn;
-    toReturn.tree = root;
-    toReturn.nodes = nodes;
-    return toReturn;
+    unsigned long long numRecords, nodes;
+    if (!readWorkloadHeader(file, queryWorkload, numRecords, nodes) || numRecords > 0x7FFFFFFF) {
+        return finishReading(file, false);
+    }
+    queries.resize(numRecords);
+    bool ok = readRecords(file, queries.data(), queries.size());
+    for (size_t k = 0; ok && k < queries.size(); ++k) {
+        ok = queries[k].first >= 0 && queries[k].first < (int) nodes &&
+             queries[k].second >= 0 && queries[k].second < (int) nodes;
+    }
+    numNodes = nodes;
+    return finishReading(file, ok);
 }
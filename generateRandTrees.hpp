@@ -1,38 +1,121 @@
 #include "lcaTree.hpp"
 #include "lcaMultilevel.hpp"
+#include <utility>
 #include <vector>
 
 using std::vector;
 
+class TaskScheduler;
+
 template <typename T>
 struct treeAndNodes {
     T* tree;
     std::vector<T*> nodes;
 };
 
+/*
+ * Every generator takes an explicit seed, runs in O(n) time, and gives the
+ * same output on every platform and for any number of threads: random
+ * numbers come from std::mt19937_64 (fully specified by the standard),
+ * drawn in fixed chunks that each get their own generator derived from the
+ * seed. Generators taking a TaskScheduler fill the chunks in parallel.
+ */
+
 /*
  * Returns a representation of a sequence of "add_leaf" operations
  * that construct a random tree.
  *
  * Output: [leafIds, parentIds] where leafIds and parentIds
  *    are both vectors of ints. Starting with a tree consisting
- *    of a single node with id parentIds[0], inserting the node
- *    leafIds[i] as a child of parentIds[i] will produce a random
- *    tree.
+ *    of a single node with id parentIds.back(), inserting the node
+ *    leafIds[i] as a child of parentIds[i], for i going down from
+ *    leafIds.size() - 1 to 0, will produce a random tree.
+ */
+vector<vector<int>> randInsertionSeq(int numNodes, unsigned long long seed);
+
+/*
+ * Returns the insertion sequence (in the format of randInsertionSeq) of a
+ * caterpillar: a path of `spineLength` nodes, each of which carries a leg
+ * of `legLength` more nodes. A `legLength` of 0 gives a path. Ids follow
+ * the order of insertion, starting with the root 0.
+ */
+vector<vector<int>> caterpillarInsertionSeq(int spineLength, int legLength);
+
+/*
+ * Shapes of trees for benchmarks, generated in O(n) time as parent arrays:
+ * parents[0] is -1 (the root) and parents[i] < i for every other node i.
+ *   pathShape:        node i hangs below node i - 1
+ *   starShape:        every node hangs below the root
+ *   caterpillarShape: a path in which every node carries one leaf
+ *   karyShape:        the complete `arity`-ary tree, numbered level by level
+ *   recursiveShape:   node i hangs below a uniformly random earlier node
+ *   pruferShape:      a uniformly random labeled tree (decoded from a random
+ *                     Prüfer sequence), renumbered level by level
+ * Random shapes draw from a std::mt19937_64 seeded with `seed`.
+ */
+enum TreeShape {pathShape, starShape, caterpillarShape, karyShape, recursiveShape, pruferShape};
+vector<int> shapeParents(TreeShape shape, int numNodes, int arity, unsigned long long seed,
+                         TaskScheduler* scheduler = NULL);
+
+/*
+ * Orders in which the nodes of a parent array can be inserted with
+ * add_leaf (every parent precedes its children), in O(n) time:
+ *   idOrder:     0, 1, ..., n - 1
+ *   bfsOrder:    level by level
+ *   dfsOrder:    preorder
+ *   randomOrder: a uniformly random node whose parent is already present
+ */
+enum InsertionOrder {idOrder, bfsOrder, dfsOrder, randomOrder};
+vector<int> insertionOrder(const vector<int>& parents, InsertionOrder order, unsigned long long seed);
+
+/*
+ * Query workloads, as pairs of node ids of a parent array:
+ *   uniformQueries: both nodes uniformly at random
+ *   zipfQueries:    both nodes drawn from a Zipf distribution with exponent
+ *                   `zipfExponent` over all nodes (ranks are scattered over
+ *                   the ids, so hot nodes are spread out)
+ *   subtreeQueries: a uniform node x, and a uniform node in the subtree of
+ *                   the ancestor of x between 1 and 8 levels up
+ */
+enum QueryDistribution {uniformQueries, zipfQueries, subtreeQueries};
+vector<std::pair<int, int>> generateQueries(const vector<int>& parents, QueryDistribution distribution, int numQueries,
+                                            double zipfExponent, unsigned long long seed,
+                                            TaskScheduler* scheduler = NULL);
+
+/*
+ * Workload files, so that runs can be repeated exactly on other machines.
+ * A file holds a 40-byte header (magic "LCAWORK", version, kind, number of
+ * records, number of nodes, seed) followed by records of two 32-bit
+ * integers, all little-endian:
+ *   insertion files: (child, parent) in insertion order, the first one
+ *                    being (root, -1)
+ *   query files:     (x, y)
+ * Writers and readers return false on I/O errors; readers also reject
+ * files that are truncated, of the wrong kind, or refer to invalid nodes.
+ */
+enum WorkloadKind {insertionWorkload = 1, queryWorkload = 2};
+bool writeInsertions(const char* path, const vector<int>& parents, const vector<int>& order, unsigned long long seed);
+bool readInsertions(const char* path, vector<int>& parents, vector<int>& order);
+
+/*
+ * Writes the queries generateQueries would return, generating a window of
+ * chunks at a time so that the workload never has to fit in memory.
  */
-vector<vector<int>> randInsertionSeq(int numNodes);
+bool streamQueries(const char* path, const vector<int>& parents, QueryDistribution distribution, long long numQueries,
+                   double zipfExponent, unsigned long long seed, TaskScheduler* scheduler = NULL);
+bool readQueries(const char* path, vector<std::pair<int, int>>& queries, int& numNodes);
 
 /*
  * Returns a random ExpensiveTreeNode tree (with no preprocessing)
  * generated from a random Prüfer sequence, along with a vector of
  * all nodes in the tree
  */
-treeAndNodes<ExpensiveTreeNode> generateStaticTree(int numNodes);
+treeAndNodes<ExpensiveTreeNode> generateStaticTree(int numNodes, unsigned long long seed);
 
-/* Returns a random ExpensiveTreeNode tree, built using add_leaf */
-treeAndNodes<ExpensiveTreeNode> generateIncrementalTree(int numNodes);
+/* Returns a random ExpensiveTreeNode tree, built using add_leaf in a random order */
+treeAndNodes<ExpensiveTreeNode> generateIncrementalTree(int numNodes, unsigned long long seed);
 
-/* Returns a random MultilevelTreeNode, built using add_leaf */
-treeAndNodes<MultilevelTreeNode> generateIncrementalMultilevelTree(int numNodes);
+/* Returns a random MultilevelTreeNode, built using add_leaf in a random order */
+treeAndNodes<MultilevelTreeNode> generateIncrementalMultilevelTree(int numNodes, unsigned long long seed);
 
 
@@ -0,0 +1,464 @@
+#include "lcaArena.hpp"
+#include <assert.h>
+
+typedef ArenaTree::index index;
+
+const index ArenaTree::NIL;
+
+///////////////////////////////////////////
+////////    Basic Tree Operations   ///////
+///////////////////////////////////////////
+
+ArenaTree::ArenaTree(size_t capacity) {
+    hot.reserve(capacity);
+    cold.reserve(capacity);
+    tableWidth = 0;
+    treeRoot = NIL;
+}
+
+index ArenaTree::newNode() {
+    if ((long long int) hot.size() >= FatPreorder::maxSize) {
+        return NIL;
+    }
+
+    // Initialize values as if this node were the sole node in a tree
+    HotFields h;
+    h.start = 1; // The buffer is subtreeSize^{e} == 1
+    h.end = c - 1;
+    h.sizeWeight = FatPreorder::weight(1);
+    h.parent = NIL;
+    h.heavyChild = NIL;
+    h.subtreeSize = 1;
+    h.uncompressedLevel = 0;
+    h.isApex = true;
+
+    ColdFields cf;
+    cf.uncompressedParent = NIL;
+    cf.firstChild = NIL;
+    cf.lastChild = NIL;
+    cf.nextSibling = NIL;
+    cf.firstCompressedChild = NIL;
+    cf.lastCompressedChild = NIL;
+    cf.nextCompressedSibling = NIL;
+    cf.dynamicSubtreeSize = 1;
+    cf.startBuffered = 0;
+    cf.endBuffered = c; // == c * subtreeSize^{e} because subtreeSize is 1
+    cf.largestChildEndBuffer = 1; // Equal to `start`
+
+    hot.push_back(h);
+    cold.push_back(cf);
+    return hot.size() - 1;
+}
+
+void ArenaTree::addLeafNoPreprocessing(index parent, index child) {
+    ColdFields& p = cold[parent];
+    if (p.lastChild == NIL) {
+        p.firstChild = child;
+    } else {
+        cold[p.lastChild].nextSibling = child;
+    }
+    p.lastChild = child;
+    cold[child].uncompressedParent = parent;
+}
+
+///////////////////
+// Preprocessing //
+///////////////////
+
+void ArenaTree::preprocess(index rootNode) {
+    treeRoot = rootNode;
+
+    assignSubtreeSizes(rootNode, false); // Subtree sizes based on uncompressed values
+    assignApex(rootNode);
+    assignLevels(rootNode);
+
+    compressTree(rootNode);
+    assignSubtreeSizes(rootNode, true); // Subtree sizes based on compressed values
+
+    cold[rootNode].startBuffered = 0;
+    cold[rootNode].endBuffered = FatPreorder::intervalLength(hot[rootNode].subtreeSize);
+    contAssignIntervals(rootNode);
+    fillAllAncestors(rootNode);
+}
+
+void ArenaTree::recompress(index node) {
+    assignSubtreeSizes(node, false);
+    assignApex(node); // Treat the current node as the "root"
+
+    compressTree(node);
+    assignSubtreeSizes(node, true);
+
+    ColdFields& cf = cold[node];
+    index parent = hot[node].parent;
+    if (parent != NIL) {
+        // assign this buffered interval <- [Q(u), Q(u) + cs(v)^e]
+        cf.startBuffered = cold[parent].largestChildEndBuffer;
+        cf.endBuffered = cf.startBuffered + FatPreorder::intervalLength(hot[node].subtreeSize);
+        cold[parent].largestChildEndBuffer = cf.endBuffered;
+    } else {
+        cf.startBuffered = 0;
+        cf.endBuffered = FatPreorder::intervalLength(hot[node].subtreeSize);
+    }
+    contAssignIntervals(node);
+}
+
+void ArenaTree::collectPreorder(index node, bool useCompressed) {
+    order.clear();
+    stack.clear();
+    stack.push_back(node);
+    while (!stack.empty()) {
+        index curr = stack.back();
+        stack.pop_back();
+        order.push_back(curr);
+
+        // Push children in reverse so they are visited in list order
+        size_t mark = stack.size();
+        index child = useCompressed ? cold[curr].firstCompressedChild : cold[curr].firstChild;
+        while (child != NIL) {
+            stack.push_back(child);
+            child = useCompressed ? cold[child].nextCompressedSibling : cold[child].nextSibling;
+        }
+        for (size_t i = mark, j = stack.size(); i + 1 < j; ++i, --j) {
+            index tmp = stack[i];
+            stack[i] = stack[j - 1];
+            stack[j - 1] = tmp;
+        }
+    }
+}
+
+void ArenaTree::assignSubtreeSizes(index node, bool useCompressed) {
+    collectPreorder(node, useCompressed);
+    for (index v : order) {
+        hot[v].subtreeSize = 1;
+    }
+
+    // Children appear after their parents, so a reverse sweep is a postorder
+    for (size_t i = order.size() - 1; i > 0; --i) {
+        index v = order[i];
+        index p = useCompressed ? hot[v].parent : cold[v].uncompressedParent;
+        hot[p].subtreeSize += hot[v].subtreeSize;
+    }
+    for (index v : order) {
+        hot[v].sizeWeight = FatPreorder::weight(hot[v].subtreeSize);
+        cold[v].dynamicSubtreeSize = hot[v].subtreeSize;
+    }
+}
+
+// A node is apex if it is not a heavy child
+void ArenaTree::assignApex(index node) {
+    collectPreorder(node, false);
+    hot[node].isApex = true;
+    for (size_t i = 1; i < order.size(); ++i) {
+        index v = order[i];
+        index p = cold[v].uncompressedParent;
+        hot[v].isApex = (hot[v].subtreeSize * 2 <= hot[p].subtreeSize);
+        if (!hot[v].isApex) {
+            hot[p].heavyChild = v;
+        }
+    }
+}
+
+void ArenaTree::assignLevels(index node) {
+    collectPreorder(node, false);
+    hot[node].uncompressedLevel = 0;
+    for (size_t i = 1; i < order.size(); ++i) {
+        index v = order[i];
+        hot[v].uncompressedLevel = hot[cold[v].uncompressedParent].uncompressedLevel + 1;
+    }
+}
+
+// The uncompressed fields remain unchanged
+// "parent", compressed children and "subtreeSize" now refer to the compressed tree
+void ArenaTree::compressTree(index node) {
+    collectPreorder(node, false);
+    for (index v : order) {
+        cold[v].firstCompressedChild = NIL;
+        cold[v].lastCompressedChild = NIL;
+    }
+
+    for (index v : order) {
+        index up = cold[v].uncompressedParent;
+        if (up == NIL) {
+            continue; // root in original => root in compressed
+        }
+
+        // The closest apex is either the uncompressed parent or its compressed parent
+        // (which has already been updated, since parents precede children)
+        index p = hot[up].isApex ? up : hot[up].parent;
+        hot[v].parent = p;
+
+        // `node` keeps its position in its (unchanged) parent's child list
+        if (v != node && p != NIL) {
+            ColdFields& pc = cold[p];
+            if (pc.lastCompressedChild == NIL) {
+                pc.firstCompressedChild = v;
+            } else {
+                cold[pc.lastCompressedChild].nextCompressedSibling = v;
+            }
+            pc.lastCompressedChild = v;
+            cold[v].nextCompressedSibling = NIL;
+        }
+    }
+}
+
+void ArenaTree::contAssignIntervals(index node) {
+    collectPreorder(node, true);
+
+    // Parents precede children, so each node's buffered interval is set before it is visited
+    for (index v : order) {
+        HotFields& h = hot[v];
+        ColdFields& cf = cold[v];
+
+        FatPreorder::Coord buffer = FatPreorder::power(h.subtreeSize);
+        h.start = cf.startBuffered + buffer;
+        h.end = cf.endBuffered - buffer;
+
+        cf.largestChildEndBuffer = h.start; //Edge case when there are no children
+
+        FatPreorder::Coord currChildStart = h.start + 1;
+        FatPreorder::Coord intervalSize;
+        for (index child = cf.firstCompressedChild; child != NIL; child = cold[child].nextCompressedSibling) {
+            intervalSize = FatPreorder::intervalLength(hot[child].subtreeSize);
+            cold[child].startBuffered = currChildStart;
+            cold[child].endBuffered = currChildStart + intervalSize;
+            currChildStart = currChildStart + intervalSize + 1;
+
+            // Mantain "largest" augmented value
+            cf.largestChildEndBuffer = currChildStart + intervalSize;
+        }
+    }
+}
+
+void ArenaTree::fillAllAncestors(index node) {
+    int width = FatPreorder::tableWidth(hot[treeRoot].subtreeSize);
+    if (width != tableWidth) {
+        // Only happens when the whole tree was rebuilt: every table is refilled
+        tableWidth = width;
+        ancestors.assign(hot.size() * tableWidth, NIL);
+        node = treeRoot;
+    } else if (ancestors.size() < hot.size() * tableWidth) {
+        ancestors.resize(hot.size() * tableWidth, NIL);
+    }
+
+    collectPreorder(node, true);
+    for (index v : order) {
+        fillAncestorTable(v);
+    }
+}
+
+void ArenaTree::fillAncestorTable(index node) {
+    index* table = &ancestors[(size_t) node * tableWidth];
+    for (int i = 0; i < tableWidth; ++i) {
+        table[i] = NIL;
+    }
+
+    // Entry i is the highest ancestor whose weight is below beta^i
+    int i = FatPreorder::firstBucketAbove(hot[node].sizeWeight);
+    index currNode = node;
+    index nextNode = hot[currNode].parent;
+
+    bool currIsLess;
+    bool nextIsMore;
+    while (currNode != NIL) {
+        currIsLess = hot[currNode].sizeWeight < FatPreorder::threshold(i);
+        nextIsMore = nextNode == NIL || (hot[nextNode].sizeWeight >= FatPreorder::threshold(i));
+        while (currIsLess && nextIsMore && i < tableWidth) {
+            table[i] = currNode;
+            i += 1;
+
+            currIsLess = hot[currNode].sizeWeight < FatPreorder::threshold(i);
+            nextIsMore = nextNode == NIL || (hot[nextNode].sizeWeight >= FatPreorder::threshold(i));
+        }
+
+        currNode = nextNode;
+        nextNode = (nextNode != NIL) ? hot[nextNode].parent : NIL;
+    }
+}
+
+////////////////////////
+// Dynamic Operations //
+////////////////////////
+
+void ArenaTree::add_leaf(index parent, index leaf) {
+    if (treeRoot == NIL) {
+        // Tree was never preprocessed: its root is the top of `parent`'s path
+        treeRoot = parent;
+        while (cold[treeRoot].uncompressedParent != NIL) {
+            treeRoot = cold[treeRoot].uncompressedParent;
+        }
+    }
+
+    // Add leaf to original tree
+    addLeafNoPreprocessing(parent, leaf);
+    hot[leaf].uncompressedLevel = hot[parent].uncompressedLevel + 1;
+
+    // Set leaf path
+    hot[leaf].isApex = true;
+    index compressedParent = hot[parent].isApex ? parent : hot[parent].parent;
+    hot[leaf].parent = compressedParent;
+    ColdFields& pc = cold[compressedParent];
+    if (pc.lastCompressedChild == NIL) {
+        pc.firstCompressedChild = leaf;
+    } else {
+        cold[pc.lastCompressedChild].nextCompressedSibling = leaf;
+    }
+    pc.lastCompressedChild = leaf;
+
+    // Update subtree sizes
+    hot[leaf].subtreeSize = 1;
+    cold[leaf].dynamicSubtreeSize = 0; // Start at 0 so that we increment to 1 on the first loop
+    for (index curr = leaf; curr != NIL; curr = hot[curr].parent) {
+        cold[curr].dynamicSubtreeSize += 1;
+    }
+
+    // Record last node where
+    // dynamicSubtreeSize >= alpha * subtreeSize (ie. last "broken" node)
+    index currNode = leaf; //By convention, the leaf is "broken"
+    index next = hot[currNode].parent;
+    while (next != NIL && cold[next].dynamicSubtreeSize >= alpha * hot[next].subtreeSize) {
+        currNode = next;
+        next = hot[currNode].parent;
+    }
+
+    // Recompress last "broken" node and update ancestor tables
+    recompress(currNode);
+    fillAllAncestors(currNode);
+}
+
+///////////////////////
+// Answering Queries //
+///////////////////////
+
+index ArenaTree::lca(index nodeX, index nodeY) const {
+    return cas(nodeX, nodeY).lca;
+}
+
+bool ArenaTree::inPath(index node, index apex) const {
+    // "parent" refers to compressed parent
+    return node == apex || (!hot[node].isApex && hot[node].parent == apex);
+}
+
+bool ArenaTree::isAncestorOf(index ancestor, index node) const {
+    return (hot[ancestor].start <= hot[node].start) && (hot[node].start <= hot[ancestor].end);
+}
+
+ArenaTree::caTuple ArenaTree::cas(index nodeX, index nodeY) const {
+    if (nodeX == nodeY) {
+        caTuple result = {nodeX, nodeX, nodeX};
+        return result;
+    }
+
+    caTuple compressedCas = casCompressed(nodeX, nodeY);
+
+    // Find LCA from compressed CAs
+    index b_x = inPath(compressedCas.ca_x, compressedCas.lca) ?
+                compressedCas.ca_x : cold[compressedCas.ca_x].uncompressedParent;
+    index b_y = inPath(compressedCas.ca_y, compressedCas.lca) ?
+                compressedCas.ca_y : cold[compressedCas.ca_y].uncompressedParent;
+    index lca = (hot[b_x].uncompressedLevel < hot[b_y].uncompressedLevel) ? b_x : b_y;
+
+    // Find CA_X and CA_Y from compressed CAs (see ExpensiveTreeNode::cas)
+    index ca_x;
+    if (lca != b_x) {
+        ca_x = hot[lca].heavyChild;
+    } else if (lca != compressedCas.ca_x) {
+        ca_x = compressedCas.ca_x;
+    } else {
+        ca_x = nodeX;
+    }
+
+    index ca_y;
+    if (lca != b_y) {
+        ca_y = hot[lca].heavyChild;
+    } else if (lca != compressedCas.ca_y) {
+        ca_y = compressedCas.ca_y;
+    } else {
+        ca_y = nodeY;
+    }
+
+    caTuple result = {lca, ca_x, ca_y};
+    return result;
+}
+
+// Note: nodeX cannot be equal to nodeY
+//
+// Implementation based on Fig. 2 of Gabow's paper
+// "A Data Structure for Nearest Common Ancestors with Linking"
+ArenaTree::caTuple ArenaTree::casCompressed(index nodeX, index nodeY) const {
+    assert(nodeX != nodeY);
+
+    FatPreorder::Coord diff = FatPreorder::distance(hot[nodeX].start, hot[nodeY].start);
+    int i = FatPreorder::bucket(diff);
+
+    index v = ancestors[(size_t) nodeX * tableWidth + i];
+    index w = (v != NIL) ? hot[v].parent : nodeX;
+
+    index b, b_x;
+    if (hot[w].sizeWeight > diff) {
+        b = w;
+        b_x = (v != NIL) ? v : nodeX;
+    } else {
+        b = hot[w].parent;
+        b_x = w;
+    }
+
+    index a_x = isAncestorOf(b, nodeY) ? b_x : b;
+
+    // Symetric computation to compute a_y
+    v = ancestors[(size_t) nodeY * tableWidth + i];
+    w = (v != NIL) ? hot[v].parent : nodeY;
+
+    index b_y;
+    if (hot[w].sizeWeight > diff) {
+        b = w;
+        b_y = (v != NIL) ? v : nodeY;
+    } else {
+        b = hot[w].parent;
+        b_y = w;
+    }
+
+    index a, a_y;
+    if (isAncestorOf(b, nodeX)) {
+        a = b;
+        a_y = b_y;
+    } else {
+        a = hot[b].parent;
+        a_y = b;
+    }
+
+    caTuple toReturn = {a, a_x, a_y};
+    return toReturn;
+}
+
+index ArenaTree::naiveLca(index nodeX, index nodeY) const {
+    return naiveCas(nodeX, nodeY).lca;
+}
+
+ArenaTree::caTuple ArenaTree::naiveCas(index nodeX, index nodeY) const {
+    if (nodeX == nodeY) {
+        caTuple toReturn = {nodeX, nodeX, nodeX};
+        return toReturn;
+    }
+
+    // Walk the deeper node up until both are at the same level
+    index x = nodeX, y = nodeY;
+    index prevX = nodeX, prevY = nodeY;
+    while (hot[x].uncompressedLevel > hot[y].uncompressedLevel) {
+        prevX = x;
+        x = cold[x].uncompressedParent;
+    }
+    while (hot[y].uncompressedLevel > hot[x].uncompressedLevel) {
+        prevY = y;
+        y = cold[y].uncompressedParent;
+    }
+    while (x != y) {
+        prevX = x;
+        prevY = y;
+        x = cold[x].uncompressedParent;
+        y = cold[y].uncompressedParent;
+    }
+
+    // When one node is an ancestor of the other, its characteristic ancestor is itself
+    caTuple toReturn = {x, (x == nodeX) ? nodeX : prevX, (x == nodeY) ? nodeY : prevY};
+    return toReturn;
+}
@@ -0,0 +1,151 @@
+#ifndef LCAARENA_H
+#define LCAARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "fatPreorder.hpp"
+
+/*
+ * ArenaTree
+ * Same data structure as ExpensiveTreeNode (Gabow's fat preordering on the
+ * heavy-light compressed tree), but every node lives in contiguous arrays
+ * owned by the tree and is addressed by a 32-bit index instead of a pointer.
+ *
+ * The fields read by `cas` are kept together in `hot`, so that a query
+ * touches one small record per visited node. Everything that is only needed
+ * while (re)building the fat preordering lives in `cold`. Ancestor tables
+ * share a single pool: node v's table starts at v * tableWidth.
+ */
+class ArenaTree {
+    public:
+        typedef uint32_t index;
+        static const index NIL = 0xFFFFFFFFu;
+
+        /* Characteristic ancestors, as in ExpensiveTreeNode::caTuple */
+        struct caTuple {
+            index lca;
+            index ca_x;
+            index ca_y;
+        };
+
+        /* Parameters for the fat preordering (identical to ExpensiveTreeNode) */
+        static constexpr float beta = FatPreorder::beta;
+        static const int e = FatPreorder::e;
+        static const int c = FatPreorder::c;
+        static constexpr float alpha = FatPreorder::alpha;
+
+        /* Fields used to answer queries */
+        struct HotFields {
+            FatPreorder::Coord start;
+            FatPreorder::Coord end;
+            FatPreorder::Coord sizeWeight; // (c - 2) * subtreeSize^e
+            index parent;       // compressed parent
+            index heavyChild;
+            long long int subtreeSize; // (old) subtreeSize used by current fat preordering
+            int uncompressedLevel;
+            bool isApex;
+        };
+
+        /* Fields only used when building or updating the fat preordering */
+        struct ColdFields {
+            index uncompressedParent;
+            index firstChild;   // uncompressed children, as an intrusive list
+            index lastChild;
+            index nextSibling;
+            index firstCompressedChild;
+            index lastCompressedChild;
+            index nextCompressedSibling;
+            long long int dynamicSubtreeSize;
+            FatPreorder::Coord startBuffered;
+            FatPreorder::Coord endBuffered;
+            FatPreorder::Coord largestChildEndBuffer;
+        };
+
+        /* Creates an empty arena, optionally reserving space for `capacity` nodes */
+        ArenaTree(size_t capacity = 0);
+
+        /* Number of nodes allocated in the arena */
+        size_t size() const {return hot.size();}
+
+        /* Root of the tree (NIL before the first call to `preprocess`) */
+        index root() const {return treeRoot;}
+
+        /*
+         * Creates a new node that forms a tree by itself. Nodes are numbered
+         * consecutively from 0 in the order they are created. Returns NIL
+         * once the arena holds FatPreorder::maxSize nodes, past which
+         * coordinates could overflow.
+         */
+        index newNode();
+
+        /* Adds `child` below `parent` without preprocessing (see `preprocess`) */
+        void addLeafNoPreprocessing(index parent, index child);
+
+        /* Preprocesses the tree rooted at `rootNode` to be ready for LCA queries */
+        void preprocess(index rootNode);
+
+        /*
+         * Adds `leaf` (a node returned by `newNode`) as a child of `parent`,
+         * maintaining the fat preordering in amortized O(\log^2 n) time.
+         */
+        void add_leaf(index parent, index leaf);
+
+        /* Computes the LCA of two nodes in O(1) time */
+        index lca(index nodeX, index nodeY) const;
+
+        /* Computes the characteristic ancestors of two nodes in O(1) time */
+        caTuple cas(index nodeX, index nodeY) const;
+
+        /* Computes LCA in O(n) time */
+        index naiveLca(index nodeX, index nodeY) const;
+
+        /* Computes characteristic ancestors in O(n) time */
+        caTuple naiveCas(index nodeX, index nodeY) const;
+
+        index uncompressedParent(index node) const {return cold[node].uncompressedParent;}
+        int level(index node) const {return hot[node].uncompressedLevel;}
+
+    private:
+        std::vector<HotFields> hot;
+        std::vector<ColdFields> cold;
+
+        std::vector<index> ancestors; // ancestor tables, `tableWidth` entries per node
+        int tableWidth;
+        index treeRoot;
+
+        // Scratch space for the traversals, reused between rebuilds
+        std::vector<index> order;
+        std::vector<index> stack;
+
+        /* Fills `order` with the uncompressed (or compressed) subtree of `node` in preorder */
+        void collectPreorder(index node, bool useCompressed);
+
+        /* Sets `subtreeSize` in either the compressed or uncompressed subtree */
+        void assignSubtreeSizes(index node, bool useCompressed);
+
+        /* Sets `isApex` and `heavyChild`, treating `node` as the root */
+        void assignApex(index node);
+
+        /* Sets `uncompressedLevel` for each node in the subtree */
+        void assignLevels(index node);
+
+        /* Rebuilds the compressed subtree of `node` from the apex flags */
+        void compressTree(index node);
+
+        /* Assigns fat preordering intervals, assuming the buffered interval of `node` is set */
+        void contAssignIntervals(index node);
+
+        /* Fills the ancestor tables of the compressed subtree of `node` */
+        void fillAllAncestors(index node);
+        void fillAncestorTable(index node);
+
+        /* See ExpensiveTreeNode::recompress */
+        void recompress(index node);
+
+        caTuple casCompressed(index nodeX, index nodeY) const;
+        bool inPath(index node, index apex) const;
+        bool isAncestorOf(index ancestor, index node) const;
+};
+
+#endif
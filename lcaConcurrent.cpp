@@ -0,0 +1,113 @@
+#include "lcaConcurrent.hpp"
+#include <thread>
+
+const NodeId ConcurrentMultilevelTree::NO_NODE;
+
+///////////////////////////////////////////
+//////         Read Indicator       ///////
+///////////////////////////////////////////
+
+ConcurrentMultilevelTree::ReadIndicator::ReadIndicator() {
+    for (int i = 0; i < numStripes; ++i) {
+        stripes[i].count.store(0);
+    }
+}
+
+int ConcurrentMultilevelTree::ReadIndicator::stripeOfThisThread() {
+    static std::atomic<int> nextStripe(0);
+    thread_local int stripe = nextStripe.fetch_add(1) % numStripes;
+    return stripe;
+}
+
+void ConcurrentMultilevelTree::ReadIndicator::arrive() {
+    stripes[stripeOfThisThread()].count.fetch_add(1);
+}
+
+void ConcurrentMultilevelTree::ReadIndicator::depart() {
+    stripes[stripeOfThisThread()].count.fetch_sub(1);
+}
+
+bool ConcurrentMultilevelTree::ReadIndicator::isEmpty() const {
+    for (int i = 0; i < numStripes; ++i) {
+        if (stripes[i].count.load() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////
+//////          Left-Right          ///////
+///////////////////////////////////////////
+
+ConcurrentMultilevelTree::ConcurrentMultilevelTree(NodeId rootId) {
+    for (int i = 0; i < 2; ++i) {
+        copies[i].root = new MultilevelTreeNode(rootId);
+        copies[i].nodes.resize(rootId + 1, NULL);
+        copies[i].nodes[rootId] = copies[i].root;
+    }
+    readCopy.store(0);
+    versionIndex.store(0);
+}
+
+ConcurrentMultilevelTree::~ConcurrentMultilevelTree() {
+    for (int i = 0; i < 2; ++i) {
+        copies[i].root->deleteNode();
+    }
+}
+
+bool ConcurrentMultilevelTree::apply(Copy& copy, NodeId parentId, NodeId leafId) {
+    MultilevelTreeNode* leaf = new MultilevelTreeNode(leafId);
+    if (!copy.nodes[parentId]->add_leaf(leaf)) {
+        delete leaf;
+        return false;
+    }
+    if ((size_t) leafId >= copy.nodes.size()) {
+        copy.nodes.resize(leafId + 1, NULL);
+    }
+    copy.nodes[leafId] = leaf;
+    return true;
+}
+
+void ConcurrentMultilevelTree::waitForReaders(int version) {
+    while (!indicators[version].isEmpty()) {
+        std::this_thread::yield();
+    }
+}
+
+bool ConcurrentMultilevelTree::add_leaf(NodeId parentId, NodeId leafId) {
+    // Readers are only on copy `current`: update the other one and publish it.
+    // The copies are identical, so if one takes the leaf the other does too.
+    int current = readCopy.load();
+    if (!apply(copies[1 - current], parentId, leafId)) {
+        return false;
+    }
+    readCopy.store(1 - current);
+
+    // Drain the readers that may still be on `current`. Toggling the version
+    // lets readers arriving from now on be told apart from older ones.
+    int prevVersion = versionIndex.load();
+    int nextVersion = 1 - prevVersion;
+    waitForReaders(nextVersion);
+    versionIndex.store(nextVersion);
+    waitForReaders(prevVersion);
+
+    // No reader can be on `current` anymore
+    apply(copies[current], parentId, leafId);
+    return true;
+}
+
+NodeId ConcurrentMultilevelTree::lca(NodeId idX, NodeId idY) {
+    int version = versionIndex.load();
+    indicators[version].arrive();
+
+    const Copy& copy = copies[readCopy.load()];
+    NodeId result = NO_NODE;
+    if (idX >= 0 && idY >= 0 && (size_t) idX < copy.nodes.size() && (size_t) idY < copy.nodes.size()
+        && copy.nodes[idX] && copy.nodes[idY]) {
+        result = MultilevelTreeNode::lca(copy.nodes[idX], copy.nodes[idY])->payload();
+    }
+
+    indicators[version].depart();
+    return result;
+}
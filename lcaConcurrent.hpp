@@ -0,0 +1,79 @@
+#ifndef LCACONCURRENT_H
+#define LCACONCURRENT_H
+
+#include <atomic>
+#include <vector>
+#include "lcaMultilevel.hpp"
+
+/*
+ * ConcurrentMultilevelTree
+ * A MultilevelTreeNode tree that one writer thread can grow with `add_leaf`
+ * while any number of reader threads call `lca` without blocking.
+ *
+ * Uses the Left-Right technique (Ramalhete and Correia): two copies of the
+ * tree are kept. Readers always query the copy the writer is not touching,
+ * announcing themselves on a read indicator with a single atomic increment.
+ * The writer applies each insertion to the idle copy, publishes it by
+ * flipping an atomic index, waits for readers still on the old copy to
+ * leave, and then replays the insertion there. Readers therefore never see
+ * a partially rebuilt summary tree, and no memory is ever freed while a
+ * reader might be using it, so no reclamation scheme is needed.
+ *
+ * Nodes are addressed by their NodeId, which indexes a table in each copy,
+ * so ids should be dense.
+ */
+class ConcurrentMultilevelTree {
+    public:
+        /* Returned by `lca` when a node is not in the tree (yet) */
+        static const NodeId NO_NODE = -1;
+
+        ConcurrentMultilevelTree(NodeId rootId);
+        ~ConcurrentMultilevelTree();
+
+        /*
+         * Adds a new node `leafId` below `parentId`. Must only be called by
+         * one thread at a time. Returns false, leaving the tree unchanged,
+         * if the tree is full (see MultilevelTreeNode::add_leaf).
+         */
+        bool add_leaf(NodeId parentId, NodeId leafId);
+
+        /* Computes the LCA of two nodes. Safe to call from any thread, concurrently with `add_leaf`. */
+        NodeId lca(NodeId idX, NodeId idY);
+
+    private:
+        /* Counts the readers on one version, spread over cache lines to limit contention */
+        class ReadIndicator {
+            public:
+                ReadIndicator();
+                void arrive();
+                void depart();
+                bool isEmpty() const;
+
+            private:
+                static const int numStripes = 32;
+                struct alignas(64) Stripe {
+                    std::atomic<long> count;
+                };
+                Stripe stripes[numStripes];
+                static int stripeOfThisThread();
+        };
+
+        /* One full copy of the tree, with a table from id to node */
+        struct Copy {
+            std::vector<MultilevelTreeNode*> nodes;
+            MultilevelTreeNode* root;
+        };
+
+        Copy copies[2];
+        std::atomic<int> readCopy; // copy that new readers query
+        std::atomic<int> versionIndex; // read indicator that new readers arrive on
+        ReadIndicator indicators[2];
+
+        /* Applies an insertion to one copy */
+        static bool apply(Copy& copy, NodeId parentId, NodeId leafId);
+
+        /* Busy-waits until every reader that arrived on `version` has departed */
+        void waitForReaders(int version);
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include "lcaEulerTour.hpp"
+#include <algorithm>
+
+const NodeId EulerTourLca::NO_NODE;
+const int EulerTourLca::blockSize;
+
+uint8_t EulerTourLca::minOffset[EulerTourLca::numTypes][EulerTourLca::blockSize][EulerTourLca::blockSize];
+int8_t EulerTourLca::relativeDepth[EulerTourLca::numTypes][EulerTourLca::blockSize];
+bool EulerTourLca::initialized = EulerTourLca::initTables();
+
+bool EulerTourLca::initTables() {
+    for (int type = 0; type < numTypes; ++type) {
+        relativeDepth[type][0] = 0;
+        for (int k = 1; k < blockSize; ++k) {
+            relativeDepth[type][k] = relativeDepth[type][k - 1] + (((type >> (k - 1)) & 1) ? 1 : -1);
+        }
+        for (int i = 0; i < blockSize; ++i) {
+            int best = i;
+            for (int j = i; j < blockSize; ++j) {
+                if (relativeDepth[type][j] < relativeDepth[type][best]) {
+                    best = j;
+                }
+                minOffset[type][i][j] = best;
+            }
+        }
+    }
+    return true;
+}
+
+EulerTourLca::EulerTourLca() : numLevels(0) {}
+
+void EulerTourLca::clear() {
+    firstVisit.clear();
+    tour.clear();
+    blocks.clear();
+    sparseTable.clear();
+    numLevels = 0;
+}
+
+/////////////////////
+//    Building     //
+/////////////////////
+
+bool EulerTourLca::build(const std::vector<int>& parents) {
+    clear();
+    size_t n = parents.size();
+    if (n == 0 || n > 0x7FFFFFFFu) {
+        return false;
+    }
+
+    // Children in CSR form, and the single root
+    std::vector<uint32_t> childStart(n + 1, 0);
+    int root = -1;
+    for (size_t i = 0; i < n; ++i) {
+        if (parents[i] == -1 && root < 0) {
+            root = i;
+        } else if (parents[i] < 0 || (size_t) parents[i] >= n) {
+            return false;
+        } else {
+            childStart[parents[i] + 1]++;
+        }
+    }
+    if (root < 0) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        childStart[i + 1] += childStart[i];
+    }
+    std::vector<uint32_t> childIds(n - 1);
+    std::vector<uint32_t> nextChild(childStart.begin(), childStart.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        if ((int) i != root) {
+            childIds[nextChild[parents[i]]++] = i;
+        }
+    }
+
+    // The Euler tour, with an explicit stack: each node is visited when the
+    // tour enters it and again after each of its children. Tree edges are
+    // walked twice, so a tree has 2n - 1 visits, and a cycle (which the
+    // root cannot reach) leaves some node unvisited.
+    size_t tourLength = 2 * n - 1;
+    size_t numBlocks = (tourLength + blockSize - 1) / blockSize;
+    firstVisit.assign(n, 0xFFFFFFFFu);
+    tour.reserve(numBlocks * blockSize);
+    blocks.assign(numBlocks, Block());
+    std::copy(childStart.begin(), childStart.end() - 1, nextChild.begin());
+
+    std::vector<uint32_t> stack(1, root);
+    uint32_t depth = 0;
+    firstVisit[root] = 0;
+    tour.push_back(root);
+    blocks[0].depth = 0;
+    while (!stack.empty()) {
+        uint32_t node = stack.back();
+        bool down = nextChild[node] < childStart[node + 1];
+        if (down) {
+            node = childIds[nextChild[node]++];
+            stack.push_back(node);
+            depth++;
+            firstVisit[node] = tour.size();
+        } else {
+            stack.pop_back();
+            if (stack.empty()) {
+                break;
+            }
+            node = stack.back();
+            depth--;
+        }
+
+        size_t position = tour.size();
+        tour.push_back(node);
+        Block& block = blocks[position / blockSize];
+        if (position % blockSize == 0) {
+            block.depth = depth;
+        } else if (down) {
+            block.type |= 1u << (position % blockSize - 1);
+        }
+    }
+    if (tour.size() != tourLength) {
+        clear();
+        return false;
+    }
+
+    // Pad the last block with steps down, which never hold its minimum
+    for (size_t position = tourLength; position % blockSize != 0; ++position) {
+        tour.push_back(root);
+        blocks.back().type |= 1u << (position % blockSize - 1);
+    }
+
+    numLevels = 32 - __builtin_clz(numBlocks);
+    sparseTable.resize((size_t) numLevels * numBlocks);
+    for (size_t b = 0; b < numBlocks; ++b) {
+        sparseTable[b] = minInBlock(b, 0, blockSize - 1);
+    }
+    for (int level = 1; level < numLevels; ++level) {
+        const Visit* below = sparseTable.data() + (size_t) (level - 1) * numBlocks;
+        Visit* row = sparseTable.data() + (size_t) level * numBlocks;
+        size_t half = (size_t) 1 << (level - 1);
+        for (size_t b = 0; b + 2 * half <= numBlocks; ++b) {
+            row[b] = std::min(below[b], below[b + half]);
+        }
+    }
+    return true;
+}
+
+template <typename Node, typename Children, typename Id>
+bool EulerTourLca::collectParents(Node* root, const Children& children, const Id& id, std::vector<int>& parents) {
+    std::vector<std::pair<Node*, NodeId>> preorder; // each node with the id of its parent
+    std::vector<std::pair<Node*, NodeId>> stack(1, std::make_pair(root, (NodeId) -1));
+    std::vector<Node*> childNodes;
+    while (!stack.empty()) {
+        std::pair<Node*, NodeId> top = stack.back();
+        stack.pop_back();
+        preorder.push_back(top);
+        childNodes.clear();
+        children(top.first, childNodes);
+        for (Node* child : childNodes) {
+            stack.push_back(std::make_pair(child, id(top.first)));
+        }
+    }
+
+    parents.assign(preorder.size(), -2);
+    for (const std::pair<Node*, NodeId>& entry : preorder) {
+        NodeId nodeId = id(entry.first);
+        if (nodeId < 0 || nodeId >= (NodeId) parents.size() || parents[nodeId] != -2) {
+            return false;
+        }
+        parents[nodeId] = entry.second;
+    }
+    return true;
+}
+
+bool EulerTourLca::build(ExpensiveTreeNode* root) {
+    std::vector<int> parents;
+    bool valid = collectParents(root,
+                                [](ExpensiveTreeNode* node, std::vector<ExpensiveTreeNode*>& childNodes) {
+                                    childNodes.insert(childNodes.end(), node->uncompressedChildren.begin(), node->uncompressedChildren.end());
+                                },
+                                [](ExpensiveTreeNode* node) {return node->payload();}, parents);
+    if (!valid) {
+        clear();
+        return false;
+    }
+    return build(parents);
+}
+
+bool EulerTourLca::build(MultilevelTreeNode* root) {
+    std::vector<int> parents;
+    bool valid = collectParents(root,
+                                [](MultilevelTreeNode* node, std::vector<MultilevelTreeNode*>& childNodes) {
+                                    for (MultilevelTreeNode* child = node->firstChild; child; child = child->nextSibling) {
+                                        childNodes.push_back(child);
+                                    }
+                                },
+                                [](MultilevelTreeNode* node) {return node->payload();}, parents);
+    if (!valid) {
+        clear();
+        return false;
+    }
+    return build(parents);
+}
+
+/////////////////////
+//     Queries     //
+/////////////////////
+
+EulerTourLca::Visit EulerTourLca::minBetween(uint32_t i, uint32_t j) const {
+    uint32_t first = i / blockSize;
+    uint32_t last = j / blockSize;
+    if (first == last) {
+        return minInBlock(first, i % blockSize, j % blockSize);
+    }
+    Visit best = std::min(minInBlock(first, i % blockSize, blockSize - 1), minInBlock(last, 0, j % blockSize));
+    if (last > first + 1) {
+        best = std::min(best, minOfBlocks(first + 1, last - 1));
+    }
+    return best;
+}
+
+NodeId EulerTourLca::lca(NodeId idX, NodeId idY) const {
+    NodeId n = firstVisit.size();
+    if (idX < 0 || idY < 0 || idX >= n || idY >= n) {
+        return NO_NODE;
+    }
+    uint32_t i = firstVisit[idX];
+    uint32_t j = firstVisit[idY];
+    return visitNode(i < j ? minBetween(i, j) : minBetween(j, i));
+}
+
+void EulerTourLca::lcaBatch(const std::pair<NodeId, NodeId>* queries, NodeId* results, size_t n) const {
+    const int groupSize = ExpensiveTreeNode::batchGroupSize;
+    NodeId numIds = firstVisit.size();
+    for (size_t start = 0; start < n; start += groupSize) {
+        int count = std::min<size_t>(groupSize, n - start);
+        const std::pair<NodeId, NodeId>* group = queries + start;
+        bool valid[groupSize];
+        uint32_t from[groupSize];
+        uint32_t to[groupSize];
+
+        // Stage 1: the first visits of both nodes
+        for (int k = 0; k < count; ++k) {
+            valid[k] = group[k].first >= 0 && group[k].second >= 0 && group[k].first < numIds && group[k].second < numIds;
+            if (valid[k]) {
+                __builtin_prefetch(&firstVisit[group[k].first]);
+                __builtin_prefetch(&firstVisit[group[k].second]);
+            }
+        }
+
+        // Stage 2: the two end blocks, their tour positions and the sparse
+        // table entries between them
+        for (int k = 0; k < count; ++k) {
+            if (!valid[k]) {
+                continue;
+            }
+            uint32_t i = firstVisit[group[k].first];
+            uint32_t j = firstVisit[group[k].second];
+            from[k] = std::min(i, j);
+            to[k] = std::max(i, j);
+            uint32_t first = from[k] / blockSize;
+            uint32_t last = to[k] / blockSize;
+            __builtin_prefetch(&blocks[first]);
+            __builtin_prefetch(&blocks[last]);
+            __builtin_prefetch(&tour[from[k]]);
+            __builtin_prefetch(&tour[to[k]]);
+            if (last > first + 1) {
+                int level = 31 - __builtin_clz(last - first - 1);
+                const Visit* row = sparseTable.data() + (size_t) level * blocks.size();
+                __builtin_prefetch(&row[first + 1]);
+                __builtin_prefetch(&row[last - ((uint32_t) 1 << level)]);
+            }
+        }
+
+        // Stage 3: the answers
+        for (int k = 0; k < count; ++k) {
+            results[start + k] = valid[k] ? visitNode(minBetween(from[k], to[k])) : NO_NODE;
+        }
+    }
+}
+
+MemoryUsage EulerTourLca::memoryUsage() const {
+    MemoryUsage usage = MemoryUsage();
+    usage.numNodes = firstVisit.size();
+    usage.nodes = firstVisit.capacity() * sizeof(uint32_t) + tour.capacity() * sizeof(uint32_t);
+    usage.ancestorTables = blocks.capacity() * sizeof(Block) + sparseTable.capacity() * sizeof(Visit);
+    usage.allocations = 4;
+    return usage;
+}
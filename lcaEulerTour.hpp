@@ -0,0 +1,139 @@
+#ifndef LCAEULERTOUR_H
+#define LCAEULERTOUR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "lcaTree.hpp"
+#include "lcaMultilevel.hpp"
+
+/*
+ * EulerTourLca
+ * A static LCA structure for query-only phases: the tree cannot change once
+ * built, but a query is a couple of array lookups with no branches on the
+ * shape of the tree.
+ *
+ * The LCA of x and y is the shallowest node visited by the Euler tour of
+ * the tree between the first visits of x and y. Depths along the tour move
+ * by +1 or -1 at each step, so the tour is cut into blocks of `blockSize`
+ * positions (Bender and Farach-Colton):
+ *   - within a block, the minimum between two positions only depends on
+ *     the block's sequence of steps, its "type": one shared table answers
+ *     every in-block query of every type
+ *   - across blocks, a sparse table over the block minima answers any
+ *     range of whole blocks with two lookups
+ * Every query combines at most two in-block lookups and one sparse-table
+ * lookup, in O(1) time; building takes O(n log n) time and space (the
+ * sparse table has n / 4 entries per level).
+ *
+ * Nodes are addressed by their ids, which must be exactly 0, ..., n - 1,
+ * as in LcaSnapshot.
+ */
+class EulerTourLca {
+    public:
+        static const NodeId NO_NODE = -1;
+        static const int blockSize = 8;
+
+        EulerTourLca();
+
+        /*
+         * Builds the structure for a tree, replacing any previous one, in
+         * O(n log n) time. Returns false, leaving it empty, if the input is
+         * not a single tree on the ids 0, ..., n - 1.
+         *
+         * build(parents): parents[i] is the parent of node i (-1 for the root)
+         * build(ExpensiveTreeNode*): the uncompressed tree below `root`
+         * build(MultilevelTreeNode*): a live tree, from its root, without
+         *   changing it (it can go on taking add_leaf calls afterwards,
+         *   which this structure does not see)
+         */
+        bool build(const std::vector<int>& parents);
+        bool build(ExpensiveTreeNode* root);
+        bool build(MultilevelTreeNode* root);
+
+        size_t numNodes() const {return firstVisit.size();}
+
+        /* Computes the LCA of two nodes in O(1) time (NO_NODE if an id is out of range) */
+        NodeId lca(NodeId idX, NodeId idY) const;
+
+        /*
+         * Answers `n` queries at once, writing the i-th answer to results[i].
+         * As in ExpensiveTreeNode::lcaBatch, each group of batchGroupSize
+         * queries prefetches the first visits, then the blocks and sparse
+         * table entries, of all its queries before reading any of them.
+         */
+        void lcaBatch(const std::pair<NodeId, NodeId>* queries, NodeId* results, size_t n) const;
+
+        /*
+         * Bytes used by the arrays: `nodes` counts the first visits and the
+         * Euler tour, `ancestorTables` the blocks and the sparse table
+         */
+        MemoryUsage memoryUsage() const;
+
+    private:
+        /* A node and its depth, packed so that the shallower one compares lower */
+        typedef uint64_t Visit;
+        static Visit visit(uint32_t depth, uint32_t node) {return (uint64_t) depth << 32 | node;}
+        static NodeId visitNode(Visit v) {return (uint32_t) v;}
+
+        struct Block {
+            uint32_t depth; // depth at the first position of the block
+            uint32_t type;  // bit k set iff the tour goes down at step k + 1 of the block
+        };
+
+        std::vector<uint32_t> firstVisit; // by node id: its first position in the tour
+        std::vector<uint32_t> tour;       // node ids in the order of the Euler tour
+        std::vector<Block> blocks;
+
+        /*
+         * Level k holds, for each block b, the shallowest visit of blocks
+         * b to b + 2^k - 1; levels are stored one after the other, each
+         * `blocks.size()` entries long (the entries past the last block are
+         * not set)
+         */
+        std::vector<Visit> sparseTable;
+        int numLevels;
+
+        /*
+         * Shared by all instances, built once: for each block type, the
+         * offset of the minimum between offsets i <= j, at [type][i][j],
+         * and the depth at each offset relative to the first
+         */
+        static const int numTypes = 1 << (blockSize - 1);
+        static uint8_t minOffset[numTypes][blockSize][blockSize];
+        static int8_t relativeDepth[numTypes][blockSize];
+        static bool initialized;
+        static bool initTables();
+
+        void clear();
+
+        /* The shallowest visit between positions i <= j of the same block */
+        Visit minInBlock(uint32_t block, int i, int j) const {
+            const Block& b = blocks[block];
+            int offset = minOffset[b.type][i][j];
+            return visit(b.depth + relativeDepth[b.type][offset], tour[block * blockSize + offset]);
+        }
+
+        /* The shallowest visit of blocks first to last (inclusive) */
+        Visit minOfBlocks(uint32_t first, uint32_t last) const {
+            int level = 31 - __builtin_clz(last - first + 1);
+            const Visit* row = sparseTable.data() + (size_t) level * blocks.size();
+            Visit a = row[first];
+            Visit b = row[last + 1 - ((uint32_t) 1 << level)];
+            return a < b ? a : b;
+        }
+
+        /* The shallowest visit between tour positions i <= j */
+        Visit minBetween(uint32_t i, uint32_t j) const;
+
+        /*
+         * Fills the parent array of the tree below `root`, where
+         * children(node, childNodes) appends the children of a node, or
+         * returns false if the ids are not 0, ..., n - 1
+         */
+        template <typename Node, typename Children, typename Id>
+        static bool collectParents(Node* root, const Children& children, const Id& id, std::vector<int>& parents);
+};
+
+#endif
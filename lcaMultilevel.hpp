@@ -1,58 +1,349 @@
 #ifndef LCAMULTILEVEL_H
 #define LCAMULTILEVEL_H
 
-#include <list>
+#include <utility>
 #include <vector>
-#include <string>
 #include "lcaTree.hpp"
+#include "microWord.hpp"
 
 /*
- * MultilevelTreeNode
+ * BasicMultilevelTreeNode
  * Represents the full tree partitioned into "2-subtrees" (for indirection)
  *   Each 2-subtree has log n nodes (which we can exaggerate to the number of
  *   bits in a RAM word)
+ *
+ * `Word` is the word of the 2-subtrees (see microWord.hpp): uint32_t,
+ * uint64_t, unsigned __int128, Word256 or Word512. Wider words give fewer, larger
+ * 2-subtrees, and so a smaller summary tree, for larger ancestor words.
+ * MultilevelTreeNode is the 64-bit version. `Payload` is stored in each
+ * node as in BasicExpensiveTreeNode (a NodeId by default); the summary tree
+ * has no payload, and reaches the 2-subtree of each summary node instead.
+ *
+ * Size limit: the summary tree has a node per full 2-subtree, and holds at
+ * most FatPreorder::maxSize of them. Deletions may leave full 2-subtrees
+ * almost empty, so before an insertion or link would take the summary tree
+ * past that, the tree is repartitioned if that makes room: afterwards the
+ * summary tree has at most n / twoSubtreeMaxSize nodes. add_leaf,
+ * add_leaves and link therefore succeed on any tree of up to
+ * FatPreorder::maxSize * twoSubtreeMaxSize nodes: 1.5e11 (2^37) with
+ * 64-bit words, 6.1e11 (2^39) with Word256 and 1.2e12 (over 2^40) with
+ * Word512. Past that they return false and leave both trees unchanged.
+ * Depths are 64-bit, so paths of any such length are supported. The
+ * largest tree tested is 3M nodes (testLargeTrees, with a 46.5k-node
+ * summary tree); beyond that only the interval arithmetic is tested, up to
+ * maxSize.
  */
-class MultilevelTreeNode {
+template <typename Word, typename Payload = NodeId>
+class BasicMultilevelTreeNode : public PayloadHolder<Payload> {
     public:
-        static const int twoSubtreeMaxSize = 64;
-        
+        static const int twoSubtreeMaxSize = MicroWord<Word>::bits;
+
+        /* A node of the summary tree, which has one per full 2-subtree */
+        typedef BasicExpensiveTreeNode<NoPayload> SummaryNode;
+
+        /*
+         * Characteristic ancestors, as in ExpensiveTreeNode::caTuple:
+         * "lca" = the LCA of X and Y
+         * "ca_x" = the child of the LCA that is an ancestor of X (the LCA itself if X is the LCA)
+         * "ca_y" = the child of the LCA that is an ancestor of Y (the LCA itself if Y is the LCA)
+         */
+        struct caTuple {
+            BasicMultilevelTreeNode* lca;
+            BasicMultilevelTreeNode* ca_x;
+            BasicMultilevelTreeNode* ca_y;
+        };
+
         /* Standard Tree Variables */
-        std::string data;
-        MultilevelTreeNode* parent;
-        std::list<MultilevelTreeNode*> children;
+        BasicMultilevelTreeNode* parent;
+
+        /*
+         * Children, as an intrusive list: the first child, then each
+         * child's next sibling, up to NULL after the last one
+         */
+        BasicMultilevelTreeNode* firstChild;
+        BasicMultilevelTreeNode* nextSibling;
+        BasicMultilevelTreeNode* lastChild() const {return firstChild ? firstChild->prevSibling : NULL;}
 
         /* Standard Tree Operations */
-        MultilevelTreeNode(std::string id);
+        BasicMultilevelTreeNode(const Payload& payload);
         void print(int level = 0, bool details = false);
+
+        /*
+         * Deletes this node and its whole subtree, unlinking it from its
+         * parent. The 2-subtree that contained this node is renumbered
+         * (O(log n) work, a constant number of words), the summary nodes of
+         * the 2-subtrees below it are removed from the summary tree, and
+         * after about n/2 deleted nodes the whole tree is repartitioned.
+         * Called on the root, it deletes the whole tree.
+         */
         void deleteNode();
 
-        /* Dynamic LCA */
-        void add_leaf(MultilevelTreeNode* leaf);
-        static MultilevelTreeNode* lca(MultilevelTreeNode* nodeX, MultilevelTreeNode* nodeY);
-        static MultilevelTreeNode* naiveLca(MultilevelTreeNode* nodeX, MultilevelTreeNode* nodeY);
+        /* deleteNode for a node without children */
+        void delete_leaf();
+
+        /*
+         * Reports the memory used by the tree, in O(n) time. Must be called
+         * on the root, since the summary tree is shared by the whole tree.
+         */
+        MemoryUsage memoryUsage();
+
+        /*
+         * Bulk construction in O(n) time. Produces the same 2-subtrees as
+         * inserting the nodes in preorder with `add_leaf`, but builds the
+         * summary tree without preprocessing and runs `preprocess` on it
+         * once. Node i gets id i (with a NodeId payload), `nodes` is filled
+         * with the nodes indexed by id, and the root is returned. The tree accepts `add_leaf`
+         * afterwards like any other.
+         *
+         * buildFromParents: parents[i] is the parent of node i (-1 for the root)
+         * buildFromCsr: the children of node i are childIds[childStart[i]]
+         *   up to (but excluding) childIds[childStart[i + 1]]
+         */
+        static BasicMultilevelTreeNode* buildFromParents(const std::vector<int>& parents,
+                                                         std::vector<BasicMultilevelTreeNode*>& nodes);
+        static BasicMultilevelTreeNode* buildFromCsr(const std::vector<int>& childStart,
+                                                     const std::vector<int>& childIds, int rootId,
+                                                     std::vector<BasicMultilevelTreeNode*>& nodes);
+
+        /*
+         * Adds a leaf below this node. Returns false, without adding it, if
+         * the tree is full (see the size limit above).
+         */
+        bool add_leaf(BasicMultilevelTreeNode* leaf);
+
+        /*
+         * Adds n leaves at once: batch[k].second becomes a child of
+         * batch[k].first, which is either in the tree or a leaf earlier in
+         * the batch. The leaves join their 2-subtrees as with add_leaf, and
+         * the summary nodes of the 2-subtrees they fill are added to the
+         * summary tree together with ExpensiveTreeNode::add_leaves. Returns
+         * false, without adding any leaf, if a tree could become full
+         * (counting the whole batch against each tree it touches).
+         */
+        static bool add_leaves(const std::pair<BasicMultilevelTreeNode*, BasicMultilevelTreeNode*>* batch, size_t n);
+
+        /*
+         * Makes `otherRoot`, the root of another tree, a child of this node.
+         * A tree with a summary tree keeps its 2-subtrees: the one of this
+         * node gets a summary node if it has none yet, and the summary trees
+         * are linked with ExpensiveTreeNode::link, in O(s / log n) time plus
+         * amortized recompressions for a tree of s nodes. A smaller tree is
+         * a single 2-subtree, whose nodes are inserted with add_leaf. As
+         * with ExpensiveTreeNode::link, only the smaller summary tree is
+         * relabelled, while the depths of the 2-subtrees of the attached
+         * tree are shifted in one O(1) step each. Returns false, leaving
+         * both trees unchanged, if the joined tree would be too large.
+         */
+        bool link(BasicMultilevelTreeNode* otherRoot);
+
+        /*
+         * Computes the LCA in O(1) time, or NULL if the nodes are in
+         * different trees (as are all the results of `cas` then)
+         */
+        static BasicMultilevelTreeNode* lca(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /*
+         * Computes the characteristic ancestors of two nodes in O(1) time:
+         * the summary-tree cas tells through which 2-subtree root each path
+         * leaves the LCA's 2-subtree, and the ancestor words give the child on
+         * the path within it
+         */
+        static caTuple cas(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /*
+         * Answers `n` LCA queries at once, writing the i-th answer to results[i].
+         * Each group of ExpensiveTreeNode::batchGroupSize queries advances stage
+         * by stage (2-subtree roots, summary nodes, summary-tree cas, in-subtree
+         * lookup), prefetching what the next stage reads for every query first.
+         */
+        static void lcaBatch(const std::pair<BasicMultilevelTreeNode*, BasicMultilevelTreeNode*>* queries,
+                             BasicMultilevelTreeNode** results, size_t n);
+        static BasicMultilevelTreeNode* naiveLca(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /* Computes characteristic ancestors in O(n) time */
+        static caTuple naiveCas(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /*
+         * Number of edges from the root of the tree, in O(1) time: the depth
+         * of the root of its 2-subtree plus the bits of its ancestor word
+         */
+        long long depth();
+
+        /*
+         * Number of edges on the path between two nodes, in O(1) time
+         * (-1 for nodes of different trees)
+         */
+        static long long distance(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /*
+         * The ancestor k levels above a node (the node itself for k = 0), or
+         * NULL if k is negative or larger than its depth. Within a 2-subtree
+         * it is a select on the ancestor word; otherwise the summary tree
+         * finds the 2-subtree holding it, in O(log n) time.
+         */
+        static BasicMultilevelTreeNode* levelAncestor(BasicMultilevelTreeNode* node, long long k);
 
     private:        
-        /* Variables for 2-subtrees */
-        MultilevelTreeNode* twoSubtreeRoot; // Root of this node's 2-subtree
-        int twoSubtreeSize; // Only set for the root of a 2-subtree
-        ExpensiveTreeNode* summaryNode; // Only set for the root of a 2-subtree
-        
-        /*-------------------------*/
-        /*  LCA within a 2-subtree */
-        /*-------------------------*/
-
-        /* Each node in a 2-subtree is assigned an integer. 
-         * This vector gives the correspondence between integers and nodes.
-         * It is only set for the root of a 2-subtree. */
-        std::vector<MultilevelTreeNode*> intToSubtreeNode;
-
-        /* The ith bit is 1 iff the node with ID i is an ancestor */
-        unsigned long long ancestorWord;
+        friend class LcaSnapshot;
+
+        /*
+         * A 2-subtree is stored as one block, aligned to a cache line: this
+         * header, then its nodes, indexed by the integers 0 to size - 1 that
+         * they are assigned in the 2-subtree (integers grow with depth, so 0
+         * is its root). A block doubles its capacity as nodes join it, up to
+         * twoSubtreeMaxSize.
+         */
+        struct TwoSubtree {
+            /*
+             * A 2-subtree gets a summary node when it fills up, and keeps it
+             * while deletions shrink it (new leaves may then join it again):
+             * the 2-subtrees hanging below it rely on it. So "full" below
+             * means "has a summary node".
+             */
+            SummaryNode* summaryNode;
+
+            /*
+             * Parent of the root of the 2-subtree, where queries leave it to
+             * (NULL at the root of the tree)
+             */
+            BasicMultilevelTreeNode* up;
+
+            int size;
+            int capacity;
+
+            /*
+             * Depth of the root of the 2-subtree in the whole tree. Linking
+             * trees updates it in full 2-subtrees only, so it is read through
+             * rootDepth.
+             */
+            long long rootDepth;
+
+            /*
+             * Only set in the 2-subtree of the root of the tree: its number
+             * of nodes, kept up to date by every insertion and deletion, and
+             * the nodes left to delete before the tree is repartitioned (0 if
+             * no node was deleted yet)
+             */
+            long long numNodes;
+            long long deletionBudget;
+
+            BasicMultilevelTreeNode** nodes() {return reinterpret_cast<BasicMultilevelTreeNode**>(this + 1);}
+
+            static size_t bytes(int capacity) {return sizeof(TwoSubtree) + capacity * sizeof(BasicMultilevelTreeNode*);}
+        };
+
+        /*
+         * Previous sibling, except for the first child, where it is the last
+         * child instead: children are appended and unlinked in O(1) time
+         */
+        BasicMultilevelTreeNode* prevSibling;
+
+        /* Appends `child` after the last child, and unlinks this node from its parent */
+        void appendChild(BasicMultilevelTreeNode* child);
+        void unlinkFromParent();
+
+        /* This node's 2-subtree, or NULL while the node is alone in its tree */
+        TwoSubtree* block;
+
+        /*
+         * The ith bit is 1 iff the node with integer i is an ancestor, so the
+         * highest one is this node's own integer. Kept in the node rather
+         * than the block, as every query reads the node anyway.
+         */
+        Word ancestorWord;
+
+        /* Allocates an empty block, and frees one */
+        static TwoSubtree* newBlock(int capacity);
+        static void freeBlock(TwoSubtree* block);
+
+        /*
+         * Adds `node` to `subtree` with the next integer, below `up`, moving
+         * the block to one of twice the capacity if it is full. Returns the
+         * block.
+         */
+        static TwoSubtree* appendToBlock(TwoSubtree* subtree, BasicMultilevelTreeNode* node, BasicMultilevelTreeNode* up);
+
+        /*
+         * add_leaf without the summary tree: returns the summary node of the
+         * 2-subtree if the leaf filled it, as the second of the pair, and
+         * the summary node to add it below as the first (NULL at the root
+         * of the tree). Both are NULL if no summary node was made.
+         */
+        std::pair<SummaryNode*, SummaryNode*> attachLeaf(BasicMultilevelTreeNode* leaf);
+
+        /*
+         * Gives this node a 2-subtree of its own, as the child of a node in
+         * a full 2-subtree (or alone in its tree)
+         */
+        void startTwoSubtree();
+
+        /*
+         * Depth of the root of a 2-subtree. One without summary node hangs
+         * from a full one (or is the root of the tree), whose depth is kept.
+         */
+        static long long rootDepth(TwoSubtree* subtree);
+
+        /* The fields of the 2-subtree, which also hold for a node alone in its tree */
+        BasicMultilevelTreeNode* twoSubtreeRoot() {return block ? block->nodes()[0] : this;}
+        int twoSubtreeSize() const {return block ? block->size : 1;}
+        SummaryNode* summaryNode() const {return block ? block->summaryNode : NULL;}
+        BasicMultilevelTreeNode* intToSubtreeNode(int k) {return block ? block->nodes()[k] : this;}
+
+        /*
+         * Finds the root of the whole tree in O(1) time, through the root of
+         * the summary tree
+         */
+        BasicMultilevelTreeNode* treeRoot();
+
+        /*
+         * Partitions the nodes, given in preorder with their children linked,
+         * into 2-subtrees as add_leaf would, and builds the summary tree
+         */
+        static void carveTwoSubtrees(const std::vector<BasicMultilevelTreeNode*>& preorder);
+
+        /*
+         * Removes the nodes whose integers are set in `removed` (closed under
+         * descendants, without the root) from `subtree`, and renumbers the
+         * remaining ones in the same order, in O(log n) time
+         */
+        static void removeFromTwoSubtree(TwoSubtree* subtree, const Word& removed);
+
+        /* Called on the root: repartitions the whole tree, in O(n) time */
+        void rebalance();
+
+        /*
+         * Called on the root: whether the summary tree can take `added` more
+         * nodes, after repartitioning the tree if that makes room
+         */
+        bool summaryHasRoom(long long added);
 
         /* Given two nodes in the same 2-subtree, return their LCA */
-        static MultilevelTreeNode* lcaWithinSubtree(MultilevelTreeNode* nodeX, MultilevelTreeNode* nodeY);
+        static BasicMultilevelTreeNode* lcaWithinSubtree(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY);
+
+        /*
+         * Moves x and y up into the 2-subtree of their LCA, keeping their LCA.
+         * Sets xEntry (yEntry) to the root of the 2-subtree through which the
+         * path continues from the new x (y) down to the original one, or NULL
+         * if the path stays in the 2-subtree. Returns false if x and y are in
+         * different trees.
+         */
+        static bool liftToCommonSubtree(BasicMultilevelTreeNode*& x, BasicMultilevelTreeNode*& y,
+                                        BasicMultilevelTreeNode*& xEntry, BasicMultilevelTreeNode*& yEntry);
+
+        /*
+         * Given `node` lifted into the 2-subtree of its ancestor `ancestor`
+         * (with `entry` as set by liftToCommonSubtree), returns the child of
+         * `ancestor` on the path to the original node, or `ancestor` if the
+         * original node is `ancestor` itself
+         */
+        static BasicMultilevelTreeNode* childOnPath(BasicMultilevelTreeNode* ancestor, BasicMultilevelTreeNode* node,
+                                                    BasicMultilevelTreeNode* entry);
 
 
 };
 
+typedef BasicMultilevelTreeNode<uint64_t> MultilevelTreeNode;
+
+#include "lcaMultilevel.tpp"
+
 #endif
\ No newline at end of file
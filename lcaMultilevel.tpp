@@ -0,0 +1,978 @@
+/*
+ * Definitions of BasicMultilevelTreeNode, included by lcaMultilevel.hpp so
+ * that the tree can be instantiated for any payload type
+ */
+#include "lcaStats.hpp"
+#include <assert.h>
+#include <iostream>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <iterator>
+#include <new>
+#include <stdlib.h>
+
+
+// The payload of node i of a tree built in bulk: the id i, or an empty one
+template <typename Payload>
+Payload payloadFromId(NodeId) {
+    return Payload();
+}
+
+template <>
+inline NodeId payloadFromId<NodeId>(NodeId id) {
+    return id;
+}
+
+template <typename Word, typename Payload>
+const int BasicMultilevelTreeNode<Word, Payload>::twoSubtreeMaxSize;
+
+template <typename Word, typename Payload>
+typename BasicMultilevelTreeNode<Word, Payload>::TwoSubtree* BasicMultilevelTreeNode<Word, Payload>::newBlock(int capacity) {
+    void* memory;
+    if (posix_memalign(&memory, 64, TwoSubtree::bytes(capacity)) != 0) {
+        throw std::bad_alloc();
+    }
+    TwoSubtree* subtree = static_cast<TwoSubtree*>(memory);
+    subtree->summaryNode = NULL;
+    subtree->size = 0;
+    subtree->capacity = capacity;
+    subtree->up = NULL;
+    subtree->rootDepth = 0;
+    subtree->numNodes = 0;
+    subtree->deletionBudget = 0;
+    return subtree;
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::freeBlock(TwoSubtree* subtree) {
+    free(subtree);
+}
+
+template <typename Word, typename Payload>
+typename BasicMultilevelTreeNode<Word, Payload>::TwoSubtree* BasicMultilevelTreeNode<Word, Payload>::appendToBlock(TwoSubtree* subtree, BasicMultilevelTreeNode* node,
+                                                                                                                     BasicMultilevelTreeNode* up) {
+    if (subtree->size == subtree->capacity) {
+        TwoSubtree* larger = newBlock(std::min(2 * subtree->capacity, twoSubtreeMaxSize));
+        larger->summaryNode = subtree->summaryNode;
+        larger->up = subtree->up;
+        larger->size = subtree->size;
+        larger->rootDepth = subtree->rootDepth;
+        larger->numNodes = subtree->numNodes;
+        larger->deletionBudget = subtree->deletionBudget;
+        std::copy(subtree->nodes(), subtree->nodes() + subtree->size, larger->nodes());
+        for (int k = 0; k < subtree->size; ++k) {
+            larger->nodes()[k]->block = larger;
+        }
+        freeBlock(subtree);
+        subtree = larger;
+    }
+    node->block = subtree;
+    node->ancestorWord = (up ? up->ancestorWord : Word()) | MicroWord<Word>::bit(subtree->size);
+    subtree->nodes()[subtree->size] = node;
+    subtree->size += 1;
+    return subtree;
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::startTwoSubtree() {
+    assert(!block);
+    TwoSubtree* subtree = appendToBlock(newBlock(1), this, NULL);
+    subtree->up = parent;
+    if (parent) {
+        // Read directly: carveTwoSubtrees creates the summary nodes last
+        subtree->rootDepth = parent->block->rootDepth + MicroWord<Word>::popcount(parent->ancestorWord);
+    } else {
+        subtree->numNodes = 1;
+    }
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::appendChild(BasicMultilevelTreeNode* child) {
+    child->parent = this;
+    child->nextSibling = NULL;
+    if (firstChild) {
+        child->prevSibling = firstChild->prevSibling;
+        firstChild->prevSibling->nextSibling = child;
+    } else {
+        firstChild = child;
+    }
+    firstChild->prevSibling = child;
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::unlinkFromParent() {
+    if (parent->firstChild == this) {
+        parent->firstChild = nextSibling;
+    } else {
+        prevSibling->nextSibling = nextSibling;
+    }
+    // The last child is kept in the first child's prevSibling
+    BasicMultilevelTreeNode* successor = nextSibling ? nextSibling : parent->firstChild;
+    if (successor) {
+        successor->prevSibling = prevSibling;
+    }
+    parent = NULL;
+    nextSibling = NULL;
+    prevSibling = NULL;
+}
+
+template <typename Word, typename Payload>
+long long BasicMultilevelTreeNode<Word, Payload>::rootDepth(TwoSubtree* subtree) {
+    if (subtree->summaryNode || !subtree->up) {
+        return subtree->rootDepth;
+    }
+    return subtree->up->depth() + 1;
+}
+
+template <typename Word, typename Payload>
+bool BasicMultilevelTreeNode<Word, Payload>::add_leaf(BasicMultilevelTreeNode* leaf) {
+    LCA_STATS_ONLY(uint64_t statsStart = LcaStats::now();)
+    // Found before the leaf can fill a 2-subtree whose summary node is not
+    // in the summary tree yet
+    BasicMultilevelTreeNode* root = treeRoot();
+    if (block && block->size == twoSubtreeMaxSize - 1 && !block->summaryNode && !root->summaryHasRoom(1)) {
+        return false;
+    }
+
+    std::pair<SummaryNode*, SummaryNode*> summaryLeaf = attachLeaf(leaf);
+    if (summaryLeaf.first) {
+        summaryLeaf.first->add_leaf(summaryLeaf.second);
+    }
+    root->block->numNodes += 1;
+    LCA_STATS_ONLY(LcaStats::recordLatency(LcaStats::multilevelAddLeaf, LcaStats::now() - statsStart);)
+    return true;
+}
+
+template <typename Word, typename Payload>
+bool BasicMultilevelTreeNode<Word, Payload>::add_leaves(const std::pair<BasicMultilevelTreeNode*, BasicMultilevelTreeNode*>* batch,
+                                              size_t n) {
+    // Each leaf fills at most one 2-subtree, so a tree gains at most n
+    // summary nodes (a leaf earlier in the batch is a tree by itself here)
+    for (size_t k = 0; k < n; ++k) {
+        if (!batch[k].first->treeRoot()->summaryHasRoom(n)) {
+            return false;
+        }
+    }
+
+    // A 2-subtree fills before any 2-subtree below it starts, so the parent
+    // of each summary node is in the summary tree or earlier in the batch
+    std::vector<std::pair<SummaryNode*, SummaryNode*>> summaryBatch;
+    for (size_t k = 0; k < n; ++k) {
+        std::pair<SummaryNode*, SummaryNode*> summaryLeaf = batch[k].first->attachLeaf(batch[k].second);
+        if (summaryLeaf.first) {
+            summaryBatch.push_back(summaryLeaf);
+        }
+    }
+    SummaryNode::add_leaves(summaryBatch.data(), summaryBatch.size());
+
+    // The summary tree is whole again, so the roots can be found
+    for (size_t k = 0; k < n; ++k) {
+        batch[k].second->treeRoot()->block->numNodes += 1;
+    }
+    return true;
+}
+
+template <typename Word, typename Payload>
+std::pair<typename BasicMultilevelTreeNode<Word, Payload>::SummaryNode*, typename BasicMultilevelTreeNode<Word, Payload>::SummaryNode*>
+BasicMultilevelTreeNode<Word, Payload>::attachLeaf(BasicMultilevelTreeNode* leaf) {
+    std::pair<SummaryNode*, SummaryNode*> summaryLeaf(NULL, NULL);
+    appendChild(leaf);
+    if (!block) {
+        startTwoSubtree();
+    }
+
+    if (block->size == twoSubtreeMaxSize) {
+        // Case 1: subtree containing x was full
+        // `leaf` should be made the leaf of a new subtree
+        leaf->startTwoSubtree();
+    } else {
+        // Case 2: subtree containing x was not previously full
+        // Add `leaf` to this subtree, with the next integer
+        TwoSubtree* subtree = appendToBlock(block, leaf, this);
+
+        if (subtree->size == twoSubtreeMaxSize && !subtree->summaryNode) {
+            // If the subtree is now full (and did not shrink from full before):
+            LCA_STATS_ONLY(LcaStats::recordTwoSubtreeFill();)
+            BasicMultilevelTreeNode* subtreeRoot = subtree->nodes()[0];
+            SummaryNode* currSummary = new SummaryNode(NoPayload(), subtreeRoot);
+            subtree->rootDepth = rootDepth(subtree); // kept from now on
+            subtree->summaryNode = currSummary;
+            summaryLeaf.second = currSummary;
+            if (subtreeRoot->parent) {
+                summaryLeaf.first = subtreeRoot->parent->block->summaryNode;
+            } // Otherwise, summaryNode is the root: leave parent as NULL
+        }
+    }
+    return summaryLeaf;
+}
+
+template <typename Word, typename Payload>
+bool BasicMultilevelTreeNode<Word, Payload>::link(BasicMultilevelTreeNode* otherRoot) {
+    BasicMultilevelTreeNode* root = treeRoot();
+    assert(otherRoot->parent == NULL && root != otherRoot);
+
+    // The other summary tree joins this one, below a summary node that this
+    // node's 2-subtree may need (a smaller tree fills at most that one)
+    long long added = otherRoot->summaryNode() ? otherRoot->summaryNode()->dynamicSubtreeSize + 1 : 1;
+    if (!root->summaryHasRoom(added)) {
+        return false;
+    }
+
+    if (!otherRoot->summaryNode()) {
+        // A single 2-subtree of fewer than twoSubtreeMaxSize nodes: insert
+        // them again by increasing integer, so parents come first
+        std::vector<BasicMultilevelTreeNode*> subtreeNodes(1, otherRoot);
+        if (otherRoot->block) {
+            subtreeNodes.assign(otherRoot->block->nodes(), otherRoot->block->nodes() + otherRoot->block->size);
+            freeBlock(otherRoot->block);
+        }
+        std::vector<BasicMultilevelTreeNode*> parents;
+        for (BasicMultilevelTreeNode* node : subtreeNodes) {
+            parents.push_back(node->parent ? node->parent : this);
+            node->parent = NULL;
+            node->firstChild = NULL;
+            node->nextSibling = NULL;
+            node->prevSibling = NULL;
+            node->block = NULL;
+        }
+        for (size_t k = 0; k < subtreeNodes.size(); ++k) {
+            parents[k]->add_leaf(subtreeNodes[k]);
+        }
+        return true;
+    }
+
+    // Otherwise its root 2-subtree becomes a child 2-subtree of this node's,
+    // which therefore needs a summary node. Its full 2-subtrees move down;
+    // the others follow their parents.
+    long long shift = depth() + 1;
+    std::vector<SummaryNode*> otherSummary;
+    otherRoot->block->summaryNode->collectPreorder(otherSummary, false);
+    for (SummaryNode* summary : otherSummary) {
+        static_cast<BasicMultilevelTreeNode*>(summary->associatedTwoSubtree)->block->rootDepth += shift;
+    }
+
+    long long otherNodes = otherRoot->block->numNodes;
+    appendChild(otherRoot);
+    otherRoot->block->up = this;
+    if (!block) {
+        startTwoSubtree();
+    }
+    root->block->numNodes += otherNodes;
+
+    if (!block->summaryNode) {
+        BasicMultilevelTreeNode* subtreeRoot = block->nodes()[0];
+        SummaryNode* summary = new SummaryNode(NoPayload(), subtreeRoot);
+        block->rootDepth = rootDepth(block);
+        block->summaryNode = summary;
+        if (subtreeRoot->parent) {
+            subtreeRoot->parent->block->summaryNode->add_leaf(summary);
+        }
+    }
+    block->summaryNode->link(otherRoot->block->summaryNode);
+    return true;
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::buildFromParents(const std::vector<int>& parents,
+                                                                                                 std::vector<BasicMultilevelTreeNode*>& nodes) {
+    // Counting sort of the nodes by parent gives the CSR layout
+    int numNodes = parents.size();
+    int rootId = -1;
+    std::vector<int> childStart(numNodes + 1, 0);
+    for (int i = 0; i < numNodes; ++i) {
+        if (parents[i] < 0) {
+            rootId = i;
+        } else {
+            childStart[parents[i] + 1] += 1;
+        }
+    }
+    assert(numNodes == 0 || rootId >= 0);
+    for (int i = 0; i < numNodes; ++i) {
+        childStart[i + 1] += childStart[i];
+    }
+
+    std::vector<int> childIds(childStart[numNodes]);
+    std::vector<int> nextSlot(childStart.begin(), childStart.end() - 1);
+    for (int i = 0; i < numNodes; ++i) {
+        if (parents[i] >= 0) {
+            childIds[nextSlot[parents[i]]++] = i;
+        }
+    }
+
+    return buildFromCsr(childStart, childIds, rootId, nodes);
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::buildFromCsr(const std::vector<int>& childStart,
+                                                                                             const std::vector<int>& childIds, int rootId,
+                                                                                             std::vector<BasicMultilevelTreeNode*>& nodes) {
+    int numNodes = childStart.size() - 1;
+    nodes.resize(numNodes);
+    if (numNodes == 0) {
+        return NULL;
+    }
+    for (int i = 0; i < numNodes; ++i) {
+        nodes[i] = new BasicMultilevelTreeNode(payloadFromId<Payload>(i));
+    }
+
+    // Link the children, visiting the nodes in preorder
+    std::vector<BasicMultilevelTreeNode*> preorder;
+    preorder.reserve(numNodes);
+    std::vector<int> stack(1, rootId);
+    while (!stack.empty()) {
+        int id = stack.back();
+        stack.pop_back();
+        BasicMultilevelTreeNode* node = nodes[id];
+        preorder.push_back(node);
+
+        for (int k = childStart[id]; k < childStart[id + 1]; ++k) {
+            node->appendChild(nodes[childIds[k]]);
+        }
+        // Push in reverse so that children are visited in order
+        for (int k = childStart[id + 1] - 1; k >= childStart[id]; --k) {
+            stack.push_back(childIds[k]);
+        }
+    }
+
+    carveTwoSubtrees(preorder);
+    return nodes[rootId];
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::carveTwoSubtrees(const std::vector<BasicMultilevelTreeNode*>& preorder) {
+    // Free the blocks of a previous partition, each one through its root,
+    // which precedes the other nodes of its block in preorder
+    for (auto it = preorder.rbegin(); it != preorder.rend(); ++it) {
+        if ((*it)->block && (*it)->block->nodes()[0] == *it) {
+            freeBlock((*it)->block);
+        }
+    }
+
+    // Carve the 2-subtrees in preorder, as add_leaf would: a node joins its
+    // parent's 2-subtree unless that one is full, in which case it starts a
+    // new one
+    std::vector<BasicMultilevelTreeNode*> twoSubtreeRoots; // in preorder
+    for (BasicMultilevelTreeNode* node : preorder) {
+        BasicMultilevelTreeNode* up = node->parent;
+        node->block = NULL;
+        if (!up || up->block->size == twoSubtreeMaxSize) {
+            node->startTwoSubtree();
+            twoSubtreeRoots.push_back(node);
+        } else {
+            appendToBlock(up->block, node, up);
+        }
+    }
+
+    // Summary nodes of full 2-subtrees. The parent of a 2-subtree root lies
+    // in a full 2-subtree that comes earlier in preorder, so its summary
+    // node already exists.
+    for (BasicMultilevelTreeNode* subtreeRoot : twoSubtreeRoots) {
+        TwoSubtree* subtree = subtreeRoot->block;
+        if (subtree->size < twoSubtreeMaxSize) {
+            continue;
+        }
+        LCA_STATS_ONLY(LcaStats::recordTwoSubtreeFill();)
+        SummaryNode* summary = new SummaryNode(NoPayload());
+        summary->associatedTwoSubtree = subtreeRoot;
+        subtree->summaryNode = summary;
+        if (subtreeRoot->parent) {
+            subtreeRoot->parent->block->summaryNode->addLeafNoPreprocessing(summary);
+        }
+    }
+
+    BasicMultilevelTreeNode* root = preorder[0];
+    root->block->numNodes = preorder.size();
+    if (root->block->summaryNode) {
+        root->block->summaryNode->preprocess();
+    }
+}
+
+template <typename Word, typename Payload>
+bool BasicMultilevelTreeNode<Word, Payload>::liftToCommonSubtree(BasicMultilevelTreeNode*& x, BasicMultilevelTreeNode*& y,
+                                                        BasicMultilevelTreeNode*& xEntry, BasicMultilevelTreeNode*& yEntry) {
+    xEntry = NULL;
+    yEntry = NULL;
+    if (x->block == y->block) {
+        // No block: both nodes are alone in their trees
+        return x->block || x == y;
+    }
+    if (!x->block || !y->block) {
+        return false;
+    }
+
+    // If x and y do not belong to the same 2-subtree,
+    // use the summary tree to change x and y so that they do
+
+    // If x-hat is not full, set x to full parent
+    // (a root 2-subtree that is not full is a whole tree of its own)
+    if (!x->block->summaryNode) {
+        xEntry = x->block->nodes()[0];
+        x = x->block->up;
+    }
+
+    // If y-hat is not full, set y to full parent
+    if (!y->block->summaryNode) {
+        yEntry = y->block->nodes()[0];
+        y = y->block->up;
+    }
+    if (!x || !y) {
+        return false;
+    }
+
+    // LCA on summary tree
+    SummaryNode* xSummary = x->block->summaryNode;
+    SummaryNode* ySummary = y->block->summaryNode;
+    SummaryNode::caTuple summaryCas = SummaryNode::cas(xSummary, ySummary);
+    if (!summaryCas.lca) {
+        return false;
+    }
+
+    if (summaryCas.lca != summaryCas.ca_x) {
+        xEntry = static_cast<BasicMultilevelTreeNode*>(summaryCas.ca_x->associatedTwoSubtree);
+        x = xEntry->parent;
+    }
+    if (summaryCas.lca != summaryCas.ca_y) {
+        yEntry = static_cast<BasicMultilevelTreeNode*>(summaryCas.ca_y->associatedTwoSubtree);
+        y = yEntry->parent;
+    }
+    return true;
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::lca(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    BasicMultilevelTreeNode* x = nodeX;
+    BasicMultilevelTreeNode* y = nodeY;
+    BasicMultilevelTreeNode* xEntry;
+    BasicMultilevelTreeNode* yEntry;
+    if (!liftToCommonSubtree(x, y, xEntry, yEntry)) {
+        return NULL;
+    }
+
+    // LCA query on the 2-subtree
+    BasicMultilevelTreeNode* lcaNode = lcaWithinSubtree(x, y);
+
+    return lcaNode;
+}
+
+template <typename Word, typename Payload>
+typename BasicMultilevelTreeNode<Word, Payload>::caTuple BasicMultilevelTreeNode<Word, Payload>::cas(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    BasicMultilevelTreeNode* x = nodeX;
+    BasicMultilevelTreeNode* y = nodeY;
+    BasicMultilevelTreeNode* xEntry;
+    BasicMultilevelTreeNode* yEntry;
+    if (!liftToCommonSubtree(x, y, xEntry, yEntry)) {
+        caTuple toReturn = {NULL, NULL, NULL};
+        return toReturn;
+    }
+
+    BasicMultilevelTreeNode* lcaNode = lcaWithinSubtree(x, y);
+    caTuple toReturn = {lcaNode, childOnPath(lcaNode, x, xEntry), childOnPath(lcaNode, y, yEntry)};
+    return toReturn;
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::childOnPath(BasicMultilevelTreeNode* ancestor, BasicMultilevelTreeNode* node,
+                                                                                            BasicMultilevelTreeNode* entry) {
+    if (node == ancestor) {
+        // The path leaves the 2-subtree right at the ancestor (or ends there)
+        return entry ? entry : ancestor;
+    }
+
+    // Ancestors of `node` below `ancestor` in their 2-subtree; integers grow with depth
+    return ancestor->block->nodes()[MicroWord<Word>::lsb(node->ancestorWord & ~ancestor->ancestorWord)];
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::lcaBatch(const std::pair<BasicMultilevelTreeNode*, BasicMultilevelTreeNode*>* queries,
+                                             BasicMultilevelTreeNode** results, size_t n) {
+    const int groupSize = SummaryNode::batchGroupSize;
+    BasicMultilevelTreeNode* x[groupSize];
+    BasicMultilevelTreeNode* y[groupSize];
+    std::pair<SummaryNode*, SummaryNode*> summaryQueries[groupSize];
+    SummaryNode::caTuple summaryCas[groupSize];
+    int summaryIndex[groupSize]; // position in summaryQueries, or -1 if not needed
+    int msb[groupSize];
+
+    for (size_t first = 0; first < n; first += groupSize) {
+        size_t count = std::min((size_t) groupSize, n - first);
+
+        // Stage 1: the query nodes
+        for (size_t k = 0; k < count; ++k) {
+            x[k] = queries[first + k].first;
+            y[k] = queries[first + k].second;
+            __builtin_prefetch(x[k]);
+            __builtin_prefetch(y[k]);
+        }
+
+        // Stage 2: the headers of their 2-subtrees
+        for (size_t k = 0; k < count; ++k) {
+            __builtin_prefetch(x[k]->block);
+            __builtin_prefetch(y[k]->block);
+        }
+
+        // Stage 3: nodes in non-full 2-subtrees move to their full parent
+        // (none for a root 2-subtree: x and y are then in different trees)
+        size_t numSummary = 0;
+        for (size_t k = 0; k < count; ++k) {
+            summaryIndex[k] = -1;
+            if (x[k]->block == y[k]->block) {
+                if (!x[k]->block && x[k] != y[k]) {
+                    // Two nodes alone in their trees
+                    x[k] = y[k] = NULL;
+                }
+                continue;
+            }
+            if (!x[k]->block || !y[k]->block) {
+                x[k] = y[k] = NULL;
+                continue;
+            }
+            if (!x[k]->block->summaryNode) {
+                x[k] = x[k]->block->up;
+                __builtin_prefetch(x[k]);
+            }
+            if (!y[k]->block->summaryNode) {
+                y[k] = y[k]->block->up;
+                __builtin_prefetch(y[k]);
+            }
+            if (!x[k] || !y[k]) {
+                x[k] = y[k] = NULL;
+                continue;
+            }
+            summaryIndex[k] = numSummary++;
+        }
+
+        // Stage 4: the headers holding the summary nodes
+        for (size_t k = 0; k < count; ++k) {
+            if (summaryIndex[k] >= 0) {
+                __builtin_prefetch(x[k]->block);
+                __builtin_prefetch(y[k]->block);
+            }
+        }
+
+        // Stage 5: characteristic ancestors on the summary tree, batched as well
+        for (size_t k = 0; k < count; ++k) {
+            if (summaryIndex[k] >= 0) {
+                summaryQueries[summaryIndex[k]] = std::make_pair(x[k]->block->summaryNode, y[k]->block->summaryNode);
+            }
+        }
+        SummaryNode::casBatch(summaryQueries, summaryCas, numSummary);
+
+        // Stage 6: the 2-subtrees below the summary LCA lead back into it
+        for (size_t k = 0; k < count; ++k) {
+            if (summaryIndex[k] >= 0) {
+                SummaryNode::caTuple& summary = summaryCas[summaryIndex[k]];
+                if (summary.lca != summary.ca_x) {__builtin_prefetch(summary.ca_x->associatedTwoSubtree);}
+                if (summary.lca != summary.ca_y) {__builtin_prefetch(summary.ca_y->associatedTwoSubtree);}
+            }
+        }
+        for (size_t k = 0; k < count; ++k) {
+            if (summaryIndex[k] >= 0) {
+                SummaryNode::caTuple& summary = summaryCas[summaryIndex[k]];
+                if (!summary.lca) {
+                    x[k] = y[k] = NULL;
+                    continue;
+                }
+                if (summary.lca != summary.ca_x) {
+                    x[k] = static_cast<BasicMultilevelTreeNode*>(summary.ca_x->associatedTwoSubtree)->parent;
+                    __builtin_prefetch(x[k]);
+                }
+                if (summary.lca != summary.ca_y) {
+                    y[k] = static_cast<BasicMultilevelTreeNode*>(summary.ca_y->associatedTwoSubtree)->parent;
+                    __builtin_prefetch(y[k]);
+                }
+            }
+        }
+
+        // Stage 7: the entry of the node table of their shared block
+        for (size_t k = 0; k < count; ++k) {
+            if (x[k] && x[k] != y[k]) {
+                msb[k] = MicroWord<Word>::msb(x[k]->ancestorWord & y[k]->ancestorWord);
+                __builtin_prefetch(&x[k]->block->nodes()[msb[k]]);
+            }
+        }
+
+        // Stage 8: LCA query on the 2-subtree (see lcaWithinSubtree)
+        for (size_t k = 0; k < count; ++k) {
+            if (!x[k]) {
+                results[first + k] = NULL;
+            } else {
+                results[first + k] = (x[k] == y[k]) ? x[k] : x[k]->block->nodes()[msb[k]];
+            }
+        }
+    }
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::lcaWithinSubtree(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    assert(nodeX->block == nodeY->block);
+
+    if(nodeX == nodeY) {
+        return nodeX;
+    }
+
+    // The deepest common ancestor holds the most significant common bit
+    int msb = MicroWord<Word>::msb(nodeX->ancestorWord & nodeY->ancestorWord);
+
+    return nodeX->block->nodes()[msb];
+}
+
+template <typename Word, typename Payload>
+long long BasicMultilevelTreeNode<Word, Payload>::depth() {
+    if (!block) {
+        return 0;
+    }
+    return rootDepth(block) + MicroWord<Word>::popcount(ancestorWord) - 1;
+}
+
+template <typename Word, typename Payload>
+long long BasicMultilevelTreeNode<Word, Payload>::distance(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    BasicMultilevelTreeNode* lcaNode = lca(nodeX, nodeY);
+    if (!lcaNode) {
+        return -1;
+    }
+    return nodeX->depth() + nodeY->depth() - 2 * lcaNode->depth();
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::levelAncestor(BasicMultilevelTreeNode* node, long long k) {
+    long long target = node->depth() - k;
+    if (k < 0 || target < 0) {
+        return NULL;
+    }
+    if (k == 0) {
+        return node;
+    }
+
+    // Above a 2-subtree without summary node, go to its full parent
+    TwoSubtree* subtree = node->block;
+    long long top = rootDepth(subtree);
+    if (target < top && !subtree->summaryNode) {
+        node = subtree->up;
+        subtree = node->block;
+        top = subtree->rootDepth;
+    }
+
+    // Further up, the highest summary ancestor whose 2-subtree starts below
+    // the target: the path enters it from the 2-subtree holding the target
+    if (target < top) {
+        SummaryNode* entry = subtree->summaryNode->highestAncestorWhere([target](SummaryNode* summary) {
+            return static_cast<BasicMultilevelTreeNode*>(summary->associatedTwoSubtree)->block->rootDepth > target;
+        });
+        node = static_cast<BasicMultilevelTreeNode*>(entry->associatedTwoSubtree)->parent;
+        subtree = node->block;
+        top = subtree->rootDepth;
+    }
+
+    // Ancestors in a 2-subtree hold one bit each, in order of depth
+    return subtree->nodes()[MicroWord<Word>::select(node->ancestorWord, target - top)];
+}
+
+template <typename Node>
+std::string nodeData(Node* node) {
+    if (node) {
+        return payloadString(node->payload(), node);
+    } else {
+        return "NULL";
+    }
+}
+
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::print(int level, bool details) {
+    // Explicit stack, so that printing a deep tree cannot overflow the call stack
+    std::vector<std::pair<BasicMultilevelTreeNode*, int> > stack(1, std::make_pair(this, level));
+    while (!stack.empty()) {
+        BasicMultilevelTreeNode* node = stack.back().first;
+        int nodeLevel = stack.back().second;
+        stack.pop_back();
+
+        for (int i = 0; i < nodeLevel; i++){
+            std::cout << "    ";
+        }
+
+        std::cout << "Node " << nodeData(node);
+        if (details){
+            std:: cout << "(twoSubtreeRoot = " << nodeData(node->twoSubtreeRoot()) << ", "
+                       << "twoSubtreeSize = " << node->twoSubtreeSize() << ", "
+                       << "summaryNode = " << node->summaryNode() << ", "
+                       << "ancestorWord = ";
+            for (int k = MicroWord<Word>::bits - 1; k >= 0; --k) {
+                std::cout << MicroWord<Word>::test(node->ancestorWord, k);
+            }
+            std::cout << ")";
+        }
+        std::cout << std::endl;
+
+        for (BasicMultilevelTreeNode* child = node->lastChild(); child; child = (child == node->firstChild) ? NULL : child->prevSibling) {
+            stack.push_back(std::make_pair(child, nodeLevel + 1));
+        }
+    }
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>::BasicMultilevelTreeNode(const Payload& payload) : PayloadHolder<Payload>(payload) {
+        block = NULL; // until the node joins a tree, or starts one with add_leaf
+        ancestorWord = MicroWord<Word>::bit(0);
+
+        parent = NULL;
+        firstChild = NULL;
+        nextSibling = NULL;
+        prevSibling = NULL;
+}
+
+// Slightly modified from ExpensiveTreeNode::naiveCas
+// The code duplication is worth the easy testing
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::naiveLca(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    if (nodeX == nodeY) {
+        return(nodeX);
+    }
+
+    std::deque<BasicMultilevelTreeNode*> xPath;
+    std::deque<BasicMultilevelTreeNode*> yPath;
+    
+    BasicMultilevelTreeNode* currNode = nodeX;
+    while (currNode) {
+        xPath.push_front(currNode);
+        currNode = currNode->parent;
+    }
+
+    currNode = nodeY;
+    while (currNode) {
+        yPath.push_front(currNode);
+        currNode = currNode->parent;
+    }
+
+    size_t i = 0;
+    while (i < xPath.size() && i < yPath.size() && xPath[i] == yPath[i]) {
+        i++;
+    }
+
+    BasicMultilevelTreeNode* lca = (i > 0) ? xPath[i-1] : NULL; // no common root: different trees
+    return (lca);
+}
+
+template <typename Word, typename Payload>
+typename BasicMultilevelTreeNode<Word, Payload>::caTuple BasicMultilevelTreeNode<Word, Payload>::naiveCas(BasicMultilevelTreeNode* nodeX, BasicMultilevelTreeNode* nodeY) {
+    if (nodeX == nodeY) {
+        BasicMultilevelTreeNode::caTuple toReturn = {nodeX, nodeX, nodeX};
+        return(toReturn);
+    }
+
+    std::deque<BasicMultilevelTreeNode*> xPath;
+    std::deque<BasicMultilevelTreeNode*> yPath;
+
+    BasicMultilevelTreeNode* currNode = nodeX;
+    while (currNode) {
+        xPath.push_front(currNode);
+        currNode = currNode->parent;
+    }
+
+    currNode = nodeY;
+    while (currNode) {
+        yPath.push_front(currNode);
+        currNode = currNode->parent;
+    }
+
+    size_t i = 0;
+    while (i < xPath.size() && i < yPath.size() && xPath[i] == yPath[i]) {
+        i++;
+    }
+    if (i == 0) {
+        // Different roots: the nodes are in different trees
+        BasicMultilevelTreeNode::caTuple toReturn = {NULL, NULL, NULL};
+        return (toReturn);
+    }
+
+    BasicMultilevelTreeNode* lca = xPath[i-1];
+    BasicMultilevelTreeNode* ca_x = i < xPath.size() ? xPath[i] : xPath[xPath.size() - 1];
+    BasicMultilevelTreeNode* ca_y = i < yPath.size() ? yPath[i] : yPath[yPath.size() - 1];
+    BasicMultilevelTreeNode::caTuple toReturn = {lca, ca_x, ca_y};
+
+    return (toReturn);
+}
+
+template <typename Word, typename Payload>
+MemoryUsage BasicMultilevelTreeNode<Word, Payload>::memoryUsage() {
+    assert(parent == NULL);
+    MemoryUsage usage = {};
+    std::vector<BasicMultilevelTreeNode*> stack(1, this);
+    while (!stack.empty()) {
+        BasicMultilevelTreeNode* node = stack.back();
+        stack.pop_back();
+        usage.numNodes += 1;
+        usage.nodes += sizeof(BasicMultilevelTreeNode);
+        bool ownsBlock = node->block && node->block->nodes()[0] == node;
+        if (ownsBlock) {
+            usage.subtreeIndex += TwoSubtree::bytes(node->block->capacity);
+        }
+        usage.allocations += 1 + (ownsBlock ? 1 : 0);
+        for (BasicMultilevelTreeNode* child = node->firstChild; child; child = child->nextSibling) {
+            stack.push_back(child);
+        }
+    }
+
+    if (summaryNode()) {
+        MemoryUsage summary = summaryNode()->memoryUsage();
+        usage.summaryNodes = summary.total();
+        usage.allocations += summary.allocations;
+    }
+    return usage;
+}
+
+template <typename Word, typename Payload>
+BasicMultilevelTreeNode<Word, Payload>* BasicMultilevelTreeNode<Word, Payload>::treeRoot() {
+    if (!block) {
+        return this;
+    }
+    TwoSubtree* subtree = block;
+    if (!subtree->summaryNode) {
+        BasicMultilevelTreeNode* subtreeRoot = subtree->nodes()[0];
+        if (!subtreeRoot->parent) {
+            return subtreeRoot;
+        }
+        // The parent of a 2-subtree without summary node lies in a full one
+        subtree = subtreeRoot->parent->block;
+    }
+    // The summary root is the summary node of the root's 2-subtree
+    return static_cast<BasicMultilevelTreeNode*>(subtree->summaryNode->root->associatedTwoSubtree);
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::removeFromTwoSubtree(TwoSubtree* subtree, const Word& removed) {
+    // Integers grow with depth, so the parent of each remaining node is
+    // renumbered before the node itself, and the order is kept
+    BasicMultilevelTreeNode** nodes = subtree->nodes();
+    int next = 0;
+    for (int k = 0; k < subtree->size; ++k) {
+        if (MicroWord<Word>::test(removed, k)) {
+            continue;
+        }
+        BasicMultilevelTreeNode* node = nodes[k];
+        node->ancestorWord = (k == 0) ? MicroWord<Word>::bit(0) : node->parent->ancestorWord | MicroWord<Word>::bit(next);
+        nodes[next++] = node;
+    }
+    subtree->size = next;
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::rebalance() {
+    assert(parent == NULL);
+    if (summaryNode()) {
+        summaryNode()->deleteNode();
+    }
+
+    std::vector<BasicMultilevelTreeNode*> preorder;
+    std::vector<BasicMultilevelTreeNode*> stack(1, this);
+    while (!stack.empty()) {
+        BasicMultilevelTreeNode* node = stack.back();
+        stack.pop_back();
+        preorder.push_back(node);
+        for (BasicMultilevelTreeNode* child = node->lastChild(); child; child = (child == node->firstChild) ? NULL : child->prevSibling) {
+            stack.push_back(child);
+        }
+    }
+
+    carveTwoSubtrees(preorder);
+    block->deletionBudget = std::max((long long) preorder.size() / 2, (long long) twoSubtreeMaxSize);
+}
+
+template <typename Word, typename Payload>
+bool BasicMultilevelTreeNode<Word, Payload>::summaryHasRoom(long long added) {
+    long long summarySize = summaryNode() ? summaryNode()->dynamicSubtreeSize : 0;
+    if (summarySize + added <= FatPreorder::maxSize) {
+        return true;
+    }
+
+    // The summary tree still counts the 2-subtrees that deletions emptied:
+    // a repartition packs the nodes, leaving at most a summary node per
+    // twoSubtreeMaxSize of them
+    if (!block || block->numNodes / twoSubtreeMaxSize + added > FatPreorder::maxSize) {
+        return false;
+    }
+    rebalance();
+    summarySize = summaryNode() ? summaryNode()->dynamicSubtreeSize : 0;
+    return summarySize + added <= FatPreorder::maxSize;
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::delete_leaf() {
+    assert(!firstChild);
+    deleteNode();
+}
+
+template <typename Word, typename Payload>
+void BasicMultilevelTreeNode<Word, Payload>::deleteNode() {
+    std::vector<BasicMultilevelTreeNode*> subtree;
+    std::vector<BasicMultilevelTreeNode*> stack(1, this);
+    while (!stack.empty()) {
+        BasicMultilevelTreeNode* node = stack.back();
+        stack.pop_back();
+        subtree.push_back(node);
+        for (BasicMultilevelTreeNode* child = node->firstChild; child; child = child->nextSibling) {
+            stack.push_back(child);
+        }
+    }
+
+    BasicMultilevelTreeNode* root = NULL;
+    if (!parent) {
+        // The whole tree goes, summary tree included
+        if (summaryNode()) {
+            summaryNode()->deleteNode();
+        }
+    } else {
+        root = treeRoot();
+        TwoSubtree* home = block;
+        unlinkFromParent();
+
+        if (home->nodes()[0] == this) {
+            // The 2-subtree goes entirely, with every 2-subtree below it: their
+            // summary nodes form the subtree of its own in the summary tree
+            if (home->summaryNode) {
+                home->summaryNode->deleteNode();
+            }
+        } else {
+            // The 2-subtrees hanging from the deleted part of `home` take their
+            // summary subtrees with them
+            Word removed = Word();
+            for (BasicMultilevelTreeNode* node : subtree) {
+                if (node->block == home) {
+                    // A node's own bit is the highest one of its word
+                    removed = removed | MicroWord<Word>::bit(MicroWord<Word>::msb(node->ancestorWord));
+                } else if (node->block->nodes()[0] == node && node->parent->block == home && node->block->summaryNode) {
+                    node->block->summaryNode->deleteNode();
+                }
+            }
+            removeFromTwoSubtree(home, removed);
+        }
+    }
+
+    // Blocks go with their roots, which precede their other nodes in the
+    // subtree (and `home` keeps its root)
+    for (auto it = subtree.rbegin(); it != subtree.rend(); ++it) {
+        if ((*it)->block && (*it)->block->nodes()[0] == *it) {
+            freeBlock((*it)->block);
+        }
+    }
+    for (BasicMultilevelTreeNode* node : subtree) {
+        delete node;
+    }
+    if (!root) {
+        return;
+    }
+
+    // Deletions can leave full 2-subtrees almost empty, and the summary tree
+    // much larger than n / log n: repartition once the deletions since the
+    // last repartition reach half the nodes, so that its O(n) cost is
+    // amortized over them
+    TwoSubtree* rootBlock = root->block;
+    rootBlock->numNodes -= subtree.size();
+    if (rootBlock->deletionBudget == 0) {
+        rootBlock->deletionBudget = std::max(rootBlock->numNodes / 2, (long long) twoSubtreeMaxSize);
+    }
+    rootBlock->deletionBudget -= std::min((long long) subtree.size(), rootBlock->deletionBudget);
+    if (rootBlock->deletionBudget == 0) {
+        root->rebalance();
+    }
+}
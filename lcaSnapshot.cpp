@@ -0,0 +1,470 @@
+#include "lcaSnapshot.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const LcaSnapshot::index LcaSnapshot::NIL;
+const NodeId LcaSnapshot::NO_NODE;
+const uint32_t LcaSnapshot::version;
+
+static const char snapshotMagic[8] = "LCASNAP";
+static const uint32_t byteOrderMark = 0x01020304u;
+static const uint64_t sectionAlignment = 64;
+
+static uint64_t alignSection(uint64_t offset) {
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+/* Sections of a snapshot, built in memory before being written out */
+struct LcaSnapshot::Image {
+    Header header;
+    std::vector<FatNode> fatNodes;
+    std::vector<index> ancestors;
+    std::vector<MultilevelNode> multilevelNodes;
+    std::vector<TwoSubtree> twoSubtrees;
+    std::vector<index> twoSubtreeIds;
+    std::vector<index> summaryOwners;
+
+    std::unordered_map<const void*, index> fatIndex; // by node, of any payload
+};
+
+
+/////////////////////
+// Writing Images  //
+/////////////////////
+
+bool LcaSnapshot::save(ExpensiveTreeNode* root, const char* path) {
+    Image image;
+    memset(&image.header, 0, sizeof(Header));
+    image.header.kind = expensiveTree;
+    if (!packFatPreorder(root, true, image)) {
+        return false;
+    }
+    image.header.numNodes = image.fatNodes.size();
+    return writeImage(image, path);
+}
+
+bool LcaSnapshot::save(MultilevelTreeNode* root, const char* path) {
+    Image image;
+    memset(&image.header, 0, sizeof(Header));
+    image.header.kind = multilevelTree;
+
+    std::vector<MultilevelTreeNode*> order;
+    std::vector<MultilevelTreeNode*> stack(1, root);
+    while (!stack.empty()) {
+        MultilevelTreeNode* node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+        for (MultilevelTreeNode* child = node->lastChild(); child; child = (child == node->firstChild) ? NULL : child->prevSibling) {
+            stack.push_back(child);
+        }
+    }
+
+    size_t numNodes = order.size();
+    std::vector<bool> seen(numNodes, false);
+    for (MultilevelTreeNode* node : order) {
+        if (node->payload() < 0 || node->payload() >= (NodeId) numNodes || seen[node->payload()]) {
+            return false;
+        }
+        seen[node->payload()] = true;
+    }
+
+    // The root of a 2-subtree precedes its other nodes in preorder
+    std::unordered_map<const MultilevelTreeNode*, index> subtreeIndex;
+    image.multilevelNodes.resize(numNodes);
+    for (MultilevelTreeNode* node : order) {
+        if (node->twoSubtreeRoot() == node) {
+            subtreeIndex[node] = image.twoSubtrees.size();
+            TwoSubtree subtree = {(index) node->payload(), (uint32_t) node->twoSubtreeSize(),
+                                  NIL, (uint32_t) image.twoSubtreeIds.size()};
+            image.twoSubtrees.push_back(subtree);
+            for (int k = 0; k < node->twoSubtreeSize(); ++k) {
+                image.twoSubtreeIds.push_back(node->intToSubtreeNode(k)->payload());
+            }
+        }
+
+        MultilevelNode& record = image.multilevelNodes[node->payload()];
+        record.ancestorWord = node->ancestorWord;
+        record.twoSubtree = subtreeIndex[node->twoSubtreeRoot()];
+        record.parent = node->parent ? (index) node->parent->payload() : NIL;
+    }
+
+    // The summary tree is rooted at the summary node of the root's 2-subtree
+    if (root->summaryNode()) {
+        if (!packFatPreorder(root->summaryNode(), false, image)) {
+            return false;
+        }
+        image.summaryOwners.resize(image.fatNodes.size());
+        for (auto& entry : subtreeIndex) {
+            MultilevelTreeNode::SummaryNode* summary = entry.first->summaryNode();
+            if (summary) {
+                index i = image.fatIndex[summary];
+                image.twoSubtrees[entry.second].summary = i;
+                image.summaryOwners[i] = entry.second;
+            }
+        }
+    }
+
+    image.header.numNodes = numNodes;
+    image.header.numTwoSubtrees = image.twoSubtrees.size();
+    return writeImage(image, path);
+}
+
+template <typename Node>
+bool LcaSnapshot::packFatPreorder(Node* root, bool idsAreIndices, Image& image) {
+    std::vector<Node*> order;
+    root->collectPreorder(order, false);
+
+    // Nodes are numbered by id, or else in preorder
+    size_t numNodes = order.size();
+    std::vector<bool> seen(numNodes, false);
+    size_t tableWidth = FatPreorder::tableWidth(root->subtreeSize); // enough for any query
+    image.fatIndex.reserve(numNodes);
+    for (size_t k = 0; k < numNodes; ++k) {
+        Node* node = order[k];
+        index i = k;
+        if (idsAreIndices) {
+            NodeId id = payloadId(node->payload());
+            if (id < 0 || id >= (NodeId) numNodes || seen[id]) {
+                return false;
+            }
+            seen[id] = true;
+            i = id;
+        }
+        if (!node->isPreprocessed) {
+            return false;
+        }
+        image.fatIndex[node] = i;
+    }
+
+    auto indexOf = [&image](const Node* node) {
+        if (!node) {
+            return NIL;
+        }
+        auto found = image.fatIndex.find(node);
+        return (found == image.fatIndex.end()) ? NIL : found->second;
+    };
+
+    image.fatNodes.resize(numNodes);
+    image.ancestors.assign(numNodes * tableWidth, NIL);
+    for (Node* node : order) {
+        index i = image.fatIndex[node];
+        FatNode& record = image.fatNodes[i];
+        record.start = node->start;
+        record.end = node->end;
+        record.sizeWeight = node->sizeWeight;
+        record.parent = indexOf(node->parent);
+        record.uncompressedParent = indexOf(node->uncompressedParent);
+        record.heavyChild = indexOf(node->heavyChild);
+        record.uncompressedLevel = node->uncompressedLevel;
+        record.isApex = node->isApex;
+        for (size_t k = 0; k < tableWidth; ++k) {
+            image.ancestors[i * tableWidth + k] = indexOf(node->ancestorAt(k));
+        }
+    }
+
+    image.header.numFatNodes = numNodes;
+    image.header.tableWidth = tableWidth;
+    return true;
+}
+
+// Appends `count` records at the next aligned offset, padding with zeros
+static bool writeSection(FILE* file, uint64_t& offset, uint64_t& sectionOffset,
+                         const void* data, size_t recordSize, size_t count) {
+    static const char zeros[sectionAlignment] = {0};
+    uint64_t aligned = alignSection(offset);
+    if (fwrite(zeros, 1, aligned - offset, file) != aligned - offset) {
+        return false;
+    }
+    sectionOffset = aligned;
+    offset = aligned + recordSize * count;
+    return count == 0 || fwrite(data, recordSize, count, file) == count;
+}
+
+bool LcaSnapshot::writeImage(Image& image, const char* path) {
+    // Compute the layout first, so that the header can be written up front
+    Header& header = image.header;
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = version;
+    header.byteOrder = byteOrderMark;
+    header.fatNodeSize = sizeof(FatNode);
+    header.multilevelNodeSize = sizeof(MultilevelNode);
+
+    uint64_t offset = sizeof(Header);
+    uint64_t* offsets[] = {&header.fatNodesOffset, &header.ancestorsOffset, &header.multilevelNodesOffset,
+                           &header.twoSubtreesOffset, &header.twoSubtreeIdsOffset, &header.summaryOwnersOffset};
+    size_t sizes[] = {sizeof(FatNode) * image.fatNodes.size(), sizeof(index) * image.ancestors.size(),
+                      sizeof(MultilevelNode) * image.multilevelNodes.size(), sizeof(TwoSubtree) * image.twoSubtrees.size(),
+                      sizeof(index) * image.twoSubtreeIds.size(), sizeof(index) * image.summaryOwners.size()};
+    for (int k = 0; k < 6; ++k) {
+        *offsets[k] = alignSection(offset);
+        offset = *offsets[k] + sizes[k];
+    }
+    header.fileSize = offset;
+
+    // Write next to the target and rename it into place, so that processes
+    // that still map an older snapshot at `path` are not affected
+    std::string tempPath = std::string(path) + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    offset = 0;
+    uint64_t written;
+    bool ok = writeSection(file, offset, written, &header, sizeof(Header), 1)
+           && writeSection(file, offset, written, image.fatNodes.data(), sizeof(FatNode), image.fatNodes.size())
+           && writeSection(file, offset, written, image.ancestors.data(), sizeof(index), image.ancestors.size())
+           && writeSection(file, offset, written, image.multilevelNodes.data(), sizeof(MultilevelNode), image.multilevelNodes.size())
+           && writeSection(file, offset, written, image.twoSubtrees.data(), sizeof(TwoSubtree), image.twoSubtrees.size())
+           && writeSection(file, offset, written, image.twoSubtreeIds.data(), sizeof(index), image.twoSubtreeIds.size())
+           && writeSection(file, offset, written, image.summaryOwners.data(), sizeof(index), image.summaryOwners.size());
+    ok = (fclose(file) == 0) && ok && offset == header.fileSize;
+
+    if (!ok || rename(tempPath.c_str(), path) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/////////////////////
+// Mapping Images  //
+/////////////////////
+
+LcaSnapshot::LcaSnapshot() {
+    mapping = NULL;
+    mappingSize = 0;
+    header = NULL;
+}
+
+LcaSnapshot::~LcaSnapshot() {
+    unload();
+}
+
+void LcaSnapshot::unload() {
+    if (mapping) {
+        munmap((void*) mapping, mappingSize);
+    }
+    mapping = NULL;
+    mappingSize = 0;
+    header = NULL;
+}
+
+// Checks that `count` records of `recordSize` bytes at `offset` lie within the file
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t recordSize, uint64_t fileSize) {
+    return offset % sectionAlignment == 0 && offset <= fileSize &&
+           count <= (fileSize - offset) / recordSize;
+}
+
+bool LcaSnapshot::load(const char* path) {
+    unload();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    size_t size = info.st_size;
+    void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const Header* h = (const Header*) addr;
+    bool valid = memcmp(h->magic, snapshotMagic, sizeof(snapshotMagic)) == 0
+              && h->version == version
+              && h->byteOrder == byteOrderMark
+              && h->fatNodeSize == sizeof(FatNode)
+              && h->multilevelNodeSize == sizeof(MultilevelNode)
+              && h->fileSize == size
+              && (h->kind == expensiveTree || h->kind == multilevelTree)
+              && h->numNodes < NIL && h->numFatNodes < NIL
+              && sectionFits(h->fatNodesOffset, h->numFatNodes, sizeof(FatNode), size)
+              && sectionFits(h->ancestorsOffset, h->numFatNodes * h->tableWidth, sizeof(index), size);
+    if (valid && h->kind == expensiveTree) {
+        valid = h->numFatNodes == h->numNodes;
+    } else if (valid) {
+        valid = sectionFits(h->multilevelNodesOffset, h->numNodes, sizeof(MultilevelNode), size)
+             && sectionFits(h->twoSubtreesOffset, h->numTwoSubtrees, sizeof(TwoSubtree), size)
+             && sectionFits(h->twoSubtreeIdsOffset, h->numNodes, sizeof(index), size)
+             && sectionFits(h->summaryOwnersOffset, h->numFatNodes, sizeof(index), size);
+    }
+    if (!valid) {
+        munmap(addr, size);
+        return false;
+    }
+
+    mapping = (const char*) addr;
+    mappingSize = size;
+    header = h;
+    fatNodes = (const FatNode*) (mapping + h->fatNodesOffset);
+    ancestors = (const index*) (mapping + h->ancestorsOffset);
+    multilevelNodes = (const MultilevelNode*) (mapping + h->multilevelNodesOffset);
+    twoSubtrees = (const TwoSubtree*) (mapping + h->twoSubtreesOffset);
+    twoSubtreeIds = (const index*) (mapping + h->twoSubtreeIdsOffset);
+    summaryOwners = (const index*) (mapping + h->summaryOwnersOffset);
+    return true;
+}
+
+
+///////////////////////
+// Answering Queries //
+///////////////////////
+
+NodeId LcaSnapshot::lca(NodeId idX, NodeId idY) const {
+    NodeId numNodes = header->numNodes;
+    if (idX < 0 || idY < 0 || idX >= numNodes || idY >= numNodes) {
+        return NO_NODE;
+    }
+    if (header->kind == expensiveTree) {
+        return cas(idX, idY).lca;
+    }
+    return multilevelLca(idX, idY);
+}
+
+LcaSnapshot::index LcaSnapshot::multilevelLca(index nodeX, index nodeY) const {
+    index x = nodeX;
+    index y = nodeY;
+    index subtreeX = multilevelNodes[x].twoSubtree;
+    index subtreeY = multilevelNodes[y].twoSubtree;
+
+    if (subtreeX != subtreeY) {
+        // Only full 2-subtrees have a summary node: otherwise move to the full parent
+        if (twoSubtrees[subtreeX].summary == NIL) {
+            x = multilevelNodes[twoSubtrees[subtreeX].root].parent;
+            subtreeX = multilevelNodes[x].twoSubtree;
+        }
+        if (twoSubtrees[subtreeY].summary == NIL) {
+            y = multilevelNodes[twoSubtrees[subtreeY].root].parent;
+            subtreeY = multilevelNodes[y].twoSubtree;
+        }
+
+        caTuple summaryCas = cas(twoSubtrees[subtreeX].summary, twoSubtrees[subtreeY].summary);
+        if (summaryCas.lca != summaryCas.ca_x) {
+            x = multilevelNodes[twoSubtrees[summaryOwners[summaryCas.ca_x]].root].parent;
+        }
+        if (summaryCas.lca != summaryCas.ca_y) {
+            y = multilevelNodes[twoSubtrees[summaryOwners[summaryCas.ca_y]].root].parent;
+        }
+    }
+
+    // LCA query on the 2-subtree
+    if (x == y) {
+        return x;
+    }
+    int msb = 63 - __builtin_clzll(multilevelNodes[x].ancestorWord & multilevelNodes[y].ancestorWord);
+    return twoSubtreeIds[twoSubtrees[multilevelNodes[x].twoSubtree].firstId + msb];
+}
+
+bool LcaSnapshot::inPath(index node, index apex) const {
+    // "parent" refers to compressed parent
+    return node == apex || (!fatNodes[node].isApex && fatNodes[node].parent == apex);
+}
+
+bool LcaSnapshot::isAncestorOf(index ancestor, index node) const {
+    return (fatNodes[ancestor].start <= fatNodes[node].start) && (fatNodes[node].start <= fatNodes[ancestor].end);
+}
+
+LcaSnapshot::caTuple LcaSnapshot::cas(index nodeX, index nodeY) const {
+    if (nodeX == nodeY) {
+        caTuple result = {nodeX, nodeX, nodeX};
+        return result;
+    }
+
+    caTuple compressedCas = casCompressed(nodeX, nodeY);
+
+    // Find LCA from compressed CAs
+    index b_x = inPath(compressedCas.ca_x, compressedCas.lca) ?
+                compressedCas.ca_x : fatNodes[compressedCas.ca_x].uncompressedParent;
+    index b_y = inPath(compressedCas.ca_y, compressedCas.lca) ?
+                compressedCas.ca_y : fatNodes[compressedCas.ca_y].uncompressedParent;
+    index lca = (fatNodes[b_x].uncompressedLevel < fatNodes[b_y].uncompressedLevel) ? b_x : b_y;
+
+    // Find CA_X and CA_Y from compressed CAs (see ExpensiveTreeNode::cas)
+    index ca_x;
+    if (lca != b_x) {
+        ca_x = fatNodes[lca].heavyChild;
+    } else if (lca != compressedCas.ca_x) {
+        ca_x = compressedCas.ca_x;
+    } else {
+        ca_x = nodeX;
+    }
+
+    index ca_y;
+    if (lca != b_y) {
+        ca_y = fatNodes[lca].heavyChild;
+    } else if (lca != compressedCas.ca_y) {
+        ca_y = compressedCas.ca_y;
+    } else {
+        ca_y = nodeY;
+    }
+
+    caTuple result = {lca, ca_x, ca_y};
+    return result;
+}
+
+// Implementation based on Fig. 2 of Gabow's paper (see ExpensiveTreeNode::casCompressed)
+LcaSnapshot::caTuple LcaSnapshot::casCompressed(index nodeX, index nodeY) const {
+    assert(nodeX != nodeY);
+
+    FatPreorder::Coord diff = FatPreorder::distance(fatNodes[nodeX].start, fatNodes[nodeY].start);
+    size_t i = FatPreorder::bucket(diff);
+    size_t tableWidth = header->tableWidth;
+
+    index v = (i < tableWidth) ? ancestors[(size_t) nodeX * tableWidth + i] : NIL;
+    index w = (v != NIL) ? fatNodes[v].parent : nodeX;
+
+    index b, b_x;
+    if (fatNodes[w].sizeWeight > diff) {
+        b = w;
+        b_x = (v != NIL) ? v : nodeX;
+    } else {
+        b = fatNodes[w].parent;
+        b_x = w;
+    }
+
+    index a_x = isAncestorOf(b, nodeY) ? b_x : b;
+
+    // Symetric computation to compute a_y
+    v = (i < tableWidth) ? ancestors[(size_t) nodeY * tableWidth + i] : NIL;
+    w = (v != NIL) ? fatNodes[v].parent : nodeY;
+
+    index b_y;
+    if (fatNodes[w].sizeWeight > diff) {
+        b = w;
+        b_y = (v != NIL) ? v : nodeY;
+    } else {
+        b = fatNodes[w].parent;
+        b_y = w;
+    }
+
+    index a, a_y;
+    if (isAncestorOf(b, nodeX)) {
+        a = b;
+        a_y = b_y;
+    } else {
+        a = fatNodes[b].parent;
+        a_y = b;
+    }
+
+    caTuple toReturn = {a, a_x, a_y};
+    return toReturn;
+}
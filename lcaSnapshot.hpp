@@ -0,0 +1,148 @@
+#ifndef LCASNAPSHOT_H
+#define LCASNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lcaTree.hpp"
+#include "lcaMultilevel.hpp"
+
+/*
+ * LcaSnapshot
+ * A pointer-free binary image of a preprocessed ExpensiveTreeNode or
+ * MultilevelTreeNode tree, which answers LCA queries directly from a
+ * read-only memory mapping of the file (no deserialization step).
+ *
+ * Nodes are addressed by their ids, so the ids of the saved tree must be
+ * exactly 0, ..., n - 1. The file holds a header followed by sections of
+ * fixed-size records, each aligned to 64 bytes:
+ *   - fat preordering: one FatNode per node of the (summary) tree, and its
+ *     ancestor tables, `tableWidth` indices per node
+ *   - multilevel trees only: one MultilevelNode per node, one TwoSubtree
+ *     per 2-subtree with its nodes in a flat id array, and the 2-subtree
+ *     owning each summary node
+ * Indices are 32 bits, with NIL standing for NULL, and fat preorder
+ * coordinates 128 bits (aligned to 16 bytes). The format is written
+ * in host byte order; `load` rejects files from a different byte order,
+ * version or record layout.
+ *
+ * Since the mapping is read-only and shared, any number of processes can
+ * load the same file and share its pages in the page cache.
+ */
+class LcaSnapshot {
+    public:
+        typedef uint32_t index;
+        static const index NIL = 0xFFFFFFFFu;
+        static const NodeId NO_NODE = -1;
+
+        static const uint32_t version = 2; // 2: 128-bit fat preorder coordinates
+        enum Kind {expensiveTree = 1, multilevelTree = 2};
+
+        struct Header {
+            char magic[8];          // "LCASNAP"
+            uint32_t version;
+            uint32_t byteOrder;     // 0x01020304 as written by the host
+            uint32_t kind;
+            uint32_t tableWidth;
+            uint32_t fatNodeSize;   // sizeof(FatNode), to detect layout changes
+            uint32_t multilevelNodeSize;
+            uint64_t numNodes;
+            uint64_t numFatNodes;   // equal to numNodes, or the number of summary nodes
+            uint64_t numTwoSubtrees;
+            uint64_t fatNodesOffset;
+            uint64_t ancestorsOffset;
+            uint64_t multilevelNodesOffset;
+            uint64_t twoSubtreesOffset;
+            uint64_t twoSubtreeIdsOffset;
+            uint64_t summaryOwnersOffset;
+            uint64_t fileSize;
+        };
+
+        /* Fields of ExpensiveTreeNode read by `cas` */
+        struct FatNode {
+            FatPreorder::Coord start;
+            FatPreorder::Coord end;
+            FatPreorder::Coord sizeWeight;
+            index parent;           // compressed parent
+            index uncompressedParent;
+            index heavyChild;
+            int32_t uncompressedLevel;
+            uint32_t isApex;
+        };
+
+        struct MultilevelNode {
+            unsigned long long ancestorWord;
+            index twoSubtree;       // 2-subtree containing the node
+            index parent;
+        };
+
+        struct TwoSubtree {
+            index root;
+            uint32_t size;
+            index summary;          // fat preordering index of its summary node, or NIL if not full
+            uint32_t firstId;       // its nodes (by integer) start at twoSubtreeIds[firstId]
+        };
+
+        /*
+         * Writes the tree (which must be preprocessed) with one sequential
+         * pass over the file. Returns false if the ids are not 0, ..., n - 1,
+         * or if the file cannot be written.
+         */
+        static bool save(ExpensiveTreeNode* root, const char* path);
+        static bool save(MultilevelTreeNode* root, const char* path);
+
+        LcaSnapshot();
+        ~LcaSnapshot();
+
+        /* Maps a snapshot read-only. Returns false if it is missing or invalid. */
+        bool load(const char* path);
+        void unload();
+
+        bool loaded() const {return header != NULL;}
+        Kind kind() const {return (Kind) header->kind;}
+        size_t numNodes() const {return header->numNodes;}
+
+        /* Computes the LCA of two nodes in O(1) time (NO_NODE if an id is out of range) */
+        NodeId lca(NodeId idX, NodeId idY) const;
+
+    private:
+        struct caTuple {
+            index lca;
+            index ca_x;
+            index ca_y;
+        };
+
+        const char* mapping;
+        size_t mappingSize;
+        const Header* header;
+
+        const FatNode* fatNodes;
+        const index* ancestors;
+        const MultilevelNode* multilevelNodes;
+        const TwoSubtree* twoSubtrees;
+        const index* twoSubtreeIds;
+        const index* summaryOwners;
+
+        LcaSnapshot(const LcaSnapshot&);
+        LcaSnapshot& operator=(const LcaSnapshot&);
+
+        /* Sections built in memory by `save`, then written out in order */
+        struct Image;
+        template <typename Node>
+        static bool packFatPreorder(Node* root, bool idsAreIndices, Image& image);
+
+        /* The id of a node, or -1 for a payload without one (as summary nodes) */
+        static NodeId payloadId(NodeId id) {return id;}
+        static NodeId payloadId(NoPayload) {return -1;}
+        static bool writeImage(Image& image, const char* path);
+
+        /* Same computation as ArenaTree::cas, on the mapped fat preordering */
+        caTuple cas(index nodeX, index nodeY) const;
+        caTuple casCompressed(index nodeX, index nodeY) const;
+        bool inPath(index node, index apex) const;
+        bool isAncestorOf(index ancestor, index node) const;
+
+        /* Same computation as MultilevelTreeNode::lca */
+        index multilevelLca(index nodeX, index nodeY) const;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "lcaStats.hpp"
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    std::atomic<uint64_t> recompressCounts[LcaStats::sizeBuckets];
+    std::atomic<uint64_t> filledTables(0);
+    std::atomic<uint64_t> fills(0);
+
+    std::mutex histogramLock;
+    LatencyHistogram walks;
+    LatencyHistogram latencies[LcaStats::numOperations];
+
+    const char* operationNames[LcaStats::numOperations] = {"expensive_add_leaf", "recompress", "multilevel_add_leaf"};
+
+    void writeSummary(std::ostringstream& out, const std::string& name, const std::string& labels,
+                      const LatencyHistogram& histogram) {
+        const double quantiles[] = {0.5, 0.99, 0.999};
+        std::string separator = labels.empty() ? "" : ",";
+        for (double q : quantiles) {
+            out << name << "{" << labels << separator << "quantile=\"" << q << "\"} "
+                << (histogram.count() ? histogram.percentile(q) : 0) << "\n";
+        }
+        std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        out << name << "_sum" << braces << " " << histogram.sumOfValues() << "\n";
+        out << name << "_count" << braces << " " << histogram.count() << "\n";
+    }
+}
+
+bool LcaStats::enabled() {
+#ifdef LCA_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LcaStats::recordRecompress(long long int subtreeSize) {
+    int bucket = std::min(sizeBuckets - 1, 63 - __builtin_clzll(std::max(1LL, subtreeSize)));
+    recompressCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LcaStats::recordFillAncestors(size_t numNodes) {
+    filledTables.fetch_add(numNodes, std::memory_order_relaxed);
+}
+
+void LcaStats::recordSizeWalk(int length) {
+    std::lock_guard<std::mutex> guard(histogramLock);
+    walks.record(length);
+}
+
+void LcaStats::recordTwoSubtreeFill() {
+    fills.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LcaStats::recordLatency(Operation operation, uint64_t ns) {
+    std::lock_guard<std::mutex> guard(histogramLock);
+    latencies[operation].record(ns);
+}
+
+uint64_t LcaStats::recompressions(int sizeLog2) {
+    return recompressCounts[sizeLog2].load(std::memory_order_relaxed);
+}
+
+uint64_t LcaStats::filledAncestorTables() {
+    return filledTables.load(std::memory_order_relaxed);
+}
+
+uint64_t LcaStats::twoSubtreeFills() {
+    return fills.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram LcaStats::sizeWalks() {
+    std::lock_guard<std::mutex> guard(histogramLock);
+    return walks;
+}
+
+LatencyHistogram LcaStats::latency(Operation operation) {
+    std::lock_guard<std::mutex> guard(histogramLock);
+    return latencies[operation];
+}
+
+std::string LcaStats::snapshot() {
+    std::ostringstream out;
+    out << "# HELP lca_stats_enabled Whether the instrumentation is compiled in (LCA_STATS)\n"
+        << "# TYPE lca_stats_enabled gauge\n"
+        << "lca_stats_enabled " << (enabled() ? 1 : 0) << "\n";
+
+    out << "# HELP lca_recompress_total Recompressions, by floor(log2) of the recompressed subtree size\n"
+        << "# TYPE lca_recompress_total counter\n";
+    for (int b = 0; b < sizeBuckets; ++b) {
+        out << "lca_recompress_total{size_log2=\"" << b << "\"} " << recompressions(b) << "\n";
+    }
+
+    out << "# HELP lca_filled_ancestor_tables_total Nodes whose ancestor table was refilled\n"
+        << "# TYPE lca_filled_ancestor_tables_total counter\n"
+        << "lca_filled_ancestor_tables_total " << filledAncestorTables() << "\n";
+
+    out << "# HELP lca_two_subtree_fills_total MultilevelTreeNode 2-subtrees that filled up\n"
+        << "# TYPE lca_two_subtree_fills_total counter\n"
+        << "lca_two_subtree_fills_total " << twoSubtreeFills() << "\n";
+
+    out << "# HELP lca_size_walk_length Nodes visited by add_leaf to update dynamicSubtreeSize\n"
+        << "# TYPE lca_size_walk_length summary\n";
+    writeSummary(out, "lca_size_walk_length", "", sizeWalks());
+
+    out << "# HELP lca_operation_latency_ns Latency of the dynamic operations in nanoseconds\n"
+        << "# TYPE lca_operation_latency_ns summary\n";
+    for (int op = 0; op < numOperations; ++op) {
+        writeSummary(out, "lca_operation_latency_ns", std::string("op=\"") + operationNames[op] + "\"",
+                     latency((Operation) op));
+    }
+    return out.str();
+}
+
+void LcaStats::reset() {
+    for (int b = 0; b < sizeBuckets; ++b) {
+        recompressCounts[b].store(0, std::memory_order_relaxed);
+    }
+    filledTables.store(0, std::memory_order_relaxed);
+    fills.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(histogramLock);
+    walks.clear();
+    for (int op = 0; op < numOperations; ++op) {
+        latencies[op].clear();
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef LCASTATS_H
+#define LCASTATS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ * Instrumentation of the dynamic operations, compiled in only when
+ * LCA_STATS is defined (`make STATS=1`). Otherwise LCA_STATS_ONLY drops its
+ * argument, so the operations contain no trace of it.
+ */
+#ifdef LCA_STATS
+#define LCA_STATS_ONLY(...) __VA_ARGS__
+#else
+#define LCA_STATS_ONLY(...)
+#endif
+
+/*
+ * Histogram of latencies in nanoseconds (or of any other non-negative
+ * integers). Values below 64 have a bucket each; above that, every power
+ * of two is split into 32 buckets (about 3% wide).
+ */
+class LatencyHistogram {
+    public:
+        LatencyHistogram() : counts(numBuckets, 0), total(0), sum(0), maxNs(0) {}
+
+        void record(uint64_t ns) {
+            counts[bucketOf(ns)] += 1;
+            total += 1;
+            sum += ns;
+            maxNs = std::max(maxNs, ns);
+        }
+
+        uint64_t count() const {return total;}
+        uint64_t sumOfValues() const {return sum;}
+        double mean() const {return total ? (double) sum / total : 0;}
+        uint64_t max() const {return maxNs;}
+
+        /* Midpoint of the bucket holding the p-th quantile (0 < p <= 1) */
+        uint64_t percentile(double p) const {
+            uint64_t target = (uint64_t) ceil(p * total);
+            uint64_t seen = 0;
+            for (int b = 0; b < numBuckets; ++b) {
+                seen += counts[b];
+                if (seen >= target && counts[b] > 0) {
+                    return std::min(maxNs, lowerBound(b) + (bucketWidth(b) - 1) / 2);
+                }
+            }
+            return maxNs;
+        }
+
+        void clear() {
+            std::fill(counts.begin(), counts.end(), 0);
+            total = sum = maxNs = 0;
+        }
+
+    private:
+        static const int linearLimit = 64;
+        static const int subBuckets = 32;
+        static const int numBuckets = linearLimit + (64 - 6) * subBuckets;
+
+        std::vector<uint64_t> counts;
+        uint64_t total;
+        uint64_t sum;
+        uint64_t maxNs;
+
+        static int bucketOf(uint64_t v) {
+            if (v < (uint64_t) linearLimit) {
+                return v;
+            }
+            int e = 63 - __builtin_clzll(v); // at least 6
+            return linearLimit + (e - 6) * subBuckets + ((v >> (e - 5)) & (subBuckets - 1));
+        }
+
+        static uint64_t lowerBound(int b) {
+            if (b < linearLimit) {
+                return b;
+            }
+            int e = (b - linearLimit) / subBuckets + 6;
+            return (uint64_t) (subBuckets + (b - linearLimit) % subBuckets) << (e - 5);
+        }
+
+        static uint64_t bucketWidth(int b) {
+            return (b < linearLimit) ? 1 : (uint64_t) 1 << ((b - linearLimit) / subBuckets + 1);
+        }
+};
+
+/*
+ * LcaStats
+ * Process-wide counters for ExpensiveTreeNode and MultilevelTreeNode:
+ *   - recompressions, by log2 of the size of the recompressed subtree
+ *   - nodes whose ancestor tables were refilled
+ *   - the length of the `dynamicSubtreeSize` walk in each add_leaf
+ *   - 2-subtrees of a MultilevelTreeNode tree that filled up
+ *   - latencies of add_leaf and of recompress (including the refill of
+ *     the ancestor tables); ExpensiveTreeNode::add_leaf also counts the
+ *     summary-tree insertions made by MultilevelTreeNode::add_leaf
+ * Counters are atomic and histograms are behind a lock, so `snapshot` can
+ * be called from any thread while the trees are updated.
+ */
+class LcaStats {
+    public:
+        enum Operation {expensiveAddLeaf, recompress, multilevelAddLeaf, numOperations};
+        static const int sizeBuckets = 32;
+
+        /* Whether the instrumentation was compiled in */
+        static bool enabled();
+
+        static uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /* Recording, called by the trees */
+        static void recordRecompress(long long int subtreeSize);
+        static void recordFillAncestors(size_t numNodes);
+        static void recordSizeWalk(int length);
+        static void recordTwoSubtreeFill();
+        static void recordLatency(Operation operation, uint64_t ns);
+
+        /* Reading */
+        static uint64_t recompressions(int sizeLog2);
+        static uint64_t filledAncestorTables();
+        static uint64_t twoSubtreeFills();
+        static LatencyHistogram sizeWalks();
+        static LatencyHistogram latency(Operation operation);
+
+        /*
+         * All counters in the Prometheus text exposition format, ready to be
+         * served on a /metrics endpoint. Histograms are exported as summaries
+         * with the 0.5, 0.99 and 0.999 quantiles.
+         */
+        static std::string snapshot();
+
+        static void reset();
+};
+
+#endif
@@ -1,13 +1,99 @@
 #ifndef LCATREE_H
 #define LCATREE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <list>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "fatPreorder.hpp"
+
+template <typename Word, typename Payload> class BasicMultilevelTreeNode;
+class TaskScheduler;
+class TaskGroup;
+
+/*
+ * The trees are templates over a payload stored inline in each node, by
+ * default a NodeId: an integer that identifies the node, so that richer
+ * per-node data can be kept by the caller in an array indexed by it.
+ * Any copyable type can be the payload: the definitions are in lcaTree.tpp,
+ * which this header includes.
+ */
+typedef long long int NodeId;
+
+/* A payload of no data, for nodes that need none (as summary nodes) */
+struct NoPayload {};
+
+/*
+ * Storage of a node's payload, read with `payload()`. The trees derive from
+ * it, so an empty payload type is an empty base class, which takes no space
+ * in the node (as [[no_unique_address]] would, past C++11).
+ */
+template <typename Payload, bool isEmpty = std::is_empty<Payload>::value>
+class PayloadHolder {
+    public:
+        PayloadHolder() : value() {}
+        explicit PayloadHolder(const Payload& payload) : value(payload) {}
+
+        Payload& payload() {return value;}
+        const Payload& payload() const {return value;}
+
+    private:
+        Payload value;
+};
+
+template <typename Payload>
+class PayloadHolder<Payload, true> : private Payload {
+    public:
+        PayloadHolder() {}
+        explicit PayloadHolder(const Payload& payload) : Payload(payload) {}
 
-class MultilevelTreeNode;
+        Payload& payload() {return *this;}
+        const Payload& payload() const {return *this;}
+};
+
+/* How a node is printed: its id, or its address for other payloads */
+inline std::string payloadString(NodeId id, const void*) {
+    return std::to_string(id);
+}
+
+template <typename Payload>
+std::string payloadString(const Payload&, const void* node) {
+    char address[32];
+    snprintf(address, sizeof(address), "%p", node);
+    return address;
+}
+
+/*
+ * Bytes used by a tree, by component, as reported by `memoryUsage`.
+ * Sizes are what the data structures request from the allocator;
+ * `allocations` counts the separate heap blocks, each of which also
+ * costs the allocator's per-block overhead (16 bytes or so with glibc).
+ */
+struct MemoryUsage {
+    size_t numNodes;
+    size_t nodes;           // the node objects themselves
+    size_t childLists;      // std::list nodes of the uncompressed and compressed child lists
+    size_t ancestorTables;  // ancestor tables (allocated capacity)
+    size_t subtreeIndex;    // 2-subtree blocks (MultilevelTreeNode only)
+    size_t summaryNodes;    // the whole summary tree (MultilevelTreeNode only)
+    size_t allocations;
+
+    size_t total() const {return nodes + childLists + ancestorTables + subtreeIndex + summaryNodes;}
+    double perNode() const {return numNodes ? (double) total() / numNodes : 0;}
+};
 
-class ExpensiveTreeNode {
+/*
+ * BasicExpensiveTreeNode
+ * Gabow's fat preordering on the heavy-light compressed tree, with a
+ * `Payload` in each node. ExpensiveTreeNode is the version with a NodeId.
+ */
+template <typename Payload = NodeId>
+class BasicExpensiveTreeNode : public PayloadHolder<Payload> {
      public:
         /*
          * Tuple to store "Characteristic Ancestors":
@@ -16,41 +102,46 @@ class ExpensiveTreeNode {
          * "ca_y" = the child of the LCA that is an ancestor of Y
          */
         struct caTuple {
-            ExpensiveTreeNode* lca;
-            ExpensiveTreeNode* ca_x;
-            ExpensiveTreeNode* ca_y;
+            BasicExpensiveTreeNode* lca;
+            BasicExpensiveTreeNode* ca_x;
+            BasicExpensiveTreeNode* ca_y;
         };
 
         /* Parameters for the fat preordering proposed by Gabow */
-        static constexpr float beta = 10.0/7.0;
-        static const int e = 4;
-        static const int c = 5;
-        static constexpr float alpha = 6.0/5.0;
+        static constexpr float beta = FatPreorder::beta;
+        static const int e = FatPreorder::e;
+        static const int c = FatPreorder::c;
+        static constexpr float alpha = FatPreorder::alpha;
 
         /* Maintain uncompressed tree */
-        std::string nodeId;
-        std::list<ExpensiveTreeNode*> uncompressedChildren;
-        ExpensiveTreeNode* uncompressedParent;
+        std::list<BasicExpensiveTreeNode*> uncompressedChildren;
+        BasicExpensiveTreeNode* uncompressedParent;
         int uncompressedLevel;
 
-        /* Indirection */
-        MultilevelTreeNode* associatedTwoSubtree;
+        /*
+         * Indirection: the root of the 2-subtree this summary node stands for,
+         * a BasicMultilevelTreeNode of whichever word width built the tree
+         */
+        void* associatedTwoSubtree;
 
         /*-------------------------------------*/
         /*        Basic Tree Operations        */
         /*-------------------------------------*/
 
         /* Creates a new node without initializing any variables */
-        ExpensiveTreeNode();
+        BasicExpensiveTreeNode();
 
-        /* Creates a new node with the given ID */
-        ExpensiveTreeNode(std::string id);
+        /* Creates a new node with the given payload (its ID by default) */
+        BasicExpensiveTreeNode(const Payload& payload);
 
         /*
-         * Creates a new node with the given ID,
+         * Creates a new node with the given payload,
          * associated with the given node (indirection)
          */
-        ExpensiveTreeNode(std::string id, MultilevelTreeNode* twoSubtree);
+        BasicExpensiveTreeNode(const Payload& payload, void* twoSubtree);
+
+        /* Frees the ancestor tables of the tree if the node is its root */
+        ~BasicExpensiveTreeNode();
 
         /* Prints the uncompressed tree */
         void print();
@@ -66,7 +157,7 @@ class ExpensiveTreeNode {
          * This method can be used in conjunction with `preprocess`
          *   to construct static trees in O(n \log n) time and space.
          */
-        void addLeafNoPreprocessing(ExpensiveTreeNode* child);
+        void addLeafNoPreprocessing(BasicExpensiveTreeNode* child);
 
         /*
          * Removes the node from its tree and frees any memory associated
@@ -74,62 +165,228 @@ class ExpensiveTreeNode {
          */
         void deleteNode();
 
+        /* Reports the memory used by the subtree of this node, in O(n) time */
+        MemoryUsage memoryUsage();
+
         /*-------------------------------------*/
         /*            LCA Operations           */
         /*-------------------------------------*/        
         
-        /* Preprocesses a tree to be ready for LCA queries */
-        void preprocess();
+        /*
+         * Preprocesses a tree to be ready for LCA queries.
+         *
+         * A tree holds at most FatPreorder::maxSize nodes (about 2^31), past
+         * which its fat preorder coordinates would overflow: preprocess,
+         * add_leaf, add_leaves and link return false rather than build a
+         * tree that large. The tree is then left as it was (preprocess
+         * leaves it unpreprocessed), and the nodes that were to join it are
+         * left unattached.
+         */
+        bool preprocess();
+
+        /*
+         * Runs `preprocess`, and `recompress` on subtrees of at least
+         * `parallelGrain` nodes, on the given scheduler (NULL to run
+         * sequentially). Child subtrees of at least `parallelGrain` nodes are
+         * forked as separate tasks. The result is identical to the
+         * sequential passes. The scheduler is shared by the trees of every
+         * payload type.
+         */
+        static void setScheduler(TaskScheduler* taskScheduler);
+        static const int parallelGrain = 4096;
 
         /*
          * Adds a given node as a child, maintaining the fat preordering
          * This operation has an amortized O(\log^2 n) runtime.
          */
-        void add_leaf(ExpensiveTreeNode* leaf);
+        bool add_leaf(BasicExpensiveTreeNode* leaf);
 
-        /* Computes the LCA of two nodes in O(1) time */
-        static ExpensiveTreeNode* lca(ExpensiveTreeNode* nodeA, ExpensiveTreeNode* nodeB);
+        /*
+         * Makes `otherRoot`, the root of another (preprocessed) tree, a child
+         * of this node. As in Gabow's link, only the smaller of the two trees
+         * is relabelled, with the amortized cost of the recompressions that
+         * s new leaves would have caused, for a smaller tree of s nodes:
+         *   - a smaller `otherRoot` tree is recompressed together with the
+         *     part of this tree that add_leaf would have recompressed;
+         *   - a larger one keeps its intervals and ancestor tables. The root
+         *     of this tree takes over those of `otherRoot`, whose heavy path
+         *     it now heads, and the nodes of this tree are relabelled in the
+         *     room left in that interval, as new leaves of it would be (the
+         *     whole tree is recompressed instead when they do not fit).
+         * Either way the nodes of the attached tree get their root, depth and
+         * jump pointer in one O(1) step each, and the compressed children of
+         * a larger `otherRoot` move to the new root.
+         */
+        bool link(BasicExpensiveTreeNode* otherRoot);
+
+        /*
+         * Adds n leaves at once: batch[k].second becomes a child of
+         * batch[k].first, which is either a node of a preprocessed tree or
+         * a leaf earlier in the batch. All the leaves are attached first;
+         * then the maximal subtrees that they broke are found once, and each
+         * is recompressed once, instead of after every leaf.
+         */
+        static bool add_leaves(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* batch, size_t n);
 
-        /* Computes the characteristic ancestors of two nodes in O(1) time */
-        static caTuple cas(ExpensiveTreeNode* nodeA, ExpensiveTreeNode* nodeB);
+        /*
+         * Computes the LCA of two nodes in O(1) time.
+         * Nodes of different trees (a forest) have no LCA: the result is NULL.
+         */
+        static BasicExpensiveTreeNode* lca(BasicExpensiveTreeNode* nodeA, BasicExpensiveTreeNode* nodeB);
+
+        /*
+         * Computes the characteristic ancestors of two nodes in O(1) time
+         * (all NULL for nodes of different trees)
+         */
+        static caTuple cas(BasicExpensiveTreeNode* nodeA, BasicExpensiveTreeNode* nodeB);
+
+        /*
+         * Answers `n` queries at once, writing the i-th answer to results[i].
+         * Queries are processed in groups of `batchGroupSize`: each group is
+         * walked stage by stage, prefetching the nodes and ancestor table
+         * entries of every query before any of them is dereferenced, so that
+         * the cache misses of different queries overlap.
+         */
+        static const int batchGroupSize = 16;
+        static void lcaBatch(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* queries,
+                             BasicExpensiveTreeNode** results, size_t n);
+        static void casBatch(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* queries,
+                             caTuple* results, size_t n);
                 
         /* Computes LCA in O(n) time */
-        static ExpensiveTreeNode* naiveLca(ExpensiveTreeNode* nodeX, ExpensiveTreeNode* nodeY);
+        static BasicExpensiveTreeNode* naiveLca(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY);
 
         /* Computes characteristic ancestors in O(n) time */
-        static caTuple naiveCas(ExpensiveTreeNode* nodeA, ExpensiveTreeNode* nodeB);
+        static caTuple naiveCas(BasicExpensiveTreeNode* nodeA, BasicExpensiveTreeNode* nodeB);
+
+        /*-------------------------------------*/
+        /*     Depths and Level Ancestors      */
+        /*-------------------------------------*/
+
+        /* Number of edges from the root of the tree, in O(1) time */
+        int depth() const {return uncompressedLevel;}
+
+        /*
+         * Number of edges on the path between two nodes, in O(1) time
+         * (-1 for nodes of different trees)
+         */
+        static int distance(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY);
+
+        /*
+         * The ancestor k levels above a node (the node itself for k = 0), or
+         * NULL if k is negative or larger than its depth, in O(log n) time
+         */
+        static BasicExpensiveTreeNode* levelAncestor(BasicExpensiveTreeNode* node, int k);
 
                 
     private:
+        friend class LcaSnapshot;
+        template <typename Word, typename MultilevelPayload> friend class BasicMultilevelTreeNode;
+
         void print(int level);
-        void init(std::string id);
+        void init();
 
         // Maintain compressed tree
-        std::list<ExpensiveTreeNode*> children;
-        ExpensiveTreeNode* parent;
-        ExpensiveTreeNode* root; // Mantain the root to determine number of nodes in the tree (to determine size of ancestor tables)
+        std::list<BasicExpensiveTreeNode*> children;
+        BasicExpensiveTreeNode* parent;
+
+        /*
+         * Where the node sits in the child lists of its compressed and
+         * uncompressed parents, so that deleteNode unlinks it in O(1) time
+         * instead of searching the lists (splicing keeps them valid)
+         */
+        typedef typename std::list<BasicExpensiveTreeNode*>::iterator ChildPosition;
+        ChildPosition compressedPosition;
+        ChildPosition uncompressedPosition;
+        BasicExpensiveTreeNode* root; // Mantain the root to determine number of nodes in the tree (to determine size of ancestor tables)
+
+        /*
+         * Jump pointer in the uncompressed tree (Myers' skew-binary scheme):
+         * an ancestor set from the parent's in O(1) time when the node joins
+         * the tree, such that any ancestor is reached in O(log n) steps that
+         * each follow either `jump` or `uncompressedParent`
+         */
+        BasicExpensiveTreeNode* jump;
 
         bool isApex;
-        ExpensiveTreeNode* heavyChild;
+        BasicExpensiveTreeNode* heavyChild;
         
         // Maintain fat preordering
-        long long int start;
-        long long int end; // `end` is the last integer in the interval (inclusive)
-        long long int startBuffered;
-        long long int endBuffered;
+        FatPreorder::Coord start;
+        FatPreorder::Coord end; // `end` is the last integer in the interval (inclusive)
+        FatPreorder::Coord startBuffered;
+        FatPreorder::Coord endBuffered;
 
-        int subtreeSize; // (old) subtreeSize used by current fat preordering
-        int dynamicSubtreeSize; // (updated) subtreeSize updated dynamically
-        long long int largestChildEndBuffer;
+        long long int subtreeSize; // (old) subtreeSize used by current fat preordering
+        FatPreorder::Coord sizeWeight; // (c - 2) * subtreeSize^e, cached for queries
+        long long int dynamicSubtreeSize; // (updated) subtreeSize updated dynamically
+        FatPreorder::Coord largestChildEndBuffer;
 
-        // Support LCA queries
-        std::vector<ExpensiveTreeNode*> ancestors; //ancestor table
+        /*
+         * Ancestor tables, run-compressed in one pool per tree.
+         *
+         * Entry i of a node's table is the highest ancestor u with
+         * sizeWeight(u) < beta^i, so each ancestor u holds the consecutive
+         * entries [firstBucketAbove(u), firstBucketAbove(parent of u)), and
+         * the root holds every entry from its first one on. A table is then
+         * stored as one run per ancestor that holds any entry: a 256-bit
+         * bitmap of the entries where the runs start, the number of bits set
+         * below each of its 64-bit words (one byte each), and the pool index
+         * of each run's ancestor after a leading 0 (the index of NULL).
+         * Entry i is then the run whose rank is the number of bits set up to
+         * i, found with one popcount.
+         *
+         * A node's runs are at most its compressed depth plus one, which
+         * bounds the slot it gets in the pool; since the root's run never
+         * ends, tables do not depend on the size of the tree and never need
+         * to grow as it does.
+         */
+        struct AncestorPool {
+            std::vector<BasicExpensiveTreeNode*> nodes; // by pool index, NULL if free (and at 0)
+            std::vector<uint32_t> freeIndices;
+            std::vector<uint32_t> words;           // the slots of all tables
+            std::vector<uint32_t> spareWords;      // where `words` is compacted to
+            size_t liveWords;                      // words in slots still in use
+        };
+        static const uint32_t noSlot = 0xFFFFFFFFu;
+        static const int bitmapWords = FatPreorder::maxBuckets / 32; // four 64-bit words
+        static const int slotHeader = bitmapWords + 2; // up to the first run
+
+        uint32_t poolIndex;         // index of this node in the pool
+        uint32_t tableOffset;       // start of its slot in `words`, or noSlot
+        uint32_t tableCapacity;     // number of runs the slot can hold
+        AncestorPool* ancestorPool; // owned by the root (NULL elsewhere)
         bool isPreprocessed;
 
+        /* Entry i of the ancestor table, in O(1) time */
+        BasicExpensiveTreeNode* ancestorAt(int i) const {return *ancestorEntry(i);}
+
+        /* Where entry i is held in the pool */
+        inline BasicExpensiveTreeNode* const* ancestorEntry(int i) const;
+
+        /* Bits set in x (a single instruction where the target has one) */
+        static int popcount(uint64_t x) {
+#ifdef __POPCNT__
+            return __builtin_popcountll(x);
+#else
+            x -= (x >> 1) & 0x5555555555555555ULL;
+            x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+            x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+            return (x * 0x0101010101010101ULL) >> 56;
+#endif
+        }
+
         /*-------------------------------------------*/
         /*   Methods for Generating Compressed Tree  */
         /*-------------------------------------------*/
 
+        /*
+         * Fills `order` with the uncompressed (or compressed) subtree in
+         * preorder. The passes below iterate over this array instead of
+         * recursing, so very deep trees cannot overflow the stack.
+         */
+        void collectPreorder(std::vector<BasicExpensiveTreeNode*>& order, bool useCompressed);
+
         /* Sets `uncompressedLevel` for each node in the subtree */
         void assignLevels(int level);
 
@@ -137,7 +394,7 @@ class ExpensiveTreeNode {
          * Sets `subtreeSize` to the subtree size in either the
          * compressed or uncompressed tree
          */
-        int assignSubtreeSizes(bool useCompressed); //Returns size of tree
+        long long int assignSubtreeSizes(bool useCompressed); //Returns size of tree
 
         /*
          * Sets `isApex` field of all nodes (based on subtreeSize),
@@ -157,14 +414,26 @@ class ExpensiveTreeNode {
         void compressTree(bool isRoot = false);
 
         /* Checks if the node is the heavy path with that starting at `apex`*/
-        bool inPath(ExpensiveTreeNode* apex);
+        bool inPath(BasicExpensiveTreeNode* apex);
 
         /* Sets the `root` field of all nodes to equal to the input */
-        void assignRoot(ExpensiveTreeNode* node);
+        void assignRoot(BasicExpensiveTreeNode* rootNode);
 
         /* Sets a flag for all nodes indicating preprocessing is complete */
         void setPreprocessedFlag();
 
+        /* Sets `jump` from the uncompressed parent's (whose own must be set) */
+        void assignJump();
+
+        /*
+         * The highest ancestor u of this node for which `holds(u)`, given a
+         * predicate that holds on this node and on some prefix of its path
+         * to the root (a node's depth being at least a bound, for one), in
+         * O(log n) evaluations
+         */
+        template <typename Predicate>
+        BasicExpensiveTreeNode* highestAncestorWhere(const Predicate& holds);
+
 
         /*-------------------------------------------*/
         /*   Methods for Generating Fat Preordering  */
@@ -179,20 +448,49 @@ class ExpensiveTreeNode {
          */
         void contAssignIntervals();
 
-        /* Fills all ancestor tables */
-        void fillAllAncestors();
+        /*
+         * Sets `start` and `end` from the buffered interval, and the
+         * buffered intervals of the compressed children
+         */
+        void assignOwnInterval();
 
-        /* Updates the ancestor table of the current node */
-        void fillAncestorTable();
+        /*
+         * Fills the ancestor tables of the compressed subtree, each from the
+         * table of its parent. `rebuild` renumbers the pool from scratch when
+         * the subtree is the whole tree (preprocess); recompressions keep the
+         * slots of the nodes and only replace those their tables outgrew.
+         */
+        void fillAllAncestors(bool rebuild);
+
+        /*
+         * Fills `order` with the compressed subtree in preorder, and gives
+         * each node of it a pool index and a slot large enough for its table
+         */
+        void prepareAncestorTables(std::vector<BasicExpensiveTreeNode*>& order, bool rebuild);
+
+        /* Moves all live slots to the front of the pool */
+        static void compactAncestorPool(AncestorPool* pool);
+
+        /* Returns the pool index and the slot of the node to the pool */
+        void releaseAncestorTable(AncestorPool* pool);
+
+        /*
+         * Updates the ancestor table of the current node (its slot must be
+         * prepared). With `parentIsFilled`, the table of its compressed parent
+         * is up to date and is extended by this node's run, in time linear in
+         * the size of the table; otherwise the runs are found by walking up
+         * the compressed path.
+         */
+        void fillAncestorTable(bool parentIsFilled);
 
         /*-------------------------------------------*/
         /*       Helper Methods for LCA Queries      */
         /*-------------------------------------------*/
 
         /* Computes characteristic ancestors in compressed tree in O(1) time */
-        static caTuple casCompressed(ExpensiveTreeNode* nodeX, ExpensiveTreeNode* nodeY);
+        static caTuple casCompressed(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY);
 
-        bool isAncestorOf(ExpensiveTreeNode* node);
+        bool isAncestorOf(BasicExpensiveTreeNode* node);
 
         /*-------------------------------------------*/
         /*   Helper Methods for Dynamic Operations   */
@@ -211,14 +509,114 @@ class ExpensiveTreeNode {
          */
         void recompress();
 
+        /* recompress, then fill the ancestor tables of the subtree again */
+        void recompressAndFill();
+
+        /*
+         * Adds the tree of `otherRoot` below this node in the uncompressed
+         * tree, and gives its nodes the root and depths of this tree (in
+         * `order`, in preorder)
+         */
+        void attachTree(BasicExpensiveTreeNode* otherRoot, std::vector<BasicExpensiveTreeNode*>& order);
+
+        /*
+         * link for an `otherRoot` whose tree is larger than this one, which
+         * is then the only one relabelled (see link). Returns false, changing
+         * nothing, if the nodes of this tree do not fit in the interval of
+         * `otherRoot` or would make it broken.
+         */
+        bool linkLarger(BasicExpensiveTreeNode* otherRoot);
+
+        /*
+         * The node to recompress once nodes were added below this one (an
+         * apex whose `dynamicSubtreeSize` counts them): going up while the
+         * parent is broken, or while the interval of the node would overflow
+         * the buffer of its parent
+         */
+        BasicExpensiveTreeNode* highestBrokenAncestor();
+
+        /*-------------------------------------------*/
+        /*      Parallel Versions of the Passes      */
+        /*-------------------------------------------*/
+
+        /*
+         * Each pass produces exactly what its sequential counterpart does.
+         * Subtree sizes are computed bottom-up, forking child subtrees in
+         * the top levels only: when sizes are not known yet (`sizesKnown` is
+         * false), non-leaf children in the top `parallelForkDepth` levels,
+         * otherwise (recompress) children whose subtree in the previous
+         * compressed tree had at least `parallelGrain` nodes, in the top
+         * `parallelMaxNesting` levels: a guess, as the compressed subtree of
+         * a heavy child is the child alone. Deeper subtrees use the
+         * sequential pass.
+         */
+        static const int parallelForkDepth = 6;
+        static const int parallelMaxNesting = 32;
+        long long int parallelSubtreeSizes(bool sizesKnown, int depth);
+
+        /* assignApex, plus assignLevels and assignRoot when `withLevels` is set */
+        void parallelApex(bool withLevels, BasicExpensiveTreeNode* rootNode);
+
+        /*
+         * compressTree followed by assignSubtreeSizes(true): each apex
+         * collects its compressed children from its heavy path
+         */
+        void parallelCompressTree();
+        void collectCompressedChildren();
+
+        void parallelContAssignIntervals();
+
+        /*
+         * fillAllAncestors followed by setPreprocessedFlag: the tables are
+         * filled in chunks of `parallelGrain` nodes of the preorder
+         */
+        void parallelFillAllAncestors(bool rebuild);
+
+        /*
+         * Calls `visit` on every node of the subtree, parents before their
+         * children, with an explicit stack. Children of at least
+         * `parallelGrain` nodes that have siblings are forked into `group`
+         * as new traversals, which never wait on each other.
+         */
+        template <typename Visit>
+        void parallelPreorder(TaskGroup& group, bool useCompressed, const Visit& visit);
+
 };
 
+template <typename Payload>
+inline BasicExpensiveTreeNode<Payload>* const* BasicExpensiveTreeNode<Payload>::ancestorEntry(int i) const {
+    const AncestorPool* pool = root->ancestorPool;
+    const uint32_t* slot = pool->words.data() + tableOffset;
+    int word = i / 64;
+    uint64_t bits;
+    memcpy(&bits, slot + 2 * word, sizeof(bits));
+
+    uint32_t rank = ((slot[bitmapWords] >> (8 * word)) & 0xFF) + popcount(bits & (~0ULL >> (63 - i % 64)));
+    return &pool->nodes[slot[bitmapWords + 1 + rank]];
+}
+
+template <typename Payload>
+template <typename Predicate>
+BasicExpensiveTreeNode<Payload>* BasicExpensiveTreeNode<Payload>::highestAncestorWhere(const Predicate& holds) {
+    // A jump never passes the answer, as `holds` fails above it; this takes
+    // the same steps as the search for the answer's depth
+    BasicExpensiveTreeNode* node = this;
+    while (node->uncompressedParent && holds(node->uncompressedParent)) {
+        node = holds(node->jump) ? node->jump : node->uncompressedParent;
+    }
+    return node;
+}
+
+typedef BasicExpensiveTreeNode<> ExpensiveTreeNode;
+
 /* A thin wrapper of ExpensiveTreeNode */
 class ExpensiveTree {
     public:
         ExpensiveTreeNode* root;
 
-        ExpensiveTree(std::string rootId);
+        ExpensiveTree(NodeId rootId);
 };
 
+#include "lcaTree.tpp"
+
 #endif
\ No newline at end of file
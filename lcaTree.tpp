@@ -0,0 +1,1555 @@
+/*
+ * Definitions of BasicExpensiveTreeNode, included by lcaTree.hpp so that
+ * the tree can be instantiated for any payload type
+ */
+#include "taskScheduler.hpp"
+#include "lcaStats.hpp"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iterator>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+
+///////////////////////////////////////////
+//////         Helper Methods       ///////
+///////////////////////////////////////////
+
+template <typename Node>
+std::string getId(Node* node) {
+    if (node) {return payloadString(node->payload(), node);}
+    else {return "NULL";}
+}
+
+// Stops before a tree of more than FatPreorder::maxSize nodes overflows its
+// coordinates (defined in lcaTree.cpp)
+
+template <typename Node>
+std::string strAncestorTable(const std::vector<Node*>& ancestors) {
+    std::string result = "[";
+    for (size_t i = 0; i < ancestors.size(); ++i)
+    {
+        result = result + getId(ancestors[i]) + ", ";
+    }
+    result = result + "]";
+    return(result);
+}
+
+
+///////////////////////////////////////////
+////////    LCA for Static Trees    ///////
+///////////////////////////////////////////
+
+///////////////////
+// Preprocessing //
+///////////////////
+
+
+// The scheduler of the parallel passes, shared by the trees of every
+// payload type (see setScheduler; defined in lcaTree.cpp)
+extern TaskScheduler* lcaTreeScheduler;
+
+// Scratch space of the sequential passes, for each node type. It keeps its
+// capacity from one recompression to the next, so that a steady-state
+// add_leaf does not allocate. Each thread running the passes has its own.
+template <typename Node>
+struct ExpensiveTreeScratch {
+    static thread_local std::vector<Node*> preorder;
+    static thread_local std::vector<Node*> stack;
+    static thread_local std::vector<std::pair<Node*, int> > depthStack;
+    static thread_local std::list<Node*> spareListNodes; // emptied by compressTree
+};
+template <typename Node> thread_local std::vector<Node*> ExpensiveTreeScratch<Node>::preorder;
+template <typename Node> thread_local std::vector<Node*> ExpensiveTreeScratch<Node>::stack;
+template <typename Node> thread_local std::vector<std::pair<Node*, int> > ExpensiveTreeScratch<Node>::depthStack;
+template <typename Node> thread_local std::list<Node*> ExpensiveTreeScratch<Node>::spareListNodes;
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::setScheduler(TaskScheduler* taskScheduler) {
+    lcaTreeScheduler = taskScheduler;
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::preprocess() {
+    if (lcaTreeScheduler) {
+        if (parallelSubtreeSizes(false, 0) > FatPreorder::maxSize) {
+            return false;
+        }
+        parallelApex(true, this);
+
+        parallelCompressTree(); // also sets the compressed subtree sizes
+
+        startBuffered = 0;
+        endBuffered = FatPreorder::intervalLength(subtreeSize);
+        parallelContAssignIntervals();
+        parallelFillAllAncestors(true);
+        return true;
+    }
+
+    // Subtree sizes based on uncompressed values
+    if (assignSubtreeSizes(false) > FatPreorder::maxSize) {
+        return false;
+    }
+    assignApex(true);
+    assignLevels(0);
+    assignRoot(this);
+
+    compressTree(true);
+    assignSubtreeSizes(true); // Subtree sizes based on compressed values
+    
+    assignIntervals();
+    fillAllAncestors(true);
+    setPreprocessedFlag();
+    return true;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::recompress() {
+    bool parallel = lcaTreeScheduler && dynamicSubtreeSize >= parallelGrain;
+    if (parallel) {
+        parallelSubtreeSizes(true, 0);
+        parallelApex(false, root); // Treat the current node as the "root"
+
+        parallelCompressTree();
+    } else {
+        assignSubtreeSizes(false);
+        assignApex(true); // Treat the current node as the "root"
+
+        compressTree(true);
+        assignSubtreeSizes(true);
+    }
+
+    if (parent) {
+        // assign this buffered interval <- [Q(u), Q(u) + cs(v)^e]
+        startBuffered = parent->largestChildEndBuffer;
+        endBuffered = parent->largestChildEndBuffer +
+                      FatPreorder::intervalLength(subtreeSize);
+        parent->largestChildEndBuffer = endBuffered;
+    } else {
+        startBuffered = 0;
+        endBuffered = FatPreorder::intervalLength(subtreeSize);
+    }
+
+    // assign fat preordering to children
+    if (parallel) {
+        parallelContAssignIntervals();
+    } else {
+        contAssignIntervals();
+    }
+}
+
+// Passes visit the nodes of a preorder array instead of recursing, so that
+// their stack usage does not depend on the depth of the tree
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::collectPreorder(std::vector<BasicExpensiveTreeNode*>& order, bool useCompressed) {
+    order.clear();
+    std::vector<BasicExpensiveTreeNode*>& stack = ExpensiveTreeScratch<BasicExpensiveTreeNode>::stack;
+    stack.assign(1, this);
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+
+        // Push in reverse so that children are visited in list order
+        std::list<BasicExpensiveTreeNode*>& childrenList = useCompressed ? node->children : node->uncompressedChildren;
+        for (auto it = childrenList.rbegin(); it != childrenList.rend(); ++it) {
+            stack.push_back(*it);
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::setPreprocessedFlag() {
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, true);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->isPreprocessed = true;
+    }
+}
+
+template <typename Payload>
+long long int BasicExpensiveTreeNode<Payload>::assignSubtreeSizes(bool useCompressed) {
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, useCompressed);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->subtreeSize = 1;
+    }
+
+    // Children appear after their parents, so a reverse sweep finishes
+    // every subtree before adding it to its parent
+    for (size_t i = order.size(); i-- > 0;) {
+        BasicExpensiveTreeNode* node = order[i];
+        node->dynamicSubtreeSize = node->subtreeSize;
+        node->sizeWeight = FatPreorder::weight(node->subtreeSize);
+        if (i > 0) {
+            BasicExpensiveTreeNode* up = useCompressed ? node->parent : node->uncompressedParent;
+            up->subtreeSize += node->subtreeSize;
+        }
+    }
+    return subtreeSize;
+}
+
+// A node is apex if it is not a heavy child
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignApex(bool isRoot) {
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, false);
+    for (BasicExpensiveTreeNode* node : order) {
+        // Assign apex based on subtreeSize
+        if (node == this && isRoot) {
+            node->isApex = true;
+        } else {
+            node->isApex = (node->subtreeSize * 2 <= node->uncompressedParent->subtreeSize);
+        }
+
+        // Update parent's heavyChild pointer if necessary
+        if (!node->isApex) {
+            node->uncompressedParent->heavyChild = node;
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignRoot(BasicExpensiveTreeNode* rootNode) {
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, true);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->root = rootNode;
+    }
+}
+
+// uncompressedParent and uncompressedChildren and uncompressedLevel remain unchanged
+// "parent", "children", and "subtreeSize" now refer to the compressed tree
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::compressTree(bool isRoot){
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    std::list<BasicExpensiveTreeNode*>& spareListNodes = ExpensiveTreeScratch<BasicExpensiveTreeNode>::spareListNodes;
+    collectPreorder(order, false);
+
+    // Every node of the subtree but the top one is in exactly one compressed
+    // child list, before and after: the list nodes are taken out of the old
+    // lists and relinked into the new ones instead of being reallocated
+    for (BasicExpensiveTreeNode* node : order) {
+        spareListNodes.splice(spareListNodes.end(), node->children);
+    }
+
+    // A node's new compressed parent is visited before the node
+    for (BasicExpensiveTreeNode* node : order) {
+        if (node->uncompressedParent) { // if root, do nothing (root in original => root in compressec)
+            if (node->uncompressedParent->isApex) {
+                //The closest apex is already parent in uncompressed tree
+                node->parent = node->uncompressedParent;
+            } else {
+                // note that uncompressedParent has already been updated
+                node->parent = node->uncompressedParent->parent;
+            }
+        }
+
+        if (!(node == this && isRoot) && node->parent) {
+            std::list<BasicExpensiveTreeNode*>& siblings = node->parent->children;
+            if (spareListNodes.empty()) {
+                siblings.push_back(node);
+            } else {
+                siblings.splice(siblings.end(), spareListNodes, spareListNodes.begin());
+                siblings.back() = node;
+            }
+            node->compressedPosition = std::prev(siblings.end());
+        }
+    }
+    spareListNodes.clear();
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignIntervals(){
+    startBuffered = 0;
+    endBuffered = FatPreorder::intervalLength(subtreeSize);
+    contAssignIntervals();
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::contAssignIntervals() {
+    // Parents come first, so each node's buffered interval is already set
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, true);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->assignOwnInterval();
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignOwnInterval() {
+    // Calculate fat preorder numbering
+    FatPreorder::Coord buffer = FatPreorder::power(subtreeSize);
+    start = startBuffered + buffer;
+    end = endBuffered - buffer;
+
+    largestChildEndBuffer = start; //Edge case when there are no children
+    
+    // Assign buffered intervals to children
+    FatPreorder::Coord currChildStart = start + 1;
+    FatPreorder::Coord intervalSize;
+    for (BasicExpensiveTreeNode* child : children) {
+        intervalSize = FatPreorder::intervalLength(child->subtreeSize);
+        child->startBuffered = currChildStart;
+        child->endBuffered = currChildStart + intervalSize;
+        currChildStart = currChildStart + intervalSize + 1;
+
+        // Mantain "largest" augmented value
+        largestChildEndBuffer = currChildStart + intervalSize;
+    }
+}
+
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::fillAllAncestors(bool rebuild){
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    prepareAncestorTables(order, rebuild);
+
+    // In preorder, the parent of every node but the first has just been
+    // filled, and that of the first is outside the subtree and unchanged
+    for (BasicExpensiveTreeNode* node : order) {
+        node->fillAncestorTable(true);
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::prepareAncestorTables(std::vector<BasicExpensiveTreeNode*>& order, bool rebuild) {
+    AncestorPool*& pool = root->ancestorPool;
+    bool wholeTree = rebuild && (this == root);
+    if (!pool) {
+        pool = new AncestorPool();
+    }
+
+    // Preprocessing the whole tree renumbers it in preorder, from an empty
+    // pool. Recompressing it keeps the slots that are still large enough.
+    if (wholeTree || pool->nodes.empty()) {
+        pool->nodes.assign(1, NULL); // index 0 stands for NULL
+        pool->freeIndices.clear();
+        pool->words.clear();
+        pool->liveWords = 0;
+    }
+
+    int topDepth = 0;
+    for (BasicExpensiveTreeNode* node = parent; node; node = node->parent) {
+        topDepth++;
+    }
+
+    // Nodes whose slot is too small give it back, and get a new one below
+    size_t newWords = 0;
+    order.clear();
+    std::vector<std::pair<BasicExpensiveTreeNode*, int> >& stack = ExpensiveTreeScratch<BasicExpensiveTreeNode>::depthStack;
+    stack.assign(1, std::make_pair(this, topDepth));
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        order.push_back(node);
+
+        if (wholeTree) {
+            if (node != this && node->ancestorPool) { // a former root
+                delete node->ancestorPool;
+                node->ancestorPool = NULL;
+            }
+            node->poolIndex = noSlot;
+            node->tableOffset = noSlot;
+        }
+        if (node->poolIndex == noSlot) {
+            if (pool->freeIndices.empty()) {
+                node->poolIndex = pool->nodes.size();
+                pool->nodes.push_back(node);
+            } else {
+                node->poolIndex = pool->freeIndices.back();
+                pool->freeIndices.pop_back();
+                pool->nodes[node->poolIndex] = node;
+            }
+        }
+
+        uint32_t runs = std::min(depth + 1, (int) FatPreorder::maxBuckets);
+        if (node->tableOffset == noSlot || node->tableCapacity < runs) {
+            if (node->tableOffset != noSlot) {
+                pool->liveWords -= slotHeader + node->tableCapacity;
+                node->tableOffset = noSlot;
+            }
+            node->tableCapacity = runs;
+            newWords += slotHeader + runs;
+        }
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, depth + 1));
+        }
+    }
+
+    // Compacting only once the garbage outweighs the live slots keeps its cost amortized
+    if (pool->words.size() - pool->liveWords > pool->liveWords + newWords) {
+        compactAncestorPool(pool);
+    }
+    size_t offset = pool->words.size();
+    assert(offset + newWords < noSlot);
+    pool->words.resize(offset + newWords);
+    pool->liveWords += newWords;
+    for (BasicExpensiveTreeNode* node : order) {
+        if (node->tableOffset == noSlot) {
+            node->tableOffset = offset;
+            offset += slotHeader + node->tableCapacity;
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::compactAncestorPool(AncestorPool* pool) {
+    // Compacts into the spare buffer, which then swaps with `words`: both
+    // keep the largest capacity the pool has needed, so this stops allocating
+    std::vector<uint32_t>& words = pool->spareWords;
+    words.clear();
+    words.reserve(pool->words.capacity());
+    for (BasicExpensiveTreeNode* node : pool->nodes) {
+        if (node && node->tableOffset != noSlot) {
+            size_t slotSize = slotHeader + node->tableCapacity;
+            uint32_t offset = words.size();
+            words.insert(words.end(), pool->words.begin() + node->tableOffset,
+                         pool->words.begin() + node->tableOffset + slotSize);
+            node->tableOffset = offset;
+        }
+    }
+    pool->words.swap(words);
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::releaseAncestorTable(AncestorPool* pool) {
+    if (poolIndex < pool->nodes.size() && pool->nodes[poolIndex] == this) {
+        pool->nodes[poolIndex] = NULL;
+        pool->freeIndices.push_back(poolIndex);
+        if (tableOffset != noSlot) {
+            pool->liveWords -= slotHeader + tableCapacity;
+        }
+    }
+    poolIndex = noSlot;
+    tableOffset = noSlot;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::fillAncestorTable(bool parentIsFilled){
+    LCA_STATS_ONLY(LcaStats::recordFillAncestors(1);)
+    std::vector<uint32_t>& words = root->ancestorPool->words;
+    uint32_t* slot = &words[tableOffset];
+    uint64_t bitmap[bitmapWords / 2] = {};
+    uint32_t* runs = slot + bitmapWords + 1;
+    uint32_t numRuns = 0;
+    runs[0] = 0; // rank 0: NULL
+
+    // Each ancestor holds the entries from where its run starts up to the
+    // first entry of its parent; entries below the first one stay NULL
+    int first = FatPreorder::firstBucketAbove(sizeWeight);
+    int next = parent ? FatPreorder::firstBucketAbove(parent->sizeWeight) : FatPreorder::maxBuckets;
+    if (first < next) {
+        bitmap[first / 64] |= 1ULL << (first % 64);
+        numRuns++;
+        runs[numRuns] = poolIndex;
+    }
+
+    if (parentIsFilled && parent && first <= next && parent->tableOffset != noSlot) {
+        // Every entry of the parent's table from its first one on is also
+        // ours, and it has none below: its runs follow our own
+        const uint32_t* parentSlot = &words[parent->tableOffset];
+        uint64_t parentBitmap[bitmapWords / 2];
+        memcpy(parentBitmap, parentSlot, sizeof(parentBitmap));
+        uint32_t parentRuns = 0;
+        for (int word = 0; word < bitmapWords / 2; ++word) {
+            bitmap[word] |= parentBitmap[word];
+            parentRuns += popcount(parentBitmap[word]);
+        }
+        assert(numRuns + parentRuns <= tableCapacity);
+        memcpy(runs + numRuns + 1, parentSlot + bitmapWords + 2, parentRuns * sizeof(uint32_t));
+    } else {
+        first = std::max(first, next);
+        for (BasicExpensiveTreeNode* node = parent; node; node = node->parent) {
+            next = node->parent ? FatPreorder::firstBucketAbove(node->parent->sizeWeight) : FatPreorder::maxBuckets;
+            if (first < next) {
+                assert(numRuns < tableCapacity);
+                bitmap[first / 64] |= 1ULL << (first % 64);
+                numRuns++;
+                runs[numRuns] = node->poolIndex;
+            }
+            first = std::max(first, next);
+        }
+    }
+    memcpy(slot, bitmap, sizeof(bitmap));
+
+    // Bits set below each word (at most 192, so each count fits in a byte)
+    uint32_t below = 0;
+    slot[bitmapWords] = 0;
+    for (int word = 1; word < bitmapWords / 2; ++word) {
+        below += popcount(bitmap[word - 1]);
+        slot[bitmapWords] |= below << (8 * word);
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignLevels(int level) {
+    std::vector<BasicExpensiveTreeNode*>& order = ExpensiveTreeScratch<BasicExpensiveTreeNode>::preorder;
+    collectPreorder(order, false);
+    this->uncompressedLevel = level;
+    this->assignJump();
+    for (size_t i = 1; i < order.size(); ++i) {
+        order[i]->uncompressedLevel = order[i]->uncompressedParent->uncompressedLevel + 1;
+        order[i]->assignJump();
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::assignJump() {
+    BasicExpensiveTreeNode* up = uncompressedParent;
+    if (!up) {
+        jump = this;
+        return;
+    }
+
+    // Two jumps of equal length from the parent merge into one
+    BasicExpensiveTreeNode* upJump = up->jump;
+    bool merge = up->uncompressedLevel - upJump->uncompressedLevel
+              == upJump->uncompressedLevel - upJump->jump->uncompressedLevel;
+    jump = merge ? upJump->jump : up;
+}
+
+////////////////////////
+// Dynamic Operations //
+////////////////////////
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::add_leaf(BasicExpensiveTreeNode* leaf) {
+    if (root->dynamicSubtreeSize >= FatPreorder::maxSize) {
+        return false;
+    }
+    LCA_STATS_ONLY(uint64_t statsStart = LcaStats::now();)
+
+    // Add leaf to original tree
+    uncompressedChildren.push_back(leaf);
+    leaf->uncompressedPosition = std::prev(uncompressedChildren.end());
+    leaf->uncompressedParent = this;
+    leaf->root = root;
+    leaf->uncompressedLevel = uncompressedLevel + 1;
+    leaf->assignJump();
+
+    // A preprocessed leaf was the root of its own tree, whose pool is dropped
+    delete leaf->ancestorPool;
+    leaf->ancestorPool = NULL;
+    leaf->poolIndex = noSlot;
+    leaf->tableOffset = noSlot;
+
+    // Set leaf path
+    leaf->isApex = true;
+    if (isApex) {
+        children.push_back(leaf);
+        leaf->parent = this;
+    } else {
+        leaf->parent = parent;
+        parent->children.push_back(leaf); //if !isApex, `this` has a parent
+    }
+    leaf->compressedPosition = std::prev(leaf->parent->children.end());
+
+    // Update subtree sizes
+    BasicExpensiveTreeNode* currNode = leaf;
+
+    leaf->subtreeSize = 1;
+    leaf->sizeWeight = FatPreorder::weight(1);
+    leaf->dynamicSubtreeSize = 0; // Start at 0 so that we increment to 1 on the first loop
+    
+    LCA_STATS_ONLY(int walkLength = 0;)
+    while (currNode) {
+        currNode->dynamicSubtreeSize += 1;
+        currNode = currNode->parent;
+        LCA_STATS_ONLY(walkLength++;)
+    }
+    LCA_STATS_ONLY(LcaStats::recordSizeWalk(walkLength);)
+
+    // Record last node where
+    // dynamicSubtreeSize >= alpha * subtreeSize (ie. last "broken" node)
+    currNode = leaf; //By convention, the leaf is "broken"
+    bool nextIsBroken = currNode->parent && currNode->parent->dynamicSubtreeSize >= alpha * currNode->parent->subtreeSize;
+
+    while(nextIsBroken) {
+        currNode = currNode->parent;
+        nextIsBroken = currNode->parent && currNode->parent->dynamicSubtreeSize >= alpha * currNode->parent->subtreeSize;
+    }
+
+    // Recompress last "broken" node and update ancestor tables
+    currNode->recompressAndFill();
+    LCA_STATS_ONLY(LcaStats::recordLatency(LcaStats::expensiveAddLeaf, LcaStats::now() - statsStart);)
+    return true;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::recompressAndFill() {
+    LCA_STATS_ONLY(uint64_t recompressStart = LcaStats::now();)
+    recompress();
+    if (lcaTreeScheduler && subtreeSize >= parallelGrain) {
+        parallelFillAllAncestors(false);
+    } else {
+        fillAllAncestors(false);
+        setPreprocessedFlag();
+    }
+    LCA_STATS_ONLY(
+        LcaStats::recordRecompress(subtreeSize);
+        LcaStats::recordLatency(LcaStats::recompress, LcaStats::now() - recompressStart);
+    )
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>* BasicExpensiveTreeNode<Payload>::highestBrokenAncestor() {
+    // A leaf always fits in the buffer of its parent, but a larger subtree
+    // may not
+    BasicExpensiveTreeNode* currNode = this;
+    while (currNode->parent &&
+           (currNode->parent->dynamicSubtreeSize >= alpha * currNode->parent->subtreeSize ||
+            currNode->parent->largestChildEndBuffer + FatPreorder::intervalLength(currNode->dynamicSubtreeSize)
+                > currNode->parent->end)) {
+        currNode = currNode->parent;
+    }
+    return currNode;
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::link(BasicExpensiveTreeNode* otherRoot) {
+    assert(otherRoot->uncompressedParent == NULL && otherRoot->root == otherRoot && root != otherRoot);
+    if (root->dynamicSubtreeSize + otherRoot->dynamicSubtreeSize > FatPreorder::maxSize) {
+        return false;
+    }
+    if (otherRoot->dynamicSubtreeSize > root->dynamicSubtreeSize && linkLarger(otherRoot)) {
+        return true;
+    }
+
+    // Its nodes join this tree: the pool of their tables is dropped, and
+    // they get new slots when they are refilled below
+    delete otherRoot->ancestorPool;
+    otherRoot->ancestorPool = NULL;
+    std::vector<BasicExpensiveTreeNode*> order;
+    attachTree(otherRoot, order);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->poolIndex = noSlot;
+        node->tableOffset = noSlot;
+    }
+
+    // The other root hangs from the compressed tree like a new leaf
+    otherRoot->isApex = true;
+    if (isApex) {
+        children.push_back(otherRoot);
+        otherRoot->parent = this;
+    } else {
+        otherRoot->parent = parent;
+        parent->children.push_back(otherRoot);
+    }
+    otherRoot->compressedPosition = std::prev(otherRoot->parent->children.end());
+    for (BasicExpensiveTreeNode* node = otherRoot->parent; node; node = node->parent) {
+        node->dynamicSubtreeSize += order.size();
+    }
+
+    // Recompress the last "broken" node, as add_leaf does
+    otherRoot->highestBrokenAncestor()->recompressAndFill();
+    return true;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::attachTree(BasicExpensiveTreeNode* otherRoot,
+                                                 std::vector<BasicExpensiveTreeNode*>& order) {
+    uncompressedChildren.push_back(otherRoot);
+    otherRoot->uncompressedPosition = std::prev(uncompressedChildren.end());
+    otherRoot->uncompressedParent = this;
+
+    otherRoot->collectPreorder(order, false);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->root = root;
+        node->uncompressedLevel += uncompressedLevel + 1;
+        node->assignJump(); // preorder: the parent's is already set
+    }
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::linkLarger(BasicExpensiveTreeNode* otherRoot) {
+    // The path from the root down to this node joins the heavy path of
+    // otherRoot, and every subtree hanging from it is light
+    std::vector<BasicExpensiveTreeNode*> path;
+    for (BasicExpensiveTreeNode* node = this; node; node = node->uncompressedParent) {
+        path.push_back(node);
+    }
+    std::reverse(path.begin(), path.end());
+    std::vector<BasicExpensiveTreeNode*> lightRoots;
+    for (size_t i = 0; i < path.size(); ++i) {
+        for (BasicExpensiveTreeNode* child : path[i]->uncompressedChildren) {
+            if (i + 1 == path.size() || child != path[i + 1]) {
+                lightRoots.push_back(child);
+            }
+        }
+    }
+
+    // The path below the root and otherRoot become leaves of the compressed
+    // root, and the light subtrees its children: they all need room in the
+    // interval of otherRoot, which the root takes over
+    std::vector<BasicExpensiveTreeNode*> order;
+    long long int numNodes = path.size();
+    FatPreorder::Coord room = path.size() * FatPreorder::intervalLength(1);
+    for (BasicExpensiveTreeNode* light : lightRoots) {
+        light->collectPreorder(order, false);
+        numNodes += order.size();
+        room += FatPreorder::intervalLength(order.size());
+    }
+    if (otherRoot->dynamicSubtreeSize + numNodes >= alpha * otherRoot->subtreeSize ||
+        otherRoot->largestChildEndBuffer + room > otherRoot->end) {
+        return false;
+    }
+
+    // The nodes of this tree drop their tables and compressed children
+    BasicExpensiveTreeNode* top = root;
+    top->collectPreorder(order, false);
+    for (BasicExpensiveTreeNode* node : order) {
+        node->children.clear();
+        node->poolIndex = noSlot;
+        node->tableOffset = noSlot;
+    }
+
+    // The root takes the place of otherRoot in the compressed tree: its
+    // interval, and its table, whose pool index the tables of the other
+    // tree end with
+    delete top->ancestorPool;
+    top->ancestorPool = otherRoot->ancestorPool;
+    otherRoot->ancestorPool = NULL;
+    top->poolIndex = otherRoot->poolIndex;
+    top->tableOffset = otherRoot->tableOffset;
+    top->tableCapacity = otherRoot->tableCapacity;
+    top->ancestorPool->nodes[top->poolIndex] = top;
+    otherRoot->poolIndex = noSlot;
+    otherRoot->tableOffset = noSlot;
+    top->startBuffered = otherRoot->startBuffered;
+    top->endBuffered = otherRoot->endBuffered;
+    top->start = otherRoot->start;
+    top->end = otherRoot->end;
+    top->largestChildEndBuffer = otherRoot->largestChildEndBuffer;
+    top->subtreeSize = otherRoot->subtreeSize;
+    top->sizeWeight = otherRoot->sizeWeight;
+    top->dynamicSubtreeSize = otherRoot->dynamicSubtreeSize + numNodes;
+    top->children.splice(top->children.end(), otherRoot->children);
+    for (BasicExpensiveTreeNode* child : top->children) {
+        child->parent = top;
+    }
+    attachTree(otherRoot, order);
+
+    // The path below the root, then otherRoot, hang from it as leaves
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+        path[i]->heavyChild = path[i + 1];
+    }
+    heavyChild = otherRoot;
+    path.erase(path.begin());
+    path.push_back(otherRoot);
+    for (BasicExpensiveTreeNode* node : path) {
+        node->isApex = false;
+        node->parent = top;
+        top->children.push_back(node);
+        node->compressedPosition = std::prev(top->children.end());
+        node->subtreeSize = 1;
+        node->sizeWeight = FatPreorder::weight(1);
+        node->dynamicSubtreeSize = 1;
+        node->startBuffered = top->largestChildEndBuffer;
+        node->endBuffered = node->startBuffered + FatPreorder::intervalLength(1);
+        top->largestChildEndBuffer = node->endBuffered;
+        node->assignOwnInterval();
+        node->fillAllAncestors(false);
+    }
+
+    // Each light subtree is recompressed on its own, below the root
+    for (BasicExpensiveTreeNode* light : lightRoots) {
+        light->isApex = true;
+        light->parent = top;
+        top->children.push_back(light);
+        light->compressedPosition = std::prev(top->children.end());
+        light->recompressAndFill();
+    }
+    return true;
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::add_leaves(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* batch, size_t n) {
+    // Every leaf of the batch is counted against each tree that it touches
+    // (a leaf earlier in the batch is the root of its own tree until then)
+    for (size_t k = 0; k < n; ++k) {
+        if (batch[k].first->root->dynamicSubtreeSize + (long long int) n > FatPreorder::maxSize) {
+            return false;
+        }
+    }
+
+    // Attach the leaves to both trees as add_leaf does. They are marked as
+    // not preprocessed until they are recompressed, which tells the leaves
+    // of the batch from the nodes that were in the tree before.
+    for (size_t k = 0; k < n; ++k) {
+        BasicExpensiveTreeNode* node = batch[k].first;
+        BasicExpensiveTreeNode* leaf = batch[k].second;
+        node->uncompressedChildren.push_back(leaf);
+        leaf->uncompressedPosition = std::prev(node->uncompressedChildren.end());
+        leaf->uncompressedParent = node;
+        leaf->root = node->root;
+        leaf->uncompressedLevel = node->uncompressedLevel + 1;
+        leaf->assignJump();
+
+        delete leaf->ancestorPool;
+        leaf->ancestorPool = NULL;
+        leaf->poolIndex = noSlot;
+        leaf->tableOffset = noSlot;
+        leaf->isPreprocessed = false;
+
+        leaf->isApex = true;
+        leaf->parent = node->isApex ? node : node->parent;
+        leaf->parent->children.push_back(leaf);
+        leaf->compressedPosition = std::prev(leaf->parent->children.end());
+        leaf->subtreeSize = 1;
+        leaf->sizeWeight = FatPreorder::weight(1);
+        leaf->dynamicSubtreeSize = 1;
+    }
+
+    // Leaves come after their parents, so a reverse sweep finishes the size
+    // of every new subtree before adding it to its parent. A new subtree
+    // below an old node is added to all its compressed ancestors at once.
+    std::vector<BasicExpensiveTreeNode*> tops;
+    for (size_t k = n; k-- > 0;) {
+        BasicExpensiveTreeNode* leaf = batch[k].second;
+        if (!leaf->parent->isPreprocessed) {
+            leaf->parent->dynamicSubtreeSize += leaf->dynamicSubtreeSize;
+            continue;
+        }
+        for (BasicExpensiveTreeNode* node = leaf->parent; node; node = node->parent) {
+            node->dynamicSubtreeSize += leaf->dynamicSubtreeSize;
+        }
+        tops.push_back(leaf);
+    }
+    for (BasicExpensiveTreeNode*& top : tops) {
+        top = top->highestBrokenAncestor();
+    }
+
+    // Keep the highest of these nodes only. The subtrees recompressed below
+    // the same parent must also fit in its buffer together: if they do not,
+    // that parent is recompressed instead, which may in turn contain others.
+    std::unordered_set<BasicExpensiveTreeNode*> marked;
+    std::unordered_map<BasicExpensiveTreeNode*, FatPreorder::Coord> demand;
+    for (bool changed = true; changed;) {
+        marked.clear();
+        marked.insert(tops.begin(), tops.end());
+        size_t kept = 0;
+        for (BasicExpensiveTreeNode* top : tops) {
+            bool isHighest = true;
+            for (BasicExpensiveTreeNode* node = top->parent; node && isHighest; node = node->parent) {
+                isHighest = !marked.count(node);
+            }
+            if (isHighest) {
+                tops[kept++] = top;
+            }
+        }
+        tops.resize(kept);
+
+        // Duplicates are dropped here, keeping the order of the batch
+        marked.clear();
+        demand.clear();
+        kept = 0;
+        for (BasicExpensiveTreeNode* top : tops) {
+            if (marked.insert(top).second) {
+                tops[kept++] = top;
+                if (top->parent) {
+                    demand[top->parent] += FatPreorder::intervalLength(top->dynamicSubtreeSize);
+                }
+            }
+        }
+        tops.resize(kept);
+
+        changed = false;
+        for (BasicExpensiveTreeNode*& top : tops) {
+            BasicExpensiveTreeNode* up = top->parent;
+            if (up && up->largestChildEndBuffer + demand[up] > up->end) {
+                top = up->highestBrokenAncestor();
+                changed = true;
+            }
+        }
+    }
+
+    // The subtrees are disjoint, and their ancestors are not recompressed
+    for (BasicExpensiveTreeNode* top : tops) {
+        top->recompressAndFill();
+    }
+    return true;
+}
+
+//////////////////////
+// Parallel Passes  //
+//////////////////////
+
+template <typename Payload>
+template <typename Visit>
+void BasicExpensiveTreeNode<Payload>::parallelPreorder(TaskGroup& group, bool useCompressed, const Visit& visit) {
+    std::vector<BasicExpensiveTreeNode*> stack(1, this);
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back();
+        stack.pop_back();
+        visit(node);
+
+        // An only child is never forked: a long path stays within one task
+        std::list<BasicExpensiveTreeNode*>& childrenList = useCompressed ? node->children : node->uncompressedChildren;
+        bool onlyChild = childrenList.size() == 1;
+        for (BasicExpensiveTreeNode* child : childrenList) {
+            if (!onlyChild && child->subtreeSize >= parallelGrain) {
+                TaskGroup* taskGroup = &group;
+                group.run([child, taskGroup, useCompressed, visit]() {
+                    child->parallelPreorder(*taskGroup, useCompressed, visit);
+                });
+            } else {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+template <typename Payload>
+long long int BasicExpensiveTreeNode<Payload>::parallelSubtreeSizes(bool sizesKnown, int depth) {
+    // Sizes are combined after the children finish, so forking is limited to
+    // the top levels to bound the nesting of waits
+    int maxDepth = sizesKnown ? parallelMaxNesting : parallelForkDepth;
+    if (depth >= maxDepth) {
+        return assignSubtreeSizes(false);
+    }
+
+    TaskGroup group(lcaTreeScheduler);
+    for (BasicExpensiveTreeNode* child : uncompressedChildren) {
+        // Before this pass, `subtreeSize` still holds the size in the previous
+        // compressed tree (1 for a heavy child, which has no compressed
+        // children), so it only guesses which subtrees are worth a task
+        bool isLarge = sizesKnown ? child->subtreeSize >= parallelGrain
+                                  : !child->uncompressedChildren.empty();
+        if (isLarge) {
+            group.run([child, sizesKnown, depth]() {
+                child->parallelSubtreeSizes(sizesKnown, depth + 1);
+            });
+        } else {
+            child->assignSubtreeSizes(false);
+        }
+    }
+    group.wait();
+
+    subtreeSize = 1;
+    for (BasicExpensiveTreeNode* child : uncompressedChildren) {
+        subtreeSize += child->subtreeSize;
+    }
+    dynamicSubtreeSize = subtreeSize;
+    sizeWeight = FatPreorder::weight(subtreeSize);
+    return subtreeSize;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::parallelApex(bool withLevels, BasicExpensiveTreeNode* rootNode) {
+    BasicExpensiveTreeNode* top = this;
+    TaskGroup group(lcaTreeScheduler);
+    parallelPreorder(group, false, [top, withLevels, rootNode](BasicExpensiveTreeNode* node) {
+        if (node == top) {
+            node->isApex = true;
+        } else {
+            node->isApex = (node->subtreeSize * 2 <= node->uncompressedParent->subtreeSize);
+        }
+
+        // At most one child is heavy, so only one task writes the parent's field
+        if (!node->isApex) {
+            node->uncompressedParent->heavyChild = node;
+        }
+        if (withLevels) {
+            node->uncompressedLevel = (node == top) ? 0 : node->uncompressedParent->uncompressedLevel + 1;
+            node->assignJump();
+            node->root = rootNode;
+        }
+    });
+    group.wait();
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::parallelCompressTree() {
+    // Other nodes get their parent from the apex that collects them
+    if (uncompressedParent) {
+        parent = uncompressedParent->isApex ? uncompressedParent : uncompressedParent->parent;
+    }
+
+    TaskGroup group(lcaTreeScheduler);
+    parallelPreorder(group, false, [](BasicExpensiveTreeNode* node) {
+        // In the compressed tree, only apexes have children
+        node->children.clear();
+        if (node->isApex) {
+            node->collectCompressedChildren();
+        }
+
+        // The compressed subtree of an apex holds its whole uncompressed
+        // subtree, while any other node is a compressed leaf
+        if (!node->isApex) {
+            node->subtreeSize = 1;
+        }
+        node->dynamicSubtreeSize = node->subtreeSize;
+        node->sizeWeight = FatPreorder::weight(node->subtreeSize);
+    });
+    group.wait();
+}
+
+// The compressed children of an apex are the nodes below its heavy path whose
+// uncompressed parent is on the path. Visiting them in preorder reproduces
+// the order in which the sequential compressTree appends them.
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::collectCompressedChildren() {
+    std::vector<BasicExpensiveTreeNode*> stack(1, this);
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back();
+        stack.pop_back();
+        if (node != this) {
+            children.push_back(node);
+            node->compressedPosition = std::prev(children.end());
+            node->parent = this;
+        }
+
+        if (node == this || !node->isApex) {
+            for (auto it = node->uncompressedChildren.rbegin(); it != node->uncompressedChildren.rend(); ++it) {
+                stack.push_back(*it);
+            }
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::parallelContAssignIntervals() {
+    TaskGroup group(lcaTreeScheduler);
+    parallelPreorder(group, true, [](BasicExpensiveTreeNode* node) {
+        node->assignOwnInterval();
+    });
+    group.wait();
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::parallelFillAllAncestors(bool rebuild) {
+    // Slots are handed out sequentially; each task then writes only the slots
+    // of its own nodes, walking up from each (a parent may be in another chunk)
+    std::vector<BasicExpensiveTreeNode*> order;
+    prepareAncestorTables(order, rebuild);
+
+    TaskGroup group(lcaTreeScheduler);
+    const std::vector<BasicExpensiveTreeNode*>* nodes = &order;
+    for (size_t first = 0; first < order.size(); first += parallelGrain) {
+        size_t last = std::min(order.size(), first + parallelGrain);
+        group.run([nodes, first, last]() {
+            for (size_t k = first; k < last; ++k) {
+                (*nodes)[k]->fillAncestorTable(false);
+                (*nodes)[k]->isPreprocessed = true;
+            }
+        });
+    }
+    group.wait();
+}
+
+
+///////////////////////
+// Answering Queries //
+///////////////////////
+
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>* BasicExpensiveTreeNode<Payload>::lca(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    BasicExpensiveTreeNode::caTuple allCas = cas(nodeX, nodeY);
+    return allCas.lca;
+}
+
+template <typename Payload>
+typename BasicExpensiveTreeNode<Payload>::caTuple BasicExpensiveTreeNode<Payload>::cas(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    if (!nodeX->isPreprocessed or !nodeY->isPreprocessed) {
+        std::cout << "Error: Tree must be preprocessed before calling LCA." << std::endl;
+        exit(-1);
+    } else if (nodeX == nodeY) {
+        BasicExpensiveTreeNode::caTuple result = {nodeX, nodeX, nodeX};
+        return result;
+    } else if (nodeX->root != nodeY->root) {
+        BasicExpensiveTreeNode::caTuple result = {NULL, NULL, NULL};
+        return result;
+    }
+
+    BasicExpensiveTreeNode::caTuple compressedCas = casCompressed(nodeX, nodeY);
+            
+    // Find LCA from compressed CAs
+    BasicExpensiveTreeNode* b_x = (compressedCas.ca_x->inPath(compressedCas.lca)) ?
+                     compressedCas.ca_x : compressedCas.ca_x->uncompressedParent;
+    BasicExpensiveTreeNode* b_y = (compressedCas.ca_y->inPath(compressedCas.lca)) ?
+                     compressedCas.ca_y : compressedCas.ca_y->uncompressedParent;
+    BasicExpensiveTreeNode* lca = ((b_x->uncompressedLevel < b_y->uncompressedLevel) ?
+                        b_x : b_y);
+
+    // Find CA_X from compressed CAs
+    BasicExpensiveTreeNode* ca_x;
+    if (lca != b_x) {
+        // In this case, lca must have a heavy child (cannot be NULL)
+        ca_x = lca->heavyChild;
+    } else if (lca == b_x && lca != compressedCas.ca_x) {
+        ca_x = compressedCas.ca_x;
+    } else {
+        // ie. lca == b_x && lca == compressedCas.ca_x
+        ca_x = nodeX;
+    }
+
+    // Symmetrically, find CA_Y from compressed CAs
+    BasicExpensiveTreeNode* ca_y;
+    if (lca != b_y) {
+        ca_y = lca->heavyChild;
+    } else if (lca == b_y && lca != compressedCas.ca_y) {
+        ca_y = compressedCas.ca_y;
+    } else {
+        ca_y = nodeY;
+    }
+
+    // Return result
+    BasicExpensiveTreeNode::caTuple result = {lca, ca_x, ca_y};
+    return result;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::lcaBatch(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* queries,
+                                 BasicExpensiveTreeNode** results, size_t n) {
+    BasicExpensiveTreeNode::caTuple allCas[batchGroupSize];
+    for (size_t first = 0; first < n; first += batchGroupSize) {
+        size_t count = std::min((size_t) batchGroupSize, n - first);
+        casBatch(queries + first, allCas, count);
+        for (size_t k = 0; k < count; ++k) {
+            results[first + k] = allCas[k].lca;
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::casBatch(const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* queries,
+                                 caTuple* results, size_t n) {
+    int bucket[batchGroupSize];
+    BasicExpensiveTreeNode* const* entry[2 * batchGroupSize];
+    BasicExpensiveTreeNode* v[2 * batchGroupSize];
+
+    for (size_t first = 0; first < n; first += batchGroupSize) {
+        size_t count = std::min((size_t) batchGroupSize, n - first);
+        const std::pair<BasicExpensiveTreeNode*, BasicExpensiveTreeNode*>* group = queries + first;
+
+        // Stage 1: the query nodes themselves
+        for (size_t k = 0; k < count; ++k) {
+            __builtin_prefetch(group[k].first);
+            __builtin_prefetch(group[k].second);
+        }
+
+        // Stage 2: the ancestor table slots selected by the start distance
+        for (size_t k = 0; k < count; ++k) {
+            BasicExpensiveTreeNode* x = group[k].first;
+            BasicExpensiveTreeNode* y = group[k].second;
+            bucket[k] = -1;
+            if (x != y && x->root == y->root) { // coordinates of different trees do not compare
+                bucket[k] = FatPreorder::bucket(FatPreorder::distance(x->start, y->start));
+                __builtin_prefetch(&x->root->ancestorPool->words[x->tableOffset]);
+                __builtin_prefetch(&y->root->ancestorPool->words[y->tableOffset]);
+            }
+        }
+
+        // Stage 3: the pool entries of the runs holding those entries
+        for (size_t k = 0; k < count; ++k) {
+            entry[2 * k] = entry[2 * k + 1] = NULL;
+            if (bucket[k] >= 0) {
+                entry[2 * k] = group[k].first->ancestorEntry(bucket[k]);
+                entry[2 * k + 1] = group[k].second->ancestorEntry(bucket[k]);
+                __builtin_prefetch(entry[2 * k]);
+                __builtin_prefetch(entry[2 * k + 1]);
+            }
+        }
+
+        // Stage 4: the nodes stored in those entries, whose parents are read next
+        for (size_t k = 0; k < 2 * count; ++k) {
+            v[k] = entry[k] ? *entry[k] : NULL;
+            if (v[k]) {__builtin_prefetch(v[k]);}
+        }
+
+        // Stage 5: the compressed parents compared against the distance
+        for (size_t k = 0; k < 2 * count; ++k) {
+            if (v[k] && v[k]->parent) {__builtin_prefetch(v[k]->parent);}
+        }
+
+        // The remaining loads of each query are now (mostly) cache hits
+        for (size_t k = 0; k < count; ++k) {
+            results[first + k] = cas(group[k].first, group[k].second);
+        }
+    }
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::inPath(BasicExpensiveTreeNode* apex) {
+    if (this == apex) {
+        return true;
+    } else {
+        return (!isApex && (parent == apex)); // "parent" refers to compressed parent
+    }
+}
+
+// Note: nodeX cannot be equal to nodeY
+//
+// Implementation based on Fig. 2 of Gabow's paper
+// "A Data Structure for Nearest Common Ancestors with Linking"
+template <typename Payload>
+typename BasicExpensiveTreeNode<Payload>::caTuple BasicExpensiveTreeNode<Payload>::casCompressed(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    assert(nodeX != nodeY);
+
+    if (!nodeX->isPreprocessed or !nodeY->isPreprocessed) {
+        std::cout << "Error: Tree must be preprocessed before calling LCA." << std::endl;
+        exit(-1);
+    }
+
+    FatPreorder::Coord distance = FatPreorder::distance(nodeX->start, nodeY->start);
+    int i = FatPreorder::bucket(distance);
+    BasicExpensiveTreeNode* v = nodeX->ancestorAt(i);
+    BasicExpensiveTreeNode* w;
+    if (v) {
+        w = v->parent;
+    } else {
+        w = nodeX;
+    }
+
+    BasicExpensiveTreeNode* b;
+    BasicExpensiveTreeNode* b_x;
+    if (w->sizeWeight > distance) {
+        b = w;
+        if (v) {b_x = v;} else {b_x = nodeX;}
+    } else {
+        b = w->parent;
+        b_x = w;
+    }
+
+    BasicExpensiveTreeNode* a;
+    BasicExpensiveTreeNode* a_x;
+    if (b->isAncestorOf(nodeY)) {
+        a = b;
+        a_x = b_x;
+    } else {
+        a = b->parent;
+        a_x = b;
+    }
+
+    // Symetric computation to compute a_y
+    v = nodeY->ancestorAt(i);
+    if (v) {w = v->parent;} else {w = nodeY;}
+
+    BasicExpensiveTreeNode* b_y;
+    if (w->sizeWeight > distance) {
+        b = w;
+        if (v) {b_y = v;} else {b_y = nodeY;}
+    } else {
+        b = w->parent;
+        b_y = w;
+    }
+
+    BasicExpensiveTreeNode* a_y;
+    if (b->isAncestorOf(nodeX)) {
+        a = b;
+        a_y = b_y;
+    } else {
+        a = b->parent;
+        a_y = b;
+    }
+
+    caTuple toReturn;
+    toReturn.lca = a;
+    toReturn.ca_x = a_x;
+    toReturn.ca_y = a_y;
+    return(toReturn);
+}
+
+template <typename Payload>
+bool BasicExpensiveTreeNode<Payload>::isAncestorOf(BasicExpensiveTreeNode* node) {
+    return (start <= node->start) && (node->start <= end);
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>* BasicExpensiveTreeNode<Payload>::naiveLca(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    BasicExpensiveTreeNode::caTuple allCas = naiveCas(nodeX, nodeY);
+    return(allCas.lca);
+}
+
+template <typename Payload>
+typename BasicExpensiveTreeNode<Payload>::caTuple BasicExpensiveTreeNode<Payload>::naiveCas(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    if (nodeX == nodeY) {
+        BasicExpensiveTreeNode::caTuple toReturn = {nodeX, nodeX, nodeX};
+        return(toReturn);
+    }
+
+    std::deque<BasicExpensiveTreeNode*> xPath;
+    std::deque<BasicExpensiveTreeNode*> yPath;
+    
+    BasicExpensiveTreeNode* currNode = nodeX;
+    while (currNode) {
+        xPath.push_front(currNode);
+        currNode = currNode->uncompressedParent;
+    }
+
+    currNode = nodeY;
+    while (currNode) {
+        yPath.push_front(currNode);
+        currNode = currNode->uncompressedParent;
+    }
+
+    size_t i = 0;
+    while (i < xPath.size() && i < yPath.size() && xPath[i] == yPath[i]) {
+        i++;
+    }
+    if (i == 0) {
+        // Different roots: the nodes are in different trees
+        BasicExpensiveTreeNode::caTuple toReturn = {NULL, NULL, NULL};
+        return (toReturn);
+    }
+
+    BasicExpensiveTreeNode* lca = xPath[i-1];
+    BasicExpensiveTreeNode* ca_x = i < xPath.size() ? xPath[i] : xPath[xPath.size() - 1];
+    BasicExpensiveTreeNode* ca_y = i < yPath.size() ? yPath[i] : yPath[yPath.size() - 1];
+    BasicExpensiveTreeNode::caTuple toReturn = {lca, ca_x, ca_y};
+    
+    return (toReturn);
+}
+
+template <typename Payload>
+int BasicExpensiveTreeNode<Payload>::distance(BasicExpensiveTreeNode* nodeX, BasicExpensiveTreeNode* nodeY) {
+    BasicExpensiveTreeNode* lcaNode = lca(nodeX, nodeY);
+    if (!lcaNode) {
+        return -1;
+    }
+    return nodeX->uncompressedLevel + nodeY->uncompressedLevel - 2 * lcaNode->uncompressedLevel;
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>* BasicExpensiveTreeNode<Payload>::levelAncestor(BasicExpensiveTreeNode* node, int k) {
+    int target = node->uncompressedLevel - k;
+    if (k < 0 || target < 0) {
+        return NULL;
+    }
+    return node->highestAncestorWhere([target](BasicExpensiveTreeNode* ancestor) {
+        return ancestor->uncompressedLevel >= target;
+    });
+}
+
+///////////////////////////
+// Basic Tree Operations //
+///////////////////////////
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::init() {
+    // Initialize values as if this node were the sole node in a tree
+    parent = NULL;
+    root = this;
+    uncompressedParent = NULL;
+    subtreeSize = 1;
+    sizeWeight = FatPreorder::weight(1);
+    dynamicSubtreeSize = 1;
+    isApex = true;
+    heavyChild = NULL;
+    uncompressedLevel = 0;
+    jump = this;
+    isPreprocessed = true;
+
+    // The table of a lone node is never read; it gets one with the first fill
+    poolIndex = noSlot;
+    tableOffset = noSlot;
+    tableCapacity = 0;
+    ancestorPool = NULL;
+
+    // Assign interval
+    startBuffered = 0;
+    endBuffered = c; // == c * subtreeSize^{e} because subtreeSize is 1
+    start = 1; // The buffer is subtreeSize^{e} == 1
+    end = c - 1;
+    largestChildEndBuffer = 1; // Equal to `start`
+
+
+    associatedTwoSubtree = NULL;
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>::BasicExpensiveTreeNode() {
+    parent = NULL;
+    ancestorPool = NULL;
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>::BasicExpensiveTreeNode(const Payload& payload) : PayloadHolder<Payload>(payload) {
+    init();
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>::BasicExpensiveTreeNode(const Payload& payload, void* twoSubtree)
+    : PayloadHolder<Payload>(payload) {
+    init();
+    associatedTwoSubtree = twoSubtree;
+    preprocess();
+}
+
+template <typename Payload>
+BasicExpensiveTreeNode<Payload>::~BasicExpensiveTreeNode() {
+    delete ancestorPool;
+}
+
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::addLeafNoPreprocessing(BasicExpensiveTreeNode* child) {
+    children.push_back(child);
+    child->compressedPosition = std::prev(children.end());
+    uncompressedChildren.push_back(child);
+    child->uncompressedPosition = std::prev(uncompressedChildren.end());
+    child->parent = this;
+    child->uncompressedParent = this;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::deleteNode() {
+    if(uncompressedParent) {
+        uncompressedParent->uncompressedChildren.erase(uncompressedPosition);
+    }
+
+    std::vector<BasicExpensiveTreeNode*> order;
+    collectPreorder(order, false);
+
+    // Return the tables to the pool of the tree (the root's own destructor frees it)
+    AncestorPool* pool = root ? root->ancestorPool : NULL;
+    if (pool) {
+        for (BasicExpensiveTreeNode* node : order) {
+            node->releaseAncestorTable(pool);
+        }
+    }
+
+    // Mark the nodes being deleted, so that compressed parents outside the
+    // subtree (which keep living) can be told apart from deleted ones
+    for (BasicExpensiveTreeNode* node : order) {
+        node->root = NULL;
+    }
+    for (BasicExpensiveTreeNode* node : order) {
+        if (node->parent && node->parent->root) {
+            node->parent->children.erase(node->compressedPosition);
+        }
+    }
+
+    for (BasicExpensiveTreeNode* node : order) {
+        delete node;
+    }
+}
+
+template <typename Payload>
+MemoryUsage BasicExpensiveTreeNode<Payload>::memoryUsage() {
+    // A std::list node holds the element and two links
+    const size_t listNodeBytes = sizeof(BasicExpensiveTreeNode*) + 2 * sizeof(void*);
+
+    std::vector<BasicExpensiveTreeNode*> order;
+    collectPreorder(order, false);
+
+    MemoryUsage usage = {};
+    usage.numNodes = order.size();
+    for (BasicExpensiveTreeNode* node : order) {
+        size_t listNodes = node->uncompressedChildren.size() + node->children.size();
+        usage.nodes += sizeof(BasicExpensiveTreeNode);
+        usage.childLists += listNodes * listNodeBytes;
+        usage.allocations += 1 + listNodes;
+    }
+
+    // The root owns the pool; a subtree only accounts for its own slots
+    AncestorPool* pool = root ? root->ancestorPool : NULL;
+    if (this == root && pool) {
+        usage.ancestorTables = pool->words.capacity() * sizeof(uint32_t)
+                             + pool->nodes.capacity() * sizeof(BasicExpensiveTreeNode*)
+                             + pool->freeIndices.capacity() * sizeof(uint32_t)
+                             + pool->spareWords.capacity() * sizeof(uint32_t);
+        usage.allocations += 5;
+    } else if (pool) {
+        for (BasicExpensiveTreeNode* node : order) {
+            if (node->tableOffset != noSlot) {
+                usage.ancestorTables += (slotHeader + node->tableCapacity) * sizeof(uint32_t);
+            }
+            usage.ancestorTables += sizeof(BasicExpensiveTreeNode*); // its entry in `nodes`
+        }
+    }
+    return usage;
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::print() {
+    this->print(0);
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::print(int level) {
+    std::vector<std::pair<BasicExpensiveTreeNode*, int> > stack(1, std::make_pair(this, level));
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back().first;
+        int nodeLevel = stack.back().second;
+        stack.pop_back();
+
+        for (int i = 0; i < nodeLevel; i++){
+            std::cout << "    ";
+        }
+
+        std::cout << "Node " << getId(node)
+                  << "(subtree size = " << node->subtreeSize << ", "
+                  << "isApex = " << node->isApex << ", "
+                  << "parentId = " << getId(node->parent) << ", "
+                  << "uncompparentId = " << getId(node->uncompressedParent) << ", "
+                  << "level = " << node->uncompressedLevel << ", "
+                  << "heavyChild = " << getId(node->heavyChild) << ")"
+                  << std::endl;
+        for (auto it = node->uncompressedChildren.rbegin(); it != node->uncompressedChildren.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, nodeLevel + 1));
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::printIntervals(int level) {
+    std::vector<std::pair<BasicExpensiveTreeNode*, int> > stack(1, std::make_pair(this, level));
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back().first;
+        int nodeLevel = stack.back().second;
+        stack.pop_back();
+
+        for (int i = 0; i < nodeLevel; i++){
+            std::cout << "    ";
+        }
+
+        std::cout << "Node " << getId(node)
+                  << "(startB = " << FatPreorder::toString(node->startBuffered) << ", "
+                  << "start = " << FatPreorder::toString(node->start) << ", "
+                  << "end = " << FatPreorder::toString(node->end) << ", "
+                  << "endB = " << FatPreorder::toString(node->endBuffered) << ", "
+                  << "len = "  << FatPreorder::toString(node->sizeWeight) << ", "
+                  << "subSize = " << node->subtreeSize << ", "
+                  << "dynamicSubSize = " << node->dynamicSubtreeSize << ", "
+                  << "isApex = " << node->isApex << ")"
+                  << std::endl;
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, nodeLevel + 1));
+        }
+    }
+}
+
+template <typename Payload>
+void BasicExpensiveTreeNode<Payload>::printAncestors(int level) {
+    std::vector<std::pair<BasicExpensiveTreeNode*, int> > stack(1, std::make_pair(this, level));
+    while (!stack.empty()) {
+        BasicExpensiveTreeNode* node = stack.back().first;
+        int nodeLevel = stack.back().second;
+        stack.pop_back();
+
+        for (int i = 0; i < nodeLevel; i++){
+            std::cout << "    ";
+        }
+
+        std::vector<BasicExpensiveTreeNode*> ancestors;
+        for (int i = 0; i < FatPreorder::tableWidth(root->subtreeSize); ++i) {
+            ancestors.push_back(node->ancestorAt(i));
+        }
+        std::cout << "Node " << getId(node)
+                  << strAncestorTable(ancestors)
+                  << std::endl;
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+            stack.push_back(std::make_pair(*it, nodeLevel + 1));
+        }
+    }
+}
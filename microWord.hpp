@@ -0,0 +1,248 @@
+#ifndef MICROWORD_H
+#define MICROWORD_H
+
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/*
+ * Words for the 2-subtrees ("micro-trees") of BasicMultilevelTreeNode:
+ * a 2-subtree holds as many nodes as its word has bits, and each node
+ * stores the word of its ancestors in the 2-subtree.
+ *
+ * MicroWord<Word> gives the operations the structure needs on each type:
+ *   bits        the number of bits (and of nodes in a full 2-subtree)
+ *   bit(i)      the word with only bit i set
+ *   test(w, i)  whether bit i of w is set
+ *   msb(w)      index of the highest set bit (w must not be 0)
+ *   lsb(w)      index of the lowest set bit (w must not be 0)
+ *   popcount(w) the number of set bits
+ *   select(w, r) index of the set bit of rank r, counting from the lowest
+ *               (w must have more than r bits set)
+ * Words are combined with &, | and ~, and value-initialized to 0.
+ */
+template <typename Word>
+struct MicroWord;
+
+/* Index of the set bit of rank r in w, counting from the lowest */
+inline int selectBit(uint64_t w, int r) {
+    // Narrow down to the byte holding it by the counts of the lower halves,
+    // then clear the lower set bits of that byte
+    int base = 0;
+    int count = __builtin_popcount((uint32_t) w);
+    if (count <= r) {r -= count; w >>= 32; base = 32;}
+    count = __builtin_popcount((uint32_t) w & 0xFFFF);
+    if (count <= r) {r -= count; w >>= 16; base += 16;}
+    count = __builtin_popcount((uint32_t) w & 0xFF);
+    if (count <= r) {r -= count; w >>= 8; base += 8;}
+    for (; r > 0; --r) {
+        w &= w - 1;
+    }
+    return base + __builtin_ctzll(w);
+}
+
+template <>
+struct MicroWord<uint32_t> {
+    static const int bits = 32;
+    static uint32_t bit(int i) {return (uint32_t) 1 << i;}
+    static bool test(uint32_t w, int i) {return (w >> i) & 1;}
+    static int msb(uint32_t w) {return 31 - __builtin_clz(w);}
+    static int lsb(uint32_t w) {return __builtin_ctz(w);}
+    static int popcount(uint32_t w) {return __builtin_popcount(w);}
+    static int select(uint32_t w, int r) {return selectBit(w, r);}
+};
+
+template <>
+struct MicroWord<uint64_t> {
+    static const int bits = 64;
+    static uint64_t bit(int i) {return (uint64_t) 1 << i;}
+    static bool test(uint64_t w, int i) {return (w >> i) & 1;}
+    static int msb(uint64_t w) {return 63 - __builtin_clzll(w);}
+    static int lsb(uint64_t w) {return __builtin_ctzll(w);}
+    static int popcount(uint64_t w) {return __builtin_popcountll(w);}
+    static int select(uint64_t w, int r) {return selectBit(w, r);}
+};
+
+template <>
+struct MicroWord<unsigned __int128> {
+    static const int bits = 128;
+    static unsigned __int128 bit(int i) {return (unsigned __int128) 1 << i;}
+    static bool test(unsigned __int128 w, int i) {return (w >> i) & 1;}
+    static int msb(unsigned __int128 w) {
+        uint64_t high = (uint64_t) (w >> 64);
+        return high ? 127 - __builtin_clzll(high) : 63 - __builtin_clzll((uint64_t) w);
+    }
+    static int lsb(unsigned __int128 w) {
+        uint64_t low = (uint64_t) w;
+        return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (w >> 64));
+    }
+    static int popcount(unsigned __int128 w) {return __builtin_popcountll((uint64_t) w) + __builtin_popcountll((uint64_t) (w >> 64));}
+    static int select(unsigned __int128 w, int r) {
+        int low = __builtin_popcountll((uint64_t) w);
+        return r < low ? selectBit((uint64_t) w, r)
+                       : 64 + selectBit((uint64_t) (w >> 64), r - low);
+    }
+};
+
+/*
+ * 256-bit word, as four 64-bit lanes (lane 0 holds bits 0 to 63). With
+ * AVX2 (`make AVX2=1`), the bitwise operations run on one ymm register and
+ * msb/lsb find the lane with a compare and a movemask; otherwise they loop
+ * over the lanes. Only 8-byte aligned, so that nodes holding one need no
+ * over-aligned allocation.
+ */
+struct Word256 {
+    uint64_t lane[4];
+};
+
+#ifdef __AVX2__
+inline __m256i loadWord(const Word256& w) {return _mm256_loadu_si256((const __m256i*) w.lane);}
+inline Word256 storeWord(__m256i v) {
+    Word256 w;
+    _mm256_storeu_si256((__m256i*) w.lane, v);
+    return w;
+}
+inline Word256 operator&(const Word256& a, const Word256& b) {return storeWord(_mm256_and_si256(loadWord(a), loadWord(b)));}
+inline Word256 operator|(const Word256& a, const Word256& b) {return storeWord(_mm256_or_si256(loadWord(a), loadWord(b)));}
+inline Word256 operator~(const Word256& a) {return storeWord(_mm256_xor_si256(loadWord(a), _mm256_set1_epi64x(-1)));}
+#else
+inline Word256 operator&(const Word256& a, const Word256& b) {
+    Word256 w = {{a.lane[0] & b.lane[0], a.lane[1] & b.lane[1], a.lane[2] & b.lane[2], a.lane[3] & b.lane[3]}};
+    return w;
+}
+inline Word256 operator|(const Word256& a, const Word256& b) {
+    Word256 w = {{a.lane[0] | b.lane[0], a.lane[1] | b.lane[1], a.lane[2] | b.lane[2], a.lane[3] | b.lane[3]}};
+    return w;
+}
+inline Word256 operator~(const Word256& a) {
+    Word256 w = {{~a.lane[0], ~a.lane[1], ~a.lane[2], ~a.lane[3]}};
+    return w;
+}
+#endif
+
+template <>
+struct MicroWord<Word256> {
+    static const int bits = 256;
+
+    static Word256 bit(int i) {
+        Word256 w = {{0, 0, 0, 0}};
+        w.lane[i / 64] = (uint64_t) 1 << (i % 64);
+        return w;
+    }
+
+    static bool test(const Word256& w, int i) {return (w.lane[i / 64] >> (i % 64)) & 1;}
+
+    static int msb(const Word256& w) {
+        int lane = 31 - __builtin_clz(nonzeroLanes(w));
+        return 64 * lane + 63 - __builtin_clzll(w.lane[lane]);
+    }
+
+    static int lsb(const Word256& w) {
+        int lane = __builtin_ctz(nonzeroLanes(w));
+        return 64 * lane + __builtin_ctzll(w.lane[lane]);
+    }
+
+    static int popcount(const Word256& w) {
+        return __builtin_popcountll(w.lane[0]) + __builtin_popcountll(w.lane[1])
+             + __builtin_popcountll(w.lane[2]) + __builtin_popcountll(w.lane[3]);
+    }
+
+    static int select(const Word256& w, int r) {
+        int lane = 0;
+        for (int count = __builtin_popcountll(w.lane[0]); count <= r; count = __builtin_popcountll(w.lane[++lane])) {
+            r -= count;
+        }
+        return 64 * lane + selectBit(w.lane[lane], r);
+    }
+
+    /* Bit k is set iff lane k is not 0 */
+    static int nonzeroLanes(const Word256& w) {
+#ifdef __AVX2__
+        __m256i zero = _mm256_cmpeq_epi64(loadWord(w), _mm256_setzero_si256());
+        return ~_mm256_movemask_pd(_mm256_castsi256_pd(zero)) & 0xF;
+#else
+        return (w.lane[0] != 0) | (w.lane[1] != 0) << 1 | (w.lane[2] != 0) << 2 | (w.lane[3] != 0) << 3;
+#endif
+    }
+};
+
+/*
+ * 512-bit word, as eight 64-bit lanes (lane 0 holds bits 0 to 63), with
+ * every operation looping over the lanes. The widest 2-subtrees: they keep
+ * the summary tree of a 2^40-node tree within FatPreorder::maxSize nodes.
+ */
+struct Word512 {
+    uint64_t lane[8];
+};
+
+inline Word512 operator&(const Word512& a, const Word512& b) {
+    Word512 w;
+    for (int k = 0; k < 8; ++k) {
+        w.lane[k] = a.lane[k] & b.lane[k];
+    }
+    return w;
+}
+
+inline Word512 operator|(const Word512& a, const Word512& b) {
+    Word512 w;
+    for (int k = 0; k < 8; ++k) {
+        w.lane[k] = a.lane[k] | b.lane[k];
+    }
+    return w;
+}
+
+inline Word512 operator~(const Word512& a) {
+    Word512 w;
+    for (int k = 0; k < 8; ++k) {
+        w.lane[k] = ~a.lane[k];
+    }
+    return w;
+}
+
+template <>
+struct MicroWord<Word512> {
+    static const int bits = 512;
+
+    static Word512 bit(int i) {
+        Word512 w = Word512();
+        w.lane[i / 64] = (uint64_t) 1 << (i % 64);
+        return w;
+    }
+
+    static bool test(const Word512& w, int i) {return (w.lane[i / 64] >> (i % 64)) & 1;}
+
+    static int msb(const Word512& w) {
+        int lane = 7;
+        while (!w.lane[lane]) {
+            --lane;
+        }
+        return 64 * lane + 63 - __builtin_clzll(w.lane[lane]);
+    }
+
+    static int lsb(const Word512& w) {
+        int lane = 0;
+        while (!w.lane[lane]) {
+            ++lane;
+        }
+        return 64 * lane + __builtin_ctzll(w.lane[lane]);
+    }
+
+    static int popcount(const Word512& w) {
+        int count = 0;
+        for (int k = 0; k < 8; ++k) {
+            count += __builtin_popcountll(w.lane[k]);
+        }
+        return count;
+    }
+
+    static int select(const Word512& w, int r) {
+        int lane = 0;
+        for (int count = __builtin_popcountll(w.lane[0]); count <= r; count = __builtin_popcountll(w.lane[++lane])) {
+            r -= count;
+        }
+        return 64 * lane + selectBit(w.lane[lane], r);
+    }
+};
+
+#endif
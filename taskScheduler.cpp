@@ -0,0 +1,132 @@
+#include "taskScheduler.hpp"
+
+namespace {
+    // Which scheduler (and which of its deques) the current thread belongs to
+    thread_local const TaskScheduler* currentScheduler = NULL;
+    thread_local int currentIndex = 0;
+}
+
+///////////////////////////////////////////
+//////         Task Scheduler       ///////
+///////////////////////////////////////////
+
+TaskScheduler::TaskScheduler(int numThreads) {
+    numWorkers = numThreads < 1 ? 1 : numThreads;
+    stopping.store(false);
+    pending.store(0);
+    for (int i = 0; i < numWorkers; ++i) {
+        workers.push_back(new Worker());
+    }
+    for (int i = 1; i < numWorkers; ++i) {
+        threads.push_back(std::thread(&TaskScheduler::workerLoop, this, i));
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping.store(true);
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (Worker* worker : workers) {
+        delete worker;
+    }
+}
+
+int TaskScheduler::self() const {
+    // Threads outside the pool (i.e. the owner) share deque 0
+    return (currentScheduler == this) ? currentIndex : 0;
+}
+
+void TaskScheduler::push(Task* task) {
+    Worker* worker = workers[self()];
+    {
+        std::lock_guard<std::mutex> guard(worker->lock);
+        worker->tasks.push_back(task);
+    }
+    pending.fetch_add(1);
+
+    // Taking the lock orders this push with a worker about to go to sleep
+    { std::lock_guard<std::mutex> guard(sleepLock); }
+    wake.notify_one();
+}
+
+bool TaskScheduler::runOne() {
+    int index = self();
+    Task* task = NULL;
+
+    // Newest task of our own deque first
+    {
+        Worker* worker = workers[index];
+        std::lock_guard<std::mutex> guard(worker->lock);
+        if (!worker->tasks.empty()) {
+            task = worker->tasks.back();
+            worker->tasks.pop_back();
+        }
+    }
+
+    // Otherwise, steal the oldest task of another deque
+    for (int i = 1; !task && i < numWorkers; ++i) {
+        Worker* victim = workers[(index + i) % numWorkers];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->tasks.empty()) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    pending.fetch_sub(1);
+    task->work();
+    task->group->outstanding.fetch_sub(1);
+    delete task;
+    return true;
+}
+
+void TaskScheduler::workerLoop(int index) {
+    currentScheduler = this;
+    currentIndex = index;
+
+    while (!stopping.load()) {
+        if (runOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [this]() {return stopping.load() || pending.load() > 0;});
+    }
+}
+
+///////////////////////////////////////////
+//////           Task Group         ///////
+///////////////////////////////////////////
+
+TaskGroup::TaskGroup(TaskScheduler* scheduler) : scheduler(scheduler) {
+    outstanding.store(0);
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(const std::function<void()>& work) {
+    TaskScheduler::Task* task = new TaskScheduler::Task();
+    task->work = work;
+    task->group = this;
+    outstanding.fetch_add(1);
+    scheduler->push(task);
+}
+
+void TaskGroup::wait() {
+    // Help with queued work (ours or anyone's) until our tasks are done
+    while (outstanding.load() > 0) {
+        if (!scheduler->runOne()) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+/*
+ * TaskScheduler
+ * A small work-stealing thread pool for fork-join parallelism.
+ *
+ * Every thread owns a deque of tasks. A thread pushes and pops tasks at the
+ * back of its own deque (so it keeps working on the most recently forked,
+ * cache-warm subproblem) and, when it runs dry, steals from the front of
+ * another thread's deque (the oldest, and usually largest, subproblem).
+ * The thread that owns the scheduler takes part through TaskGroup::wait.
+ */
+class TaskScheduler {
+    public:
+        /* Creates a scheduler using `numThreads` threads, including the caller */
+        TaskScheduler(int numThreads);
+        ~TaskScheduler();
+
+        int numThreads() const {return numWorkers;}
+
+    private:
+        friend class TaskGroup;
+
+        struct Task {
+            std::function<void()> work;
+            TaskGroup* group;
+        };
+
+        struct Worker {
+            std::mutex lock;
+            std::deque<Task*> tasks;
+        };
+
+        int numWorkers;
+        std::vector<Worker*> workers; // workers[0] is used by the owning thread
+        std::vector<std::thread> threads;
+
+        std::atomic<bool> stopping;
+        std::atomic<int> pending; // tasks pushed but not yet taken
+        std::mutex sleepLock;
+        std::condition_variable wake;
+
+        /* Index of the calling thread's deque */
+        int self() const;
+
+        void push(Task* task);
+
+        /* Runs one task from this thread's deque or a stolen one. Returns false if none was found. */
+        bool runOne();
+
+        void workerLoop(int index);
+};
+
+/*
+ * TaskGroup
+ * A set of forked tasks that can be waited on. Waiting threads execute
+ * queued tasks instead of blocking, so groups can be nested freely.
+ */
+class TaskGroup {
+    public:
+        TaskGroup(TaskScheduler* scheduler);
+        ~TaskGroup();
+
+        /* Forks `work` to be run by any thread of the scheduler */
+        void run(const std::function<void()>& work);
+
+        /* Returns once every task forked in this group has finished */
+        void wait();
+
+    private:
+        friend class TaskScheduler;
+        TaskScheduler* scheduler;
+        std::atomic<int> outstanding;
+};
+
+#endif
@@ -1,10 +1,28 @@
 #include <assert.h>
 #include <list>
+#include <map>
 #include <string>
 #include <iostream>
 #include "lcaTree.hpp"
 #include "generateRandTrees.hpp"
 #include "lcaMultilevel.hpp"
+#include "lcaArena.hpp"
+#include "fatPreorder.hpp"
+#include "lcaConcurrent.hpp"
+#include "taskScheduler.hpp"
+#include "lcaSnapshot.hpp"
+#include "lcaStats.hpp"
+#include "lcaEulerTour.hpp"
+#include <sstream>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <new>
 
 /*---------------------------*/
 /*   Tests for Correctness   */
@@ -18,6 +36,7 @@
  *    operations so that the data structure is maintained during construction
  * 3. Multilevel Dynamic: The tree is built using MultilevelTreeNode::add_leaf
  *    operations (similar to #2, but with indirection)
+ * 4. Arena: #1 and #2 repeated with the index-based ArenaTree
  *
  * A random sequence of LCA queries is generated, and the result of
  * of Gabow's O(1) LCA algorithm is compared to the result of a naive
@@ -28,12 +47,30 @@ using std::cout;
 using std::endl;
 using std::vector;
 
+/*
+ * Every heap allocation of the test binary is counted, for
+ * testAllocationFreeRecompress. Not inlined, so that the compiler does not
+ * pair the malloc inside with a delete at the call site.
+ */
+std::atomic<long long> allocationCount(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocationCount++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {throw std::bad_alloc();}
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
 
 void testStaticTree() {
     int numNodes = 1000;
     for (int i = 0; i < 100; ++i)
     {
-        treeAndNodes<ExpensiveTreeNode> randTree = generateStaticTree(numNodes);
+        treeAndNodes<ExpensiveTreeNode> randTree = generateStaticTree(numNodes, i);
         randTree.tree->preprocess();
      
         for (int j = 0; j < 100; ++j)
@@ -42,7 +79,7 @@ void testStaticTree() {
             int nodeY = rand() % numNodes;
             ExpensiveTreeNode* lca1 = ExpensiveTreeNode::lca(randTree.nodes[nodeX], randTree.nodes[nodeY]);
             ExpensiveTreeNode* lca2 = ExpensiveTreeNode::naiveLca(randTree.nodes[nodeX], randTree.nodes[nodeY]);
-            cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< lca1->nodeId << " and " << lca2->nodeId << endl;
+            cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< lca1->payload() << " and " << lca2->payload() << endl;
     
             assert(lca1 != NULL);
             assert(lca1 == lca2);
@@ -57,7 +94,7 @@ void testExpensiveIncremental() {
 
     for (int i = 0; i < 100; ++i)
     {
-        treeAndNodes<ExpensiveTreeNode> randTree = generateIncrementalTree(numNodes);
+        treeAndNodes<ExpensiveTreeNode> randTree = generateIncrementalTree(numNodes, i);
         for (int j = 0; j < 100; ++j)
         {
             int nodeX = rand() % numNodes;
@@ -66,7 +103,7 @@ void testExpensiveIncremental() {
             ExpensiveTreeNode::caTuple cas1 = ExpensiveTreeNode::cas(randTree.nodes[nodeX], randTree.nodes[nodeY]);
             ExpensiveTreeNode::caTuple cas2 = ExpensiveTreeNode::naiveCas(randTree.nodes[nodeX], randTree.nodes[nodeY]);
 
-            // std::cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< cas1.lca->nodeId << " and " << cas2.lca->nodeId << std::endl;
+            // std::cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< cas1.lca->payload() << " and " << cas2.lca->payload() << std::endl;
 
             assert(cas1.lca  != NULL);
             assert(cas1.ca_x != NULL);
@@ -76,6 +113,22 @@ void testExpensiveIncremental() {
             assert(cas1.ca_y == cas2.ca_y);
         }
 
+        // Batched queries must agree with single queries
+        std::vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> queries;
+        for (int j = 0; j < 100; ++j)
+        {
+            queries.push_back(std::make_pair(randTree.nodes[rand() % numNodes], randTree.nodes[rand() % numNodes]));
+        }
+        std::vector<ExpensiveTreeNode::caTuple> batchCas(queries.size());
+        ExpensiveTreeNode::casBatch(queries.data(), batchCas.data(), queries.size());
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            ExpensiveTreeNode::caTuple expected = ExpensiveTreeNode::naiveCas(queries[j].first, queries[j].second);
+            assert(batchCas[j].lca  == expected.lca);
+            assert(batchCas[j].ca_x == expected.ca_x);
+            assert(batchCas[j].ca_y == expected.ca_y);
+        }
+
         randTree.tree->deleteNode();
     }
     cout << "Passed 'expensive' tests" << endl;
@@ -86,7 +139,7 @@ void testMultilevel() {
 
     for (int i = 0; i < 100; ++i)
     {
-        treeAndNodes<MultilevelTreeNode> randTree = generateIncrementalMultilevelTree(numNodes);
+        treeAndNodes<MultilevelTreeNode> randTree = generateIncrementalMultilevelTree(numNodes, i);
         for (int j = 0; j < 1000; ++j)
         {
             int nodeX = rand() % numNodes;
@@ -95,19 +148,1441 @@ void testMultilevel() {
             MultilevelTreeNode* lca1 = MultilevelTreeNode::lca(randTree.nodes[nodeX], randTree.nodes[nodeY]);
             MultilevelTreeNode* lca2 = MultilevelTreeNode::naiveLca(randTree.nodes[nodeX], randTree.nodes[nodeY]);
 
-            // std::cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< lca1->data << " and " << lca2->data << std::endl;
+            // std::cout << i << "." << j << ") LCA of " << nodeX << ", " << nodeY << ": "<< lca1->payload() << " and " << lca2->payload() << std::endl;
 
             assert(lca1  != NULL);
             assert(lca1  == lca2);
+
+            MultilevelTreeNode::caTuple cas1 = MultilevelTreeNode::cas(randTree.nodes[nodeX], randTree.nodes[nodeY]);
+            MultilevelTreeNode::caTuple cas2 = MultilevelTreeNode::naiveCas(randTree.nodes[nodeX], randTree.nodes[nodeY]);
+            assert(cas1.lca == cas2.lca && cas1.ca_x == cas2.ca_x && cas1.ca_y == cas2.ca_y);
+
+            // Pairs where one node is an ancestor of the other (possibly itself)
+            MultilevelTreeNode* ancestor = randTree.nodes[nodeX];
+            for (int steps = rand() % 200; steps > 0 && ancestor->parent; --steps) {
+                ancestor = ancestor->parent;
+            }
+            cas1 = MultilevelTreeNode::cas(randTree.nodes[nodeX], ancestor);
+            cas2 = MultilevelTreeNode::naiveCas(randTree.nodes[nodeX], ancestor);
+            assert(cas1.lca == ancestor && cas1.lca == cas2.lca && cas1.ca_x == cas2.ca_x && cas1.ca_y == cas2.ca_y);
+        }
+
+        // Batched queries must agree with single queries
+        std::vector<std::pair<MultilevelTreeNode*, MultilevelTreeNode*>> queries;
+        for (int j = 0; j < 1000; ++j)
+        {
+            queries.push_back(std::make_pair(randTree.nodes[rand() % numNodes], randTree.nodes[rand() % numNodes]));
+        }
+        std::vector<MultilevelTreeNode*> batchLca(queries.size());
+        MultilevelTreeNode::lcaBatch(queries.data(), batchLca.data(), queries.size());
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            assert(batchLca[j] == MultilevelTreeNode::naiveLca(queries[j].first, queries[j].second));
         }
 
         randTree.tree->deleteNode();
     }
     cout << "Passed 'multilevel' tests" << endl;
 }
+void testArena() {
+    int numNodes = 1000;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        vector<vector<int>> sequences = randInsertionSeq(numNodes, i);
+        vector<int> leaves = sequences[0];
+        vector<int> parents = sequences[1];
+
+        // Node ids double as arena indices
+        ArenaTree staticTree(numNodes);
+        ArenaTree incrTree(numNodes);
+        for (int j = 0; j < numNodes; ++j)
+        {
+            staticTree.newNode();
+            incrTree.newNode();
+        }
+
+        for (int j = leaves.size() - 1; j >= 0; --j) {
+            staticTree.addLeafNoPreprocessing(parents[j], leaves[j]);
+            incrTree.add_leaf(parents[j], leaves[j]);
+        }
+        staticTree.preprocess(parents[parents.size() - 1]);
+
+        for (int j = 0; j < 100; ++j)
+        {
+            int nodeX = rand() % numNodes;
+            int nodeY = rand() % numNodes;
+
+            ArenaTree::caTuple expected = staticTree.naiveCas(nodeX, nodeY);
+            ArenaTree::caTuple cas1 = staticTree.cas(nodeX, nodeY);
+            ArenaTree::caTuple cas2 = incrTree.cas(nodeX, nodeY);
+
+            assert(cas1.lca  == expected.lca);
+            assert(cas1.ca_x == expected.ca_x);
+            assert(cas1.ca_y == expected.ca_y);
+            assert(cas2.lca  == expected.lca);
+            assert(cas2.ca_x == expected.ca_x);
+            assert(cas2.ca_y == expected.ca_y);
+        }
+    }
+    cout << "Passed 'arena' tests" << endl;
+}
+
+/* Checks the integer thresholds against the floating-point definition */
+void testFatPreorder() {
+    long double beta = FatPreorder::beta;
+    for (int i = 0; i < 100000; ++i)
+    {
+        long long int x = 1 + ((long long int) rand() << 20 ^ rand()) % (1LL << (i % 62));
+        int expected = 0;
+        while (powl(beta, expected + 1) <= x) {
+            expected++;
+        }
+        assert(FatPreorder::bucket(x) == expected);
+        assert(FatPreorder::threshold(expected) <= x);
+        assert(x < FatPreorder::threshold(expected + 1));
+        assert(FatPreorder::firstBucketAbove(x) == expected + 1);
+    }
+    assert(FatPreorder::weight(7) == (FatPreorder::c - 2) * 7 * 7 * 7 * 7);
+    cout << "Passed 'fat preorder' tests" << endl;
+}
+
+/*
+ * One writer grows a random recursive tree while several readers query
+ * nodes that have already been published, checking every answer against
+ * a naive walk over the parent array.
+ */
+void testConcurrent() {
+    int numNodes = 20000;
+    int numReaders = 3;
+
+    vector<NodeId> parents(numNodes, -1);
+    vector<int> depths(numNodes, 0);
+    std::atomic<int> published(1);
+    std::atomic<bool> failed(false);
+
+    ConcurrentMultilevelTree tree(0);
+
+    std::thread writer([&]() {
+        for (int i = 1; i < numNodes; ++i) {
+            parents[i] = rand() % i;
+            depths[i] = depths[parents[i]] + 1;
+            tree.add_leaf(parents[i], i);
+            published.store(i + 1);
+        }
+    });
+
+    vector<std::thread> readers;
+    for (int r = 0; r < numReaders; ++r) {
+        readers.push_back(std::thread([&, r]() {
+            unsigned int seed = r;
+            while (published.load() < numNodes) {
+                int limit = published.load();
+                NodeId x = rand_r(&seed) % limit;
+                NodeId y = rand_r(&seed) % limit;
+                NodeId result = tree.lca(x, y);
+
+                NodeId a = x, b = y;
+                while (depths[a] > depths[b]) {a = parents[a];}
+                while (depths[b] > depths[a]) {b = parents[b];}
+                while (a != b) {a = parents[a]; b = parents[b];}
+                if (result != a) {
+                    failed.store(true);
+                }
+            }
+        }));
+    }
+
+    writer.join();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    assert(!failed.load());
+    assert(tree.lca(numNodes - 1, numNodes) == ConcurrentMultilevelTree::NO_NODE);
+    cout << "Passed 'concurrent' tests" << endl;
+}
+
+/* Returns everything the print methods show about a preprocessed tree */
+std::string dumpTree(ExpensiveTreeNode* root) {
+    std::stringstream out;
+    std::streambuf* old = cout.rdbuf(out.rdbuf());
+    root->print();
+    root->printIntervals();
+    root->printAncestors();
+    cout.rdbuf(old);
+    return out.str();
+}
+
+/* Builds a random recursive tree (statically or with add_leaf) */
+vector<ExpensiveTreeNode*> buildRecursiveTree(const vector<int>& parents, bool incremental) {
+    vector<ExpensiveTreeNode*> nodes(parents.size());
+    nodes[0] = new ExpensiveTreeNode(0);
+    for (size_t i = 1; i < parents.size(); ++i) {
+        nodes[i] = new ExpensiveTreeNode(i);
+        if (incremental) {
+            nodes[parents[i]]->add_leaf(nodes[i]);
+        } else {
+            nodes[parents[i]]->addLeafNoPreprocessing(nodes[i]);
+        }
+    }
+    if (!incremental) {
+        nodes[0]->preprocess();
+    }
+    return nodes;
+}
+
+/* The parallel passes must produce exactly the sequential result */
+void testParallelPreprocess() {
+    int numNodes = 30000;
+    TaskScheduler scheduler(4);
+
+    for (int i = 0; i < 2; ++i) {
+        vector<int> parents(numNodes, -1);
+        for (int j = 1; j < numNodes; ++j) {
+            parents[j] = rand() % j;
+        }
+
+        for (int incremental = 0; incremental < 2; ++incremental) {
+            ExpensiveTreeNode::setScheduler(NULL);
+            vector<ExpensiveTreeNode*> sequential = buildRecursiveTree(parents, incremental);
+            ExpensiveTreeNode::setScheduler(&scheduler);
+            vector<ExpensiveTreeNode*> parallel = buildRecursiveTree(parents, incremental);
+            ExpensiveTreeNode::setScheduler(NULL);
+
+            assert(dumpTree(sequential[0]) == dumpTree(parallel[0]));
+            sequential[0]->deleteNode();
+            parallel[0]->deleteNode();
+        }
+    }
+    cout << "Passed 'parallel' tests" << endl;
+}
+
+/* Converts an insertion sequence whose ids follow insertion order to a parent array */
+vector<int> parentArray(const vector<vector<int>>& sequence) {
+    vector<int> parents(sequence[0].size() + 1, -1);
+    for (size_t i = 0; i < sequence[0].size(); ++i) {
+        parents[sequence[0][i]] = sequence[1][i];
+    }
+    return parents;
+}
+
+/* Compares `lca` (on node ids) with climbing the parent array */
+template <typename Lca>
+void checkAgainstParents(const vector<int>& parents, const Lca& lca) {
+    int numNodes = parents.size();
+    vector<int> depth(numNodes, 0);
+    for (int i = 1; i < numNodes; ++i) {
+        depth[i] = depth[parents[i]] + 1;
+    }
+
+    for (int j = 0; j < 200; ++j) {
+        int nodeX = rand() % numNodes;
+        int nodeY = rand() % numNodes;
+        int x = nodeX;
+        int y = nodeY;
+        while (depth[x] > depth[y]) {x = parents[x];}
+        while (depth[y] > depth[x]) {y = parents[y];}
+        while (x != y) {
+            x = parents[x];
+            y = parents[y];
+        }
+        assert(lca(nodeX, nodeY) == x);
+    }
+}
+
+/*
+ * Paths and caterpillars, far deeper than random trees. The multilevel tree
+ * is built a million nodes deep; trees without indirection are kept to 30k
+ * nodes, since every add_leaf walks up the whole path.
+ */
+void testDeepTrees() {
+    TaskScheduler scheduler(4);
+
+    for (int legLength = 0; legLength <= 2; legLength += 2) {
+        vector<int> parents = parentArray(caterpillarInsertionSeq(1000000 / (legLength + 1), legLength));
+        vector<MultilevelTreeNode*> multilevel(parents.size());
+        multilevel[0] = new MultilevelTreeNode(0);
+        for (size_t i = 1; i < parents.size(); ++i) {
+            multilevel[i] = new MultilevelTreeNode(i);
+            multilevel[parents[i]]->add_leaf(multilevel[i]);
+        }
+        checkAgainstParents(parents, [&](int x, int y) {
+            return (int) MultilevelTreeNode::lca(multilevel[x], multilevel[y])->payload();
+        });
+        multilevel[0]->deleteNode();
+
+        parents = parentArray(caterpillarInsertionSeq(30000 / (legLength + 1), legLength));
+        for (int incremental = 0; incremental < 2; ++incremental) {
+            for (int parallel = 0; parallel < 2; ++parallel) {
+                ExpensiveTreeNode::setScheduler(parallel ? &scheduler : NULL);
+                vector<ExpensiveTreeNode*> nodes = buildRecursiveTree(parents, incremental);
+                ExpensiveTreeNode::setScheduler(NULL);
+                checkAgainstParents(parents, [&](int x, int y) {
+                    return (int) ExpensiveTreeNode::lca(nodes[x], nodes[y])->payload();
+                });
+                nodes[0]->deleteNode();
+            }
+        }
+
+        ArenaTree staticTree(parents.size());
+        ArenaTree incrTree(parents.size());
+        staticTree.newNode();
+        incrTree.newNode();
+        for (size_t i = 1; i < parents.size(); ++i) {
+            staticTree.addLeafNoPreprocessing(parents[i], staticTree.newNode());
+            incrTree.add_leaf(parents[i], incrTree.newNode());
+        }
+        staticTree.preprocess(0);
+        checkAgainstParents(parents, [&](int x, int y) {return (int) staticTree.lca(x, y);});
+        checkAgainstParents(parents, [&](int x, int y) {return (int) incrTree.lca(x, y);});
+    }
+    cout << "Passed 'deep' tests" << endl;
+}
+
+/*
+ * Trees far beyond the ~36k compressed nodes at which 64-bit fat preorder
+ * intervals used to overflow, and the interval arithmetic up to `maxSize`
+ */
+void testLargeTrees() {
+    const long long int sizes[] = {36000, 1LL << 20, INT_MAX, FatPreorder::maxSize};
+    for (long long int size : sizes) {
+        FatPreorder::Coord length = FatPreorder::intervalLength(size);
+        assert(length > 0 && length / FatPreorder::c / size / size / size == size);
+        assert(FatPreorder::tableWidth(size) <= FatPreorder::maxBuckets);
+    }
+    // Thresholds past 2^64 must still split the coordinates into consistent buckets
+    for (int i = 8; i < FatPreorder::tableWidth(FatPreorder::maxSize); ++i) {
+        FatPreorder::Coord threshold = FatPreorder::threshold(i);
+        assert(FatPreorder::threshold(i - 1) < threshold);
+        assert(FatPreorder::bucket(threshold) == i && FatPreorder::bucket(threshold - 1) == i - 1);
+    }
+
+    int numNodes = 100000;
+    vector<int> parents(numNodes, -1);
+    for (int j = 1; j < numNodes; ++j) {
+        parents[j] = rand() % j;
+    }
+    for (int incremental = 0; incremental < 2; ++incremental) {
+        vector<ExpensiveTreeNode*> nodes = buildRecursiveTree(parents, incremental);
+        checkAgainstParents(parents, [&](int x, int y) {
+            return (int) ExpensiveTreeNode::lca(nodes[x], nodes[y])->payload();
+        });
+
+        const char* path = "lca_test_large_snapshot.bin";
+        LcaSnapshot snapshot;
+        assert(LcaSnapshot::save(nodes[0], path) && snapshot.load(path));
+        checkAgainstParents(parents, [&](int x, int y) {return (int) snapshot.lca(x, y);});
+        snapshot.unload();
+        remove(path);
+        nodes[0]->deleteNode();
+
+        ArenaTree arena(numNodes);
+        arena.newNode();
+        for (int j = 1; j < numNodes; ++j) {
+            if (incremental) {
+                arena.add_leaf(parents[j], arena.newNode());
+            } else {
+                arena.addLeafNoPreprocessing(parents[j], arena.newNode());
+            }
+        }
+        if (!incremental) {
+            arena.preprocess(0);
+        }
+        checkAgainstParents(parents, [&](int x, int y) {return (int) arena.lca(x, y);});
+    }
+
+    // 500 paths hanging from the root fill their 2-subtrees, for a summary tree of 46.5k nodes
+    numNodes = 3000000;
+    int legs = 500;
+    parents.assign(numNodes, -1);
+    for (int j = 1; j < numNodes; ++j) {
+        parents[j] = (j <= legs) ? 0 : j - legs;
+    }
+    vector<MultilevelTreeNode*> multilevel;
+    MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, multilevel);
+    checkAgainstParents(parents, [&](int x, int y) {
+        return (int) MultilevelTreeNode::lca(multilevel[x], multilevel[y])->payload();
+    });
+    root->deleteNode();
+    cout << "Passed 'large' tests" << endl;
+}
+
+/*
+ * Trees bulk loaded from a parent array (with shuffled ids, so parents can
+ * come after their children) must answer queries and keep accepting add_leaf
+ */
+void testBulkLoad() {
+    int numNodes = 20000;
+    int numAdded = 5000;
+
+    for (int i = 0; i < 5; ++i) {
+        vector<int> relabel(numNodes);
+        for (int j = 0; j < numNodes; ++j) {
+            relabel[j] = j;
+        }
+        std::random_shuffle(relabel.begin(), relabel.end());
+
+        vector<int> parents(numNodes, -1);
+        for (int j = 1; j < numNodes; ++j) {
+            // Random recursive trees, and long paths with random branches
+            int parent = (i % 2 == 0) ? rand() % j : std::max(0, j - 1 - rand() % 2);
+            parents[relabel[j]] = relabel[parent];
+        }
+
+        vector<MultilevelTreeNode*> nodes;
+        MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, nodes);
+        assert(root == nodes[relabel[0]]);
+
+        for (int j = 0; j < numAdded; ++j) {
+            MultilevelTreeNode* leaf = new MultilevelTreeNode(numNodes + j);
+            nodes[rand() % nodes.size()]->add_leaf(leaf);
+            nodes.push_back(leaf);
+        }
+
+        for (int j = 0; j < 1000; ++j) {
+            MultilevelTreeNode* x = nodes[rand() % nodes.size()];
+            MultilevelTreeNode* y = nodes[rand() % nodes.size()];
+            assert(MultilevelTreeNode::lca(x, y) == MultilevelTreeNode::naiveLca(x, y));
+            MultilevelTreeNode::caTuple cas1 = MultilevelTreeNode::cas(x, y);
+            MultilevelTreeNode::caTuple cas2 = MultilevelTreeNode::naiveCas(x, y);
+            assert(cas1.lca == cas2.lca && cas1.ca_x == cas2.ca_x && cas1.ca_y == cas2.ca_y);
+        }
+        root->deleteNode();
+    }
+    cout << "Passed 'bulk load' tests" << endl;
+}
+
+/*
+ * delete_leaf and subtree pruning, mixed with add_leaf, keep the answers on
+ * the surviving nodes exact, and the summary tree shrinks with the tree
+ */
+template <typename Node>
+void checkMultilevelQueries(const vector<Node*>& nodes, int numQueries) {
+    for (int j = 0; j < numQueries; ++j) {
+        Node* x = nodes[rand() % nodes.size()];
+        Node* y = nodes[rand() % nodes.size()];
+        if (j % 4 == 0) {
+            for (int steps = rand() % 100; steps > 0 && y->parent; --steps) {
+                y = y->parent;
+            }
+        }
+        assert(Node::lca(x, y) == Node::naiveLca(x, y));
+        typename Node::caTuple cas1 = Node::cas(x, y);
+        typename Node::caTuple cas2 = Node::naiveCas(x, y);
+        assert(cas1.lca == cas2.lca && cas1.ca_x == cas2.ca_x && cas1.ca_y == cas2.ca_y);
+    }
+
+    std::vector<std::pair<Node*, Node*>> queries;
+    for (int j = 0; j < numQueries; ++j) {
+        queries.push_back(std::make_pair(nodes[rand() % nodes.size()], nodes[rand() % nodes.size()]));
+    }
+    std::vector<Node*> batchLca(queries.size());
+    Node::lcaBatch(queries.data(), batchLca.data(), queries.size());
+    for (size_t j = 0; j < queries.size(); ++j) {
+        assert(batchLca[j] == Node::naiveLca(queries[j].first, queries[j].second));
+    }
+}
+
+/* Appends the children of a multilevel node to `nodes`, in order */
+template <typename Node>
+void appendChildren(Node* node, vector<Node*>& nodes) {
+    for (Node* child = node->firstChild; child; child = child->nextSibling) {
+        nodes.push_back(child);
+    }
+}
+
+void testDeletion() {
+    int numNodes = 20000;
+
+    for (int i = 0; i < 4; ++i) {
+        vector<MultilevelTreeNode*> nodes;
+        MultilevelTreeNode* root;
+        if (i % 2 == 0) {
+            treeAndNodes<MultilevelTreeNode> randTree = generateIncrementalMultilevelTree(numNodes, i);
+            root = randTree.tree;
+            nodes = randTree.nodes;
+        } else {
+            // Long paths with random branches, bulk loaded
+            vector<int> parents(numNodes, -1);
+            for (int j = 1; j < numNodes; ++j) {
+                parents[j] = std::max(0, j - 1 - rand() % 3);
+            }
+            root = MultilevelTreeNode::buildFromParents(parents, nodes);
+        }
+        size_t summaryBefore = root->memoryUsage().summaryNodes;
+
+        // nodes[position[id]] is the node with that id, while it lives
+        int nextId = numNodes;
+        vector<int> position(numNodes);
+        for (int j = 0; j < numNodes; ++j) {
+            position[nodes[j]->payload()] = j;
+        }
+        auto forget = [&](MultilevelTreeNode* node) {
+            int k = position[node->payload()];
+            nodes[k] = nodes.back();
+            position[nodes[k]->payload()] = k;
+            nodes.pop_back();
+        };
+
+        for (int round = 0; round < 30; ++round) {
+            // Leaves, found below random nodes
+            for (int j = 0; j < 1000 && nodes.size() > 1; ++j) {
+                MultilevelTreeNode* leaf = nodes[rand() % nodes.size()];
+                while (leaf->firstChild) {
+                    leaf = (rand() % 2) ? leaf->firstChild : leaf->lastChild();
+                }
+                if (leaf != root) {
+                    forget(leaf);
+                    leaf->delete_leaf();
+                }
+            }
+
+            // A subtree of at most a tenth of the tree
+            for (int attempt = 0; attempt < 10; ++attempt) {
+                MultilevelTreeNode* top = nodes[rand() % nodes.size()];
+                vector<MultilevelTreeNode*> subtree(1, top);
+                for (size_t k = 0; k < subtree.size() && subtree.size() <= nodes.size() / 10; ++k) {
+                    appendChildren(subtree[k], subtree);
+                }
+                if (top == root || subtree.size() > nodes.size() / 10) {
+                    continue;
+                }
+                for (MultilevelTreeNode* node : subtree) {
+                    forget(node);
+                }
+                top->deleteNode();
+                break;
+            }
+
+            // New leaves, fewer than the deleted nodes until the last rounds
+            int numAdded = (round < 20) ? 200 : 1000;
+            for (int j = 0; j < numAdded; ++j) {
+                MultilevelTreeNode* leaf = new MultilevelTreeNode(nextId++);
+                position.push_back(nodes.size());
+                nodes[rand() % nodes.size()]->add_leaf(leaf);
+                nodes.push_back(leaf);
+            }
+
+            checkMultilevelQueries(nodes, 300);
+            assert(root->memoryUsage().numNodes == nodes.size());
+
+            if (round == 19) {
+                // Down to a small part of the tree, with a summary tree to match
+                assert(nodes.size() < (size_t) numNodes / 4);
+                assert(root->memoryUsage().summaryNodes < summaryBefore / 2);
+            }
+        }
+        root->deleteNode();
+    }
+
+    // Emptying a tree leaf by leaf, in reverse preorder, down to its root
+    treeAndNodes<MultilevelTreeNode> randTree = generateIncrementalMultilevelTree(1000, 7);
+    vector<MultilevelTreeNode*> preorder(1, randTree.tree);
+    for (size_t k = 0; k < preorder.size(); ++k) {
+        appendChildren(preorder[k], preorder);
+    }
+    for (int j = preorder.size() - 1; j > 0; --j) {
+        preorder[j]->delete_leaf();
+        if (j % 50 == 0) {
+            checkMultilevelQueries(vector<MultilevelTreeNode*>(preorder.begin(), preorder.begin() + j), 100);
+        }
+    }
+    assert(randTree.tree->memoryUsage().numNodes == 1 && !randTree.tree->firstChild);
+    randTree.tree->delete_leaf();
+
+    // Leaves of a star, last child first: each one is unlinked from the
+    // child lists of the center in O(1) time, not found by a scan of them
+    int numLeaves = 100000;
+    ExpensiveTreeNode* center = new ExpensiveTreeNode(0);
+    vector<ExpensiveTreeNode*> leaves;
+    for (int j = 1; j <= numLeaves; ++j) {
+        leaves.push_back(new ExpensiveTreeNode(j));
+        center->add_leaf(leaves.back());
+    }
+    for (int j = numLeaves - 1; j >= 10; --j) {
+        leaves[j]->deleteNode();
+    }
+    leaves.resize(10);
+    assert(center->uncompressedChildren.size() == leaves.size());
+    for (int j = 0; j < 10; ++j) {
+        assert(ExpensiveTreeNode::lca(leaves[j], leaves[(j + 1) % 10]) == center);
+        assert(ExpensiveTreeNode::lca(leaves[j], center) == center);
+    }
+    leaves[3]->deleteNode();
+    assert(center->uncompressedChildren.size() == 9 && center->memoryUsage().numNodes == 10);
+    center->deleteNode();
+
+    cout << "Passed 'deletion' tests" << endl;
+}
+
+/*
+ * link joins random fragments, built statically, with add_leaf or in bulk,
+ * until one tree is left. While they are apart, queries across two trees
+ * answer NULL.
+ */
+void checkExpensiveQueries(const vector<ExpensiveTreeNode*>& nodes, int numQueries) {
+    std::vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> queries;
+    for (int j = 0; j < numQueries; ++j) {
+        ExpensiveTreeNode* x = nodes[rand() % nodes.size()];
+        ExpensiveTreeNode* y = nodes[rand() % nodes.size()];
+        ExpensiveTreeNode::caTuple cas1 = ExpensiveTreeNode::cas(x, y);
+        ExpensiveTreeNode::caTuple cas2 = ExpensiveTreeNode::naiveCas(x, y);
+        assert(cas1.lca == cas2.lca && cas1.ca_x == cas2.ca_x && cas1.ca_y == cas2.ca_y);
+        queries.push_back(std::make_pair(x, y));
+    }
+
+    std::vector<ExpensiveTreeNode*> batchLca(queries.size());
+    ExpensiveTreeNode::lcaBatch(queries.data(), batchLca.data(), queries.size());
+    for (size_t j = 0; j < queries.size(); ++j) {
+        assert(batchLca[j] == ExpensiveTreeNode::naiveLca(queries[j].first, queries[j].second));
+    }
+}
+
+ExpensiveTreeNode* treeParent(ExpensiveTreeNode* node) {return node->uncompressedParent;}
+
+template <typename Word>
+BasicMultilevelTreeNode<Word>* treeParent(BasicMultilevelTreeNode<Word>* node) {return node->parent;}
+
+/* Compares depth, distance and levelAncestor with walking up the parents */
+template <typename Node>
+void checkLevelAncestors(const vector<Node*>& nodes, int numQueries) {
+    for (int j = 0; j < numQueries; ++j) {
+        Node* x = nodes[rand() % nodes.size()];
+        Node* y = nodes[rand() % nodes.size()];
+        vector<Node*> xPath; // x and its ancestors, going up
+        for (Node* node = x; node; node = treeParent(node)) {
+            xPath.push_back(node);
+        }
+        int xDepth = xPath.size() - 1;
+        assert(x->depth() == xDepth);
+
+        int k = rand() % (xDepth + 2);
+        assert(Node::levelAncestor(x, k) == (k <= xDepth ? xPath[k] : NULL));
+        assert(Node::levelAncestor(x, -1) == NULL);
+
+        Node* lca = Node::naiveLca(x, y);
+        int yDepth = 0;
+        for (Node* node = y; treeParent(node); node = treeParent(node)) {
+            yDepth++;
+        }
+        int lcaDepth = 0;
+        for (Node* node = lca; node && treeParent(node); node = treeParent(node)) {
+            lcaDepth++;
+        }
+        assert(Node::distance(x, y) == (lca ? xDepth + yDepth - 2 * lcaDepth : -1));
+    }
+}
+
+void testLink() {
+    int numFragments = 40;
+
+    for (int i = 0; i < 3; ++i) {
+        vector<ExpensiveTreeNode*> roots;
+        vector<vector<ExpensiveTreeNode*>> members;
+        vector<ExpensiveTreeNode*> allNodes;
+        for (int f = 0; f < numFragments; ++f) {
+            int size = (f % 4 == 0) ? 1 + rand() % 10 : 1 + rand() % 2000;
+            treeAndNodes<ExpensiveTreeNode> fragment = (f % 2 == 0) ? generateStaticTree(size, 100 * i + f)
+                                                                    : generateIncrementalTree(size, 100 * i + f);
+            if (f % 2 == 0) {
+                fragment.tree->preprocess();
+            }
+            roots.push_back(fragment.tree);
+            members.push_back(fragment.nodes);
+            allNodes.insert(allNodes.end(), fragment.nodes.begin(), fragment.nodes.end());
+        }
+        checkExpensiveQueries(allNodes, 1000);
+
+        while (roots.size() > 1) {
+            int a = rand() % roots.size();
+            int b = (a + 1 + rand() % (roots.size() - 1)) % roots.size();
+            members[a][rand() % members[a].size()]->link(roots[b]);
+            members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+            roots.erase(roots.begin() + b);
+            members.erase(members.begin() + b);
+            checkExpensiveQueries(allNodes, 200);
+            checkLevelAncestors(allNodes, 100);
+        }
+
+        // The joined tree keeps growing with add_leaf
+        for (int j = 0; j < 1000; ++j) {
+            ExpensiveTreeNode* leaf = new ExpensiveTreeNode(allNodes.size());
+            allNodes[rand() % allNodes.size()]->add_leaf(leaf);
+            allNodes.push_back(leaf);
+        }
+        checkExpensiveQueries(allNodes, 1000);
+        checkLevelAncestors(allNodes, 1000);
+        roots[0]->deleteNode();
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        vector<MultilevelTreeNode*> roots;
+        vector<vector<MultilevelTreeNode*>> members;
+        vector<MultilevelTreeNode*> allNodes;
+        for (int f = 0; f < numFragments; ++f) {
+            // Fragments below twoSubtreeMaxSize nodes have no summary tree
+            int size = (f % 3 == 0) ? 1 + rand() % MultilevelTreeNode::twoSubtreeMaxSize : 1 + rand() % 3000;
+            vector<MultilevelTreeNode*> nodes;
+            if (f % 2 == 0) {
+                nodes = generateIncrementalMultilevelTree(size, 100 * i + f).nodes;
+            } else {
+                vector<int> parents(size, -1);
+                for (int j = 1; j < size; ++j) {
+                    parents[j] = rand() % j;
+                }
+                MultilevelTreeNode::buildFromParents(parents, nodes);
+            }
+            roots.push_back(nodes[0]);
+            members.push_back(nodes);
+            allNodes.insert(allNodes.end(), nodes.begin(), nodes.end());
+        }
+        checkMultilevelQueries(allNodes, 1000);
+
+        while (roots.size() > 1) {
+            int a = rand() % roots.size();
+            int b = (a + 1 + rand() % (roots.size() - 1)) % roots.size();
+            members[a][rand() % members[a].size()]->link(roots[b]);
+            members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+            roots.erase(roots.begin() + b);
+            members.erase(members.begin() + b);
+            checkMultilevelQueries(allNodes, 200);
+            checkLevelAncestors(allNodes, 100);
+        }
+        assert(roots[0]->memoryUsage().numNodes == allNodes.size());
+
+        // add_leaf and deletions carry on in the joined tree
+        for (int j = 0; j < 1000; ++j) {
+            MultilevelTreeNode* leaf = new MultilevelTreeNode(allNodes.size());
+            allNodes[rand() % allNodes.size()]->add_leaf(leaf);
+            allNodes.push_back(leaf);
+        }
+        for (int j = 0; j < 2000; ++j) {
+            size_t k = rand() % allNodes.size();
+            if (!allNodes[k]->firstChild && allNodes[k] != roots[0]) {
+                allNodes[k]->delete_leaf();
+                allNodes[k] = allNodes.back();
+                allNodes.pop_back();
+            }
+        }
+        checkMultilevelQueries(allNodes, 1000);
+        checkLevelAncestors(allNodes, 1000);
+        roots[0]->deleteNode();
+    }
+
+    // A large tree linked below a small tree, again and again: only the
+    // small trees are relabelled (their ancestor tables refilled), so all
+    // the links together relabel fewer nodes than the large tree has, where
+    // relabelling it at every link would take quadratic work
+    int largeSize = 20000;
+    int numLinks = 200;
+    int smallSize = 5;
+    {
+        treeAndNodes<ExpensiveTreeNode> large = generateIncrementalTree(largeSize, 7);
+        vector<ExpensiveTreeNode*> allNodes = large.nodes;
+        vector<vector<ExpensiveTreeNode*>> smallTrees(numLinks);
+        for (int k = 0; k < numLinks; ++k) {
+            for (int j = 0; j < smallSize; ++j) {
+                ExpensiveTreeNode* node = new ExpensiveTreeNode(allNodes.size());
+                if (j > 0) {
+                    smallTrees[k][rand() % j]->add_leaf(node);
+                }
+                smallTrees[k].push_back(node);
+                allNodes.push_back(node);
+            }
+        }
+
+        LcaStats::reset();
+        ExpensiveTreeNode* root = large.tree;
+        for (int k = 0; k < numLinks; ++k) {
+            smallTrees[k][rand() % smallSize]->link(root);
+            root = smallTrees[k][0];
+        }
+        if (LcaStats::enabled()) {
+            assert(LcaStats::filledAncestorTables() < (uint64_t) largeSize);
+        }
+        checkExpensiveQueries(allNodes, 2000);
+        checkLevelAncestors(allNodes, 1000);
+        root->deleteNode();
+    }
+    {
+        // The summary trees are linked the same way
+        vector<int> parents(largeSize, -1);
+        for (int j = 1; j < largeSize; ++j) {
+            parents[j] = rand() % j;
+        }
+        vector<MultilevelTreeNode*> allNodes;
+        MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, allNodes);
+        vector<vector<MultilevelTreeNode*>> smallTrees(numLinks);
+        for (int k = 0; k < numLinks; ++k) {
+            for (int j = 0; j < smallSize; ++j) {
+                MultilevelTreeNode* node = new MultilevelTreeNode(allNodes.size());
+                if (j > 0) {
+                    smallTrees[k][rand() % j]->add_leaf(node);
+                }
+                smallTrees[k].push_back(node);
+                allNodes.push_back(node);
+            }
+        }
+
+        LcaStats::reset();
+        for (int k = 0; k < numLinks; ++k) {
+            smallTrees[k][rand() % smallSize]->link(root);
+            root = smallTrees[k][0];
+        }
+        if (LcaStats::enabled()) {
+            // A few summary nodes for each link, out of hundreds
+            assert(LcaStats::filledAncestorTables() < (uint64_t) 10 * numLinks);
+        }
+        checkMultilevelQueries(allNodes, 2000);
+        checkLevelAncestors(allNodes, 1000);
+        root->deleteNode();
+    }
+    cout << "Passed 'link' tests" << endl;
+}
+
+/*
+ * Every 2-subtree width answers like the naive algorithms, through add_leaf,
+ * bulk loading, deletions and link, and wider 2-subtrees need fewer
+ * summary nodes
+ */
+template <typename Word>
+size_t checkWordWidth(int numNodes, unsigned seed) {
+    typedef BasicMultilevelTreeNode<Word> Node;
+    assert(Node::twoSubtreeMaxSize == MicroWord<Word>::bits);
+
+    // Random recursive trees with long paths, so that 2-subtrees fill up
+    srand(seed);
+    vector<int> parents(numNodes, -1);
+    for (int j = 1; j < numNodes; ++j) {
+        parents[j] = (j % 3 == 0) ? rand() % j : std::max(0, j - 1 - rand() % 2);
+    }
+
+    vector<Node*> nodes(1, new Node(0));
+    for (int j = 1; j < numNodes; ++j) {
+        nodes.push_back(new Node(j));
+        nodes[parents[j]]->add_leaf(nodes[j]);
+    }
+    checkMultilevelQueries(nodes, 2000);
+    checkLevelAncestors(nodes, 500);
+    size_t summaryNodes = nodes[0]->memoryUsage().summaryNodes;
+
+    vector<Node*> bulkNodes;
+    Node* bulkRoot = Node::buildFromParents(parents, bulkNodes);
+    checkMultilevelQueries(bulkNodes, 2000);
+    checkLevelAncestors(bulkNodes, 500);
+
+    // Leaves and a subtree deleted, then the bulk-loaded tree linked below
+    for (int j = 0; j < numNodes / 4; ++j) {
+        size_t k = 1 + rand() % (nodes.size() - 1);
+        if (!nodes[k]->firstChild) {
+            nodes[k]->delete_leaf();
+            nodes[k] = nodes.back();
+            nodes.pop_back();
+        }
+    }
+    Node* top = nodes[1 + rand() % (nodes.size() - 1)];
+    vector<Node*> subtree(1, top);
+    for (size_t k = 0; k < subtree.size(); ++k) {
+        appendChildren(subtree[k], subtree);
+    }
+    std::sort(subtree.begin(), subtree.end());
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&](Node* node) {
+                    return std::binary_search(subtree.begin(), subtree.end(), node);
+                }), nodes.end());
+    top->deleteNode();
+    checkMultilevelQueries(nodes, 2000);
+    checkLevelAncestors(nodes, 500);
+
+    nodes[rand() % nodes.size()]->link(bulkRoot);
+    nodes.insert(nodes.end(), bulkNodes.begin(), bulkNodes.end());
+    checkMultilevelQueries(nodes, 2000);
+    checkLevelAncestors(nodes, 500);
+    assert(nodes[0]->memoryUsage().numNodes == nodes.size());
+    nodes[0]->deleteNode();
+    return summaryNodes;
+}
+
+void testWordWidths() {
+    for (unsigned seed = 0; seed < 3; ++seed) {
+        size_t summary32 = checkWordWidth<uint32_t>(20000, seed);
+        size_t summary64 = checkWordWidth<uint64_t>(20000, seed);
+        size_t summary128 = checkWordWidth<unsigned __int128>(20000, seed);
+        size_t summary256 = checkWordWidth<Word256>(20000, seed);
+        size_t summary512 = checkWordWidth<Word512>(20000, seed);
+        assert(summary32 > summary64 && summary64 > summary128 && summary128 > summary256 && summary256 > summary512);
+    }
+    cout << "Passed 'word width' tests" << endl;
+}
+
+/*
+ * Level ancestors up paths far longer than a 2-subtree or a heavy path,
+ * in static, parallel-preprocessed and incremental trees; link, deletions
+ * and every 2-subtree width are covered by testLink and testWordWidths
+ */
+void testLevelAncestors() {
+    int pathLength = 200000;
+    vector<int> parents = parentArray(caterpillarInsertionSeq(pathLength, 0));
+    vector<MultilevelTreeNode*> pathNodes;
+    MultilevelTreeNode::buildFromParents(parents, pathNodes);
+    MultilevelTreeNode* bottom = pathNodes.back();
+    assert(bottom->depth() == pathLength - 1);
+    for (int k = 0; k < pathLength; ++k) {
+        assert(MultilevelTreeNode::levelAncestor(bottom, k) == pathNodes[pathLength - 1 - k]);
+    }
+    assert(MultilevelTreeNode::levelAncestor(bottom, pathLength) == NULL);
+    assert(MultilevelTreeNode::distance(pathNodes[1000], bottom) == pathLength - 1001);
+    checkLevelAncestors(pathNodes, 200);
+    pathNodes[0]->deleteNode();
+
+    pathLength = 20000;
+    vector<ExpensiveTreeNode*> expensivePath(1, new ExpensiveTreeNode(0));
+    for (int i = 1; i < pathLength; ++i) {
+        expensivePath.push_back(new ExpensiveTreeNode(i));
+        expensivePath[i - 1]->add_leaf(expensivePath[i]);
+    }
+    for (int k = 0; k < pathLength; ++k) {
+        assert(ExpensiveTreeNode::levelAncestor(expensivePath.back(), k) == expensivePath[pathLength - 1 - k]);
+    }
+    expensivePath[0]->deleteNode();
+
+    TaskScheduler scheduler(4);
+    for (int i = 0; i < 3; ++i) {
+        vector<int> randomParents(30000, -1);
+        for (size_t j = 1; j < randomParents.size(); ++j) {
+            randomParents[j] = (j % 2 == 0) ? rand() % j : j - 1;
+        }
+        ExpensiveTreeNode::setScheduler(i == 2 ? &scheduler : NULL);
+        vector<ExpensiveTreeNode*> nodes = buildRecursiveTree(randomParents, i == 1);
+        ExpensiveTreeNode::setScheduler(NULL);
+        checkLevelAncestors(nodes, 1000);
+        nodes[0]->deleteNode();
+
+        vector<MultilevelTreeNode*> multilevelNodes(1, new MultilevelTreeNode(0));
+        for (size_t j = 1; j < randomParents.size(); ++j) {
+            multilevelNodes.push_back(new MultilevelTreeNode(j));
+            multilevelNodes[randomParents[j]]->add_leaf(multilevelNodes[j]);
+        }
+        checkLevelAncestors(multilevelNodes, 1000);
+        multilevelNodes[0]->deleteNode();
+    }
+    cout << "Passed 'level ancestor' tests" << endl;
+}
+
+/*
+ * add_leaves with batches of 1 to 30000 leaves, many of them below leaves of
+ * the same batch, on random trees, long chains and wide stars (all leaves
+ * under the same few parents), then with parallel recompressions
+ */
+void testAddLeaves() {
+    TaskScheduler scheduler(4);
+    int batchSizes[] = {1, 7, 100, 5000, 30000};
+    int numNodes = 60000;
+    for (int i = 0; i < 4; ++i) {
+        vector<int> parents(numNodes, -1);
+        for (int j = 1; j < numNodes; ++j) {
+            if (i == 1) {
+                parents[j] = (j % 50 == 0) ? rand() % j : j - 1;
+            } else if (i == 2) {
+                parents[j] = rand() % std::min(j, 20);
+            } else {
+                parents[j] = rand() % j;
+            }
+        }
+        ExpensiveTreeNode::setScheduler(i == 3 ? &scheduler : NULL);
+
+        vector<ExpensiveTreeNode*> nodes(1, new ExpensiveTreeNode(0));
+        vector<MultilevelTreeNode*> multilevelNodes(1, new MultilevelTreeNode(0));
+        for (int j = 1, b = i; j < numNodes; ++b) {
+            int end = std::min(numNodes, j + batchSizes[b % 5]);
+            vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> batch;
+            vector<std::pair<MultilevelTreeNode*, MultilevelTreeNode*>> multilevelBatch;
+            for (; j < end; ++j) {
+                nodes.push_back(new ExpensiveTreeNode(j));
+                batch.push_back(std::make_pair(nodes[parents[j]], nodes[j]));
+                multilevelNodes.push_back(new MultilevelTreeNode(j));
+                multilevelBatch.push_back(std::make_pair(multilevelNodes[parents[j]], multilevelNodes[j]));
+            }
+            ExpensiveTreeNode::add_leaves(batch.data(), batch.size());
+            MultilevelTreeNode::add_leaves(multilevelBatch.data(), multilevelBatch.size());
+            checkExpensiveQueries(nodes, 200);
+            checkMultilevelQueries(multilevelNodes, 200);
+        }
+        ExpensiveTreeNode::setScheduler(NULL);
+        checkLevelAncestors(nodes, 500);
+        checkLevelAncestors(multilevelNodes, 500);
+
+        // Single leaves still go in as before
+        for (int j = 0; j < 1000; ++j) {
+            nodes.push_back(new ExpensiveTreeNode(numNodes + j));
+            nodes[rand() % nodes.size()]->add_leaf(nodes.back());
+        }
+        checkExpensiveQueries(nodes, 500);
+        nodes[0]->deleteNode();
+        multilevelNodes[0]->deleteNode();
+    }
+    cout << "Passed 'add_leaves' tests" << endl;
+}
+
+/*
+ * The Euler tour structure must answer like the trees it is built from,
+ * from a parent array, an ExpensiveTreeNode tree and a live multilevel
+ * tree, and reject anything that is not one tree on the ids 0, ..., n - 1
+ */
+void checkEulerTour(const EulerTourLca& euler, const vector<int>& parents, int numQueries) {
+    vector<std::pair<NodeId, NodeId>> queries;
+    for (int j = 0; j < numQueries; ++j) {
+        queries.push_back(std::make_pair(rand() % parents.size(), rand() % parents.size()));
+    }
+    vector<NodeId> batchLca(queries.size());
+    euler.lcaBatch(queries.data(), batchLca.data(), queries.size());
+
+    vector<int> depth(parents.size(), -1);
+    for (int j = 0; j < numQueries; ++j) {
+        // Naive LCA on the parent array: mark the ancestors of x, then walk up from y
+        NodeId x = queries[j].first;
+        NodeId y = queries[j].second;
+        for (NodeId node = x; node >= 0; node = parents[node]) {
+            depth[node] = j;
+        }
+        NodeId expected = y;
+        while (depth[expected] != j) {
+            expected = parents[expected];
+        }
+        assert(euler.lca(x, y) == expected);
+        assert(batchLca[j] == expected);
+    }
+}
+
+void testEulerTour() {
+    EulerTourLca euler;
+    assert(euler.build(vector<int>(1, -1)));
+    assert(euler.lca(0, 0) == 0);
+    assert(euler.lca(0, 1) == EulerTourLca::NO_NODE && euler.lca(-1, 0) == EulerTourLca::NO_NODE);
+
+    // Random trees with small and large fan-outs, and paths deeper than any
+    // recursion could go
+    for (int i = 0; i < 4; ++i) {
+        int numNodes = (i < 2) ? 1 + rand() % 100 : 200000 + rand() % 100;
+        vector<int> parents(numNodes, -1);
+        for (int j = 1; j < numNodes; ++j) {
+            parents[j] = (i % 2 == 0) ? rand() % j : std::max(0, j - 1 - rand() % 3);
+        }
+        // Ids in a random order, with the root anywhere
+        vector<int> ids(numNodes);
+        for (int j = 0; j < numNodes; ++j) {
+            ids[j] = j;
+        }
+        std::random_shuffle(ids.begin(), ids.end());
+        vector<int> shuffled(numNodes);
+        for (int j = 0; j < numNodes; ++j) {
+            shuffled[ids[j]] = (parents[j] < 0) ? -1 : ids[parents[j]];
+        }
+        assert(euler.build(shuffled) && euler.numNodes() == (size_t) numNodes);
+        checkEulerTour(euler, shuffled, 5000);
+    }
+    vector<int> path = parentArray(caterpillarInsertionSeq(1000000, 0));
+    assert(euler.build(path));
+    assert(euler.lca(999999, 500000) == 500000 && euler.lca(1, 999999) == 1);
+
+    // From the uncompressed tree of an ExpensiveTreeNode tree
+    vector<int> parents(30000, -1);
+    for (size_t j = 1; j < parents.size(); ++j) {
+        parents[j] = rand() % j;
+    }
+    vector<ExpensiveTreeNode*> nodes = buildRecursiveTree(parents, true);
+    assert(euler.build(nodes[0]));
+    for (int j = 0; j < 5000; ++j) {
+        ExpensiveTreeNode* x = nodes[rand() % nodes.size()];
+        ExpensiveTreeNode* y = nodes[rand() % nodes.size()];
+        assert(euler.lca(x->payload(), y->payload()) == ExpensiveTreeNode::lca(x, y)->payload());
+    }
+    nodes[0]->deleteNode();
+
+    // From a live multilevel tree, which goes on taking leaves afterwards
+    vector<MultilevelTreeNode*> multilevelNodes;
+    MultilevelTreeNode::buildFromParents(parents, multilevelNodes);
+    assert(euler.build(multilevelNodes[0]));
+    checkEulerTour(euler, parents, 5000);
+    multilevelNodes.push_back(new MultilevelTreeNode(parents.size()));
+    multilevelNodes[7]->add_leaf(multilevelNodes.back());
+    parents.push_back(7);
+    assert(euler.build(multilevelNodes[0]));
+    checkEulerTour(euler, parents, 5000);
+
+    // Ids that are not 0, ..., n - 1 after a deletion, and trees that are not
+    size_t deleted = 1;
+    while (multilevelNodes[deleted]->firstChild) {
+        deleted++;
+    }
+    multilevelNodes[deleted]->delete_leaf();
+    assert(!euler.build(multilevelNodes[0]) && euler.numNodes() == 0);
+    assert(euler.lca(0, 0) == EulerTourLca::NO_NODE);
+    multilevelNodes[0]->deleteNode();
+    int twoRoots[] = {-1, 0, -1};
+    int cycle[] = {-1, 2, 1};
+    int outOfRange[] = {-1, 3, 0};
+    assert(!euler.build(vector<int>(twoRoots, twoRoots + 3)));
+    assert(!euler.build(vector<int>(cycle, cycle + 3)));
+    assert(!euler.build(vector<int>(outOfRange, outOfRange + 3)));
+    assert(!euler.build(vector<int>()));
+    cout << "Passed 'Euler tour' tests" << endl;
+}
+
+/* Snapshots must answer exactly like the trees they were saved from */
+void testSnapshot() {
+    const char* path = "lca_test_snapshot.bin";
+    int numNodes = 1000;
+
+    for (int incremental = 0; incremental < 2; ++incremental) {
+        treeAndNodes<ExpensiveTreeNode> randTree = incremental ? generateIncrementalTree(numNodes, 1)
+                                                               : generateStaticTree(numNodes, 0);
+        if (!incremental) {
+            randTree.tree->preprocess();
+        }
+        assert(LcaSnapshot::save(randTree.tree, path));
+
+        LcaSnapshot snapshot;
+        assert(snapshot.load(path));
+        assert(snapshot.kind() == LcaSnapshot::expensiveTree);
+        assert(snapshot.numNodes() == (size_t) numNodes);
+        for (int j = 0; j < 1000; ++j) {
+            int nodeX = rand() % numNodes;
+            int nodeY = rand() % numNodes;
+            assert(snapshot.lca(nodeX, nodeY) == ExpensiveTreeNode::lca(randTree.nodes[nodeX], randTree.nodes[nodeY])->payload());
+        }
+        assert(snapshot.lca(0, numNodes) == LcaSnapshot::NO_NODE);
+        randTree.tree->deleteNode();
+    }
+
+    // Multilevel trees, with and without a summary tree
+    for (int size = 50; size <= 50000; size *= 1000) {
+        vector<int> parents(size, -1);
+        for (int j = 1; j < size; ++j) {
+            parents[j] = rand() % j;
+        }
+        vector<MultilevelTreeNode*> nodes;
+        MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, nodes);
+        for (int j = 0; j < size / 10; ++j) {
+            MultilevelTreeNode* leaf = new MultilevelTreeNode(nodes.size());
+            nodes[rand() % nodes.size()]->add_leaf(leaf);
+            nodes.push_back(leaf);
+        }
+        assert(LcaSnapshot::save(root, path));
+
+        // Two mappings of the same file, as two processes would have
+        LcaSnapshot first;
+        LcaSnapshot second;
+        assert(first.load(path) && second.load(path));
+        assert(first.kind() == LcaSnapshot::multilevelTree);
+        for (int j = 0; j < 1000; ++j) {
+            int nodeX = rand() % nodes.size();
+            int nodeY = rand() % nodes.size();
+            NodeId expected = MultilevelTreeNode::lca(nodes[nodeX], nodes[nodeY])->payload();
+            assert(first.lca(nodeX, nodeY) == expected);
+            assert(second.lca(nodeX, nodeY) == expected);
+        }
+        root->deleteNode();
+    }
+
+    // Ids must be 0, ..., n - 1, and damaged files are rejected
+    ExpensiveTreeNode* root = new ExpensiveTreeNode(0);
+    root->add_leaf(new ExpensiveTreeNode(2));
+    assert(!LcaSnapshot::save(root, path));
+    root->deleteNode();
+
+    LcaSnapshot snapshot;
+    FILE* file = fopen(path, "r+b");
+    fputc('X', file);
+    fclose(file);
+    assert(!snapshot.load(path));
+    assert(!snapshot.loaded());
+    remove(path);
+    assert(!snapshot.load(path));
+
+    cout << "Passed 'snapshot' tests" << endl;
+}
+
+/* Generated workloads depend only on the seed, and survive a round trip through files */
+void testWorkloadGenerator() {
+    const char* insertionPath = "lca_test_insertions.bin";
+    const char* queryPath = "lca_test_queries.bin";
+    int numNodes = 200000; // several chunks
+    TaskScheduler scheduler(4);
+
+    for (int shape = pathShape; shape <= pruferShape; ++shape) {
+        vector<int> parents = shapeParents((TreeShape) shape, numNodes, 3, 42);
+        assert(parents == shapeParents((TreeShape) shape, numNodes, 3, 42, &scheduler));
+        assert(parents[0] == -1);
+        for (int i = 1; i < numNodes; ++i) {
+            assert(parents[i] >= 0 && parents[i] < i);
+        }
+    }
+    assert(shapeParents(recursiveShape, numNodes, 0, 1) != shapeParents(recursiveShape, numNodes, 0, 2));
+
+    // Uniform labeled trees: 12 of the 16 trees on 4 nodes are paths, the others are stars
+    int stars = 0;
+    for (int seed = 0; seed < 4000; ++seed) {
+        vector<int> parents = shapeParents(pruferShape, 4, 0, seed);
+        vector<int> degree(4, 0);
+        for (int v = 1; v < 4; ++v) {
+            degree[v] += 1;
+            degree[parents[v]] += 1;
+        }
+        stars += *std::max_element(degree.begin(), degree.end()) == 3;
+    }
+    assert(abs(stars - 1000) < 150);
+
+    vector<int> parents = shapeParents(pruferShape, numNodes, 0, 7, &scheduler);
+    for (int order = idOrder; order <= randomOrder; ++order) {
+        vector<int> insertions = insertionOrder(parents, (InsertionOrder) order, 8);
+        assert(writeInsertions(insertionPath, parents, insertions, 8));
+        vector<int> readParents;
+        vector<int> readOrder;
+        assert(readInsertions(insertionPath, readParents, readOrder));
+        assert(readParents == parents && readOrder == insertions);
+    }
+
+    for (int distribution = uniformQueries; distribution <= subtreeQueries; ++distribution) {
+        int numQueries = 300000;
+        vector<std::pair<int, int>> queries = generateQueries(parents, (QueryDistribution) distribution, numQueries, 1.1, 9);
+        assert(queries == generateQueries(parents, (QueryDistribution) distribution, numQueries, 1.1, 9, &scheduler));
+        assert(streamQueries(queryPath, parents, (QueryDistribution) distribution, numQueries, 1.1, 9, &scheduler));
+        vector<std::pair<int, int>> readBack;
+        int readNodes = 0;
+        assert(readQueries(queryPath, readBack, readNodes));
+        assert(readBack == queries && readNodes == numNodes);
+    }
+
+    // Truncated files and files of the wrong kind are rejected
+    vector<std::pair<int, int>> queries;
+    int readNodes;
+    assert(!readQueries(insertionPath, queries, readNodes));
+    FILE* file = fopen(queryPath, "r+b");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    assert(truncate(queryPath, size - 1) == 0);
+    assert(!readQueries(queryPath, queries, readNodes));
+
+    // Headers announcing 2^31 - 1 records are rejected before anything is
+    // allocated for them
+    unsigned char count[8] = {0xFF, 0xFF, 0xFF, 0x7F, 0, 0, 0, 0};
+    const char* paths[] = {insertionPath, queryPath};
+    for (const char* path : paths) {
+        file = fopen(path, "r+b");
+        fseek(file, 16, SEEK_SET);
+        fwrite(count, 1, 8, file);
+        fwrite(count, 1, 8, file); // the number of nodes
+        fclose(file);
+    }
+    vector<int> readParents;
+    vector<int> readOrder;
+    assert(!readInsertions(insertionPath, readParents, readOrder));
+    assert(!readQueries(queryPath, queries, readNodes));
+    remove(insertionPath);
+    remove(queryPath);
+
+    cout << "Passed 'workload generator' tests" << endl;
+}
+
+/* memoryUsage counts every node, and the summary tree only once it exists */
+void testMemoryUsage() {
+    int numNodes = 1000;
+    treeAndNodes<ExpensiveTreeNode> staticTree = generateStaticTree(numNodes, 3);
+    MemoryUsage before = staticTree.tree->memoryUsage();
+    staticTree.tree->preprocess();
+    MemoryUsage after = staticTree.tree->memoryUsage();
+    assert(before.numNodes == (size_t) numNodes && after.numNodes == (size_t) numNodes);
+    assert(before.ancestorTables == 0 && after.ancestorTables >= numNodes * sizeof(ExpensiveTreeNode*));
+    assert(after.nodes == numNodes * sizeof(ExpensiveTreeNode) && after.subtreeIndex == 0 && after.summaryNodes == 0);
+    assert(after.total() == after.nodes + after.childLists + after.ancestorTables);
+
+    // Run-compressed tables take far less than full-width tables of 32-bit entries
+    size_t fullTables = numNodes * FatPreorder::tableWidth(numNodes) * sizeof(uint32_t);
+    assert(after.ancestorTables < fullTables / 2);
+    staticTree.tree->deleteNode();
+
+    // Slots left behind by recompressions are reclaimed as the tree grows
+    treeAndNodes<ExpensiveTreeNode> incrementalTree = generateIncrementalTree(numNodes, 3);
+    assert(incrementalTree.tree->memoryUsage().ancestorTables < fullTables / 2);
+    incrementalTree.tree->deleteNode();
+
+    MultilevelTreeNode* root = new MultilevelTreeNode(0);
+    vector<MultilevelTreeNode*> nodes(1, root);
+    for (int i = 1; i < numNodes; ++i) {
+        nodes.push_back(new MultilevelTreeNode(i));
+        nodes[rand() % i]->add_leaf(nodes.back());
+        MemoryUsage usage = root->memoryUsage();
+        assert(usage.numNodes == (size_t) i + 1);
+        assert((usage.summaryNodes > 0) == (i + 1 >= MultilevelTreeNode::twoSubtreeMaxSize));
+        assert(usage.ancestorTables == 0 && usage.subtreeIndex >= (i + 1) * sizeof(MultilevelTreeNode*));
+    }
+    root->deleteNode();
+
+    cout << "Passed 'memory usage' tests" << endl;
+}
+
+/* A payload with data of its own, for testPayloads */
+struct NodeLabel {
+    std::string name;
+    explicit NodeLabel(int id) : name("node " + std::to_string(id)) {}
+};
+
+/*
+ * Trees with a payload of any type give the same answers as trees with ids,
+ * built alongside them, and an empty payload (as in summary nodes) takes no
+ * space in the node
+ */
+void testPayloads() {
+    assert(sizeof(BasicExpensiveTreeNode<NoPayload>) + sizeof(NodeId) <= sizeof(ExpensiveTreeNode));
+    assert(sizeof(BasicMultilevelTreeNode<uint64_t, NoPayload>) + sizeof(NodeId) <= sizeof(MultilevelTreeNode));
+
+    typedef BasicExpensiveTreeNode<NoPayload> BareNode;
+    typedef BasicMultilevelTreeNode<uint64_t, NoPayload> BareMultilevelNode;
+    typedef BasicExpensiveTreeNode<NodeLabel> LabelledNode;
+    typedef BasicMultilevelTreeNode<uint64_t, NodeLabel> LabelledMultilevelNode;
+    int numNodes = 3000;
+    vector<ExpensiveTreeNode*> nodes(1, new ExpensiveTreeNode(0));
+    vector<BareNode*> bareNodes(1, new BareNode(NoPayload()));
+    vector<LabelledNode*> labelledNodes(1, new LabelledNode(NodeLabel(0)));
+    vector<MultilevelTreeNode*> multilevel(1, new MultilevelTreeNode(0));
+    vector<BareMultilevelNode*> bareMultilevel(1, new BareMultilevelNode(NoPayload()));
+    vector<LabelledMultilevelNode*> labelledMultilevel(1, new LabelledMultilevelNode(NodeLabel(0)));
+    std::map<BareNode*, NodeId> bareIds;
+    std::map<BareMultilevelNode*, NodeId> bareMultilevelIds;
+    bareIds[bareNodes[0]] = 0;
+    bareMultilevelIds[bareMultilevel[0]] = 0;
+    for (int i = 1; i < numNodes; ++i) {
+        int parent = rand() % i;
+        nodes.push_back(new ExpensiveTreeNode(i));
+        nodes[parent]->add_leaf(nodes[i]);
+        bareNodes.push_back(new BareNode(NoPayload()));
+        bareNodes[parent]->add_leaf(bareNodes[i]);
+        bareIds[bareNodes[i]] = i;
+        labelledNodes.push_back(new LabelledNode(NodeLabel(i)));
+        labelledNodes[parent]->add_leaf(labelledNodes[i]);
+        multilevel.push_back(new MultilevelTreeNode(i));
+        multilevel[parent]->add_leaf(multilevel[i]);
+        bareMultilevel.push_back(new BareMultilevelNode(NoPayload()));
+        bareMultilevel[parent]->add_leaf(bareMultilevel[i]);
+        bareMultilevelIds[bareMultilevel[i]] = i;
+        labelledMultilevel.push_back(new LabelledMultilevelNode(NodeLabel(i)));
+        labelledMultilevel[parent]->add_leaf(labelledMultilevel[i]);
+    }
+
+    for (int j = 0; j < 10000; ++j) {
+        int x = rand() % numNodes;
+        int y = rand() % numNodes;
+        NodeId expected = ExpensiveTreeNode::lca(nodes[x], nodes[y])->payload();
+        assert(bareIds[BareNode::lca(bareNodes[x], bareNodes[y])] == expected);
+        assert(LabelledNode::lca(labelledNodes[x], labelledNodes[y])->payload().name == NodeLabel(expected).name);
+        expected = MultilevelTreeNode::lca(multilevel[x], multilevel[y])->payload();
+        assert(bareMultilevelIds[BareMultilevelNode::lca(bareMultilevel[x], bareMultilevel[y])] == expected);
+        assert(LabelledMultilevelNode::lca(labelledMultilevel[x], labelledMultilevel[y])->payload().name == NodeLabel(expected).name);
+    }
+    nodes[0]->deleteNode();
+    bareNodes[0]->deleteNode();
+    labelledNodes[0]->deleteNode();
+    multilevel[0]->deleteNode();
+    bareMultilevel[0]->deleteNode();
+    labelledMultilevel[0]->deleteNode();
+
+    cout << "Passed 'payload' tests" << endl;
+}
+
+/*
+ * Once the scratch space and the ancestor pool have grown, add_leaf only
+ * allocates the two list nodes linking the leaf to its parent: rebuilding
+ * a subtree reuses everything else.
+ */
+void testAllocationFreeRecompress() {
+    int warmup = 20000;
+    int numNodes = 40000;
+    for (int shape = 0; shape < 2; ++shape) {
+        vector<ExpensiveTreeNode*> nodes;
+        for (int i = 0; i < numNodes; ++i) {
+            nodes.push_back(new ExpensiveTreeNode(i));
+        }
+
+        // Random parents, then a long path (whose recompressions are the largest)
+        long long before = 0;
+        for (int i = 1; i < numNodes; ++i) {
+            if (i == warmup) {before = allocationCount;}
+            int parent = (shape == 0) ? rand() % i : i - 1;
+            nodes[parent]->add_leaf(nodes[i]);
+        }
+        long long allocations = allocationCount - before;
+        assert(allocations <= 2LL * (numNodes - warmup) + 100);
+
+        for (int i = 0; i < 1000; ++i) {
+            ExpensiveTreeNode* x = nodes[rand() % numNodes];
+            ExpensiveTreeNode* y = nodes[rand() % numNodes];
+            assert(ExpensiveTreeNode::lca(x, y) == ExpensiveTreeNode::naiveLca(x, y));
+        }
+        nodes[0]->deleteNode();
+    }
+
+    cout << "Passed 'allocation-free recompress' tests" << endl;
+}
+
+/* Counters follow the operations when compiled in (make STATS=1), and stay at zero otherwise */
+void testStats() {
+    LcaStats::reset();
+    int numNodes = 2000;
+    treeAndNodes<MultilevelTreeNode> randTree = generateIncrementalMultilevelTree(numNodes, 5);
+    randTree.tree->deleteNode();
+
+    uint64_t recompressions = 0;
+    for (int b = 0; b < LcaStats::sizeBuckets; ++b) {
+        recompressions += LcaStats::recompressions(b);
+    }
+    LatencyHistogram multilevelLatency = LcaStats::latency(LcaStats::multilevelAddLeaf);
+    LatencyHistogram expensiveLatency = LcaStats::latency(LcaStats::expensiveAddLeaf);
+    std::string snapshot = LcaStats::snapshot();
+
+    if (LcaStats::enabled()) {
+        // Every full 2-subtree but the root's adds a leaf to the summary tree, which recompresses once
+        uint64_t fills = LcaStats::twoSubtreeFills();
+        assert(fills > 0 && fills <= (uint64_t) numNodes / MultilevelTreeNode::twoSubtreeMaxSize);
+        assert(multilevelLatency.count() == (uint64_t) numNodes - 1);
+        assert(expensiveLatency.count() == fills - 1 && recompressions == fills - 1);
+        assert(LcaStats::sizeWalks().count() == fills - 1);
+        assert(LcaStats::filledAncestorTables() >= recompressions);
+        assert(snapshot.find("lca_stats_enabled 1") != std::string::npos);
+    } else {
+        assert(LcaStats::twoSubtreeFills() == 0 && recompressions == 0 && LcaStats::filledAncestorTables() == 0);
+        assert(multilevelLatency.count() == 0 && expensiveLatency.count() == 0);
+        assert(snapshot.find("lca_stats_enabled 0") != std::string::npos);
+    }
+    assert(snapshot.find("lca_operation_latency_ns_count{op=\"multilevel_add_leaf\"}") != std::string::npos);
+
+    LcaStats::reset();
+    assert(LcaStats::twoSubtreeFills() == 0 && LcaStats::latency(LcaStats::multilevelAddLeaf).count() == 0);
+    cout << "Passed 'stats' tests" << endl;
+}
+
 int main(){
+    testFatPreorder();
     testStaticTree();
     testExpensiveIncremental();
     testMultilevel();
+    testArena();
+    testConcurrent();
+    testParallelPreprocess();
+    testDeepTrees();
+    testLargeTrees();
+    testBulkLoad();
+    testDeletion();
+    testLink();
+    testWordWidths();
+    testLevelAncestors();
+    testAddLeaves();
+    testEulerTour();
+    testSnapshot();
+    testWorkloadGenerator();
+    testMemoryUsage();
+    testPayloads();
+    testStats();
+    testAllocationFreeRecompress();
     return 0;
 }
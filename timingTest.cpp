@@ -1,10 +1,17 @@
 #include <list>
-#include <string>
 #include <iostream>
 #include <chrono>
 #include "lcaTree.hpp"
 #include "generateRandTrees.hpp"
 #include "lcaMultilevel.hpp"
+#include "lcaArena.hpp"
+#include "lcaConcurrent.hpp"
+#include "taskScheduler.hpp"
+#include "lcaSnapshot.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
 
 using std::chrono::high_resolution_clock;
 using std::chrono::duration_cast;
@@ -31,7 +38,7 @@ treeAndTiming<ExpensiveTreeNode> seqToStaticTree(std::vector<int> leaves, std::v
     std::vector<ExpensiveTreeNode*> nodes(numNodes);
     for (int i = 0; i < numNodes; ++i)
     {
-        nodes[i] = new ExpensiveTreeNode(std::to_string(i));
+        nodes[i] = new ExpensiveTreeNode(i);
     }
 
     ExpensiveTreeNode* root = nodes[parents[parents.size() - 1]];
@@ -67,7 +74,7 @@ treeAndTiming<ExpensiveTreeNode> seqToIncrementalTree(std::vector<int> leaves, s
     std::vector<ExpensiveTreeNode*> nodes(numNodes);
     for (int i = 0; i < numNodes; ++i)
     {
-        nodes[i] = new ExpensiveTreeNode(std::to_string(i));
+        nodes[i] = new ExpensiveTreeNode(i);
     }
 
     ExpensiveTreeNode* root = nodes[parents[parents.size() - 1]];
@@ -95,7 +102,7 @@ treeAndTiming<MultilevelTreeNode> seqToIncrementalMultilevelTree(std::vector<int
     std::vector<MultilevelTreeNode*> nodes(numNodes);
     for (int i = 0; i < numNodes; ++i)
     {
-        nodes[i] = new MultilevelTreeNode(std::to_string(i));
+        nodes[i] = new MultilevelTreeNode(i);
     }
 
     MultilevelTreeNode* root = nodes[parents[parents.size() - 1]];
@@ -114,6 +121,415 @@ treeAndTiming<MultilevelTreeNode> seqToIncrementalMultilevelTree(std::vector<int
     return toReturn;
 }
 
+/* Times the creation of static and incremental ArenaTrees (node ids are arena indices) */
+struct arenaAndTiming {
+    ArenaTree* staticTree;
+    ArenaTree* incrTree;
+    int staticTotal;
+    int incrementalTotal;
+};
+
+arenaAndTiming seqToArenaTrees(std::vector<int> leaves, std::vector<int> parents) {
+    int numNodes = leaves.size() + 1;
+    arenaAndTiming toReturn;
+
+    auto t1 = high_resolution_clock::now();
+
+    toReturn.staticTree = new ArenaTree(numNodes);
+    for (int i = 0; i < numNodes; ++i)
+    {
+        toReturn.staticTree->newNode();
+    }
+    for (int i = leaves.size() - 1; i >= 0; --i) {
+        toReturn.staticTree->addLeafNoPreprocessing(parents[i], leaves[i]);
+    }
+    toReturn.staticTree->preprocess(parents[parents.size() - 1]);
+
+    auto t2 = high_resolution_clock::now();
+
+    toReturn.incrTree = new ArenaTree(numNodes);
+    for (int i = 0; i < numNodes; ++i)
+    {
+        toReturn.incrTree->newNode();
+    }
+    toReturn.incrTree->preprocess(parents[parents.size() - 1]);
+    for (int i = leaves.size() - 1; i >= 0; --i) {
+        toReturn.incrTree->add_leaf(parents[i], leaves[i]);
+    }
+
+    auto t3 = high_resolution_clock::now();
+
+    toReturn.staticTotal = duration_cast<microseconds>(t2 - t1).count();
+    toReturn.incrementalTotal = duration_cast<microseconds>(t3 - t2).count();
+    return toReturn;
+}
+
+/*
+ * Compares a loop of single LCA queries against the batched API on trees
+ * too large to stay in cache. Trees are random recursive trees (each node's
+ * parent is uniform among the earlier nodes).
+ */
+void timeBatchQueries() {
+    int numMultilevel = 1000000;
+    int numExpensive = 30000; // static fat preorder intervals stay within a long long
+    int numQueries = 1000000;
+
+    std::vector<MultilevelTreeNode*> multiNodes(numMultilevel);
+    multiNodes[0] = new MultilevelTreeNode(0);
+    for (int i = 1; i < numMultilevel; ++i) {
+        multiNodes[i] = new MultilevelTreeNode(i);
+        multiNodes[rand() % i]->add_leaf(multiNodes[i]);
+    }
+
+    std::vector<ExpensiveTreeNode*> expNodes(numExpensive);
+    expNodes[0] = new ExpensiveTreeNode(0);
+    for (int i = 1; i < numExpensive; ++i) {
+        expNodes[i] = new ExpensiveTreeNode(i);
+        expNodes[rand() % i]->addLeafNoPreprocessing(expNodes[i]);
+    }
+    expNodes[0]->preprocess();
+
+    std::vector<std::pair<MultilevelTreeNode*, MultilevelTreeNode*>> multiQueries(numQueries);
+    std::vector<std::pair<ExpensiveTreeNode*, ExpensiveTreeNode*>> expQueries(numQueries);
+    for (int k = 0; k < numQueries; ++k) {
+        multiQueries[k] = std::make_pair(multiNodes[rand() % numMultilevel], multiNodes[rand() % numMultilevel]);
+        expQueries[k] = std::make_pair(expNodes[rand() % numExpensive], expNodes[rand() % numExpensive]);
+    }
+
+    std::vector<MultilevelTreeNode*> multiResults(numQueries);
+    std::vector<ExpensiveTreeNode*> expResults(numQueries);
+
+    auto t0 = high_resolution_clock::now();
+    for (int k = 0; k < numQueries; ++k) {
+        multiResults[k] = MultilevelTreeNode::lca(multiQueries[k].first, multiQueries[k].second);
+    }
+    auto t1 = high_resolution_clock::now();
+    MultilevelTreeNode::lcaBatch(multiQueries.data(), multiResults.data(), numQueries);
+    auto t2 = high_resolution_clock::now();
+    for (int k = 0; k < numQueries; ++k) {
+        expResults[k] = ExpensiveTreeNode::lca(expQueries[k].first, expQueries[k].second);
+    }
+    auto t3 = high_resolution_clock::now();
+    ExpensiveTreeNode::lcaBatch(expQueries.data(), expResults.data(), numQueries);
+    auto t4 = high_resolution_clock::now();
+
+    std::cout << "-------" << std::endl;
+    std::cout << "Multilevel (n = " << numMultilevel << ") queries/s, single: "
+              << numQueries * 1e9 / duration_cast<nanoseconds>(t1 - t0).count()
+              << ", batched: " << numQueries * 1e9 / duration_cast<nanoseconds>(t2 - t1).count() << std::endl;
+    std::cout << "Static (n = " << numExpensive << ") queries/s, single: "
+              << numQueries * 1e9 / duration_cast<nanoseconds>(t3 - t2).count()
+              << ", batched: " << numQueries * 1e9 / duration_cast<nanoseconds>(t4 - t3).count() << std::endl;
+    std::cout << "-------" << std::endl;
+
+    multiNodes[0]->deleteNode();
+    expNodes[0]->deleteNode();
+}
+
+/*
+ * Query throughput while one writer keeps inserting leaves: the Left-Right
+ * ConcurrentMultilevelTree against a MultilevelTreeNode behind a global mutex.
+ * Each run stops after `numInserted` leaves or one second, whichever is first.
+ */
+void timeConcurrentQueries() {
+    int numPrebuilt = 100000;
+    int numInserted = 100000;
+    int numNodes = numPrebuilt + numInserted;
+
+    std::vector<NodeId> parents(numNodes, 0);
+    for (int i = 1; i < numNodes; ++i) {
+        parents[i] = rand() % i;
+    }
+
+    std::cout << "-------" << std::endl;
+    for (int numReaders = 1; numReaders <= 8; numReaders *= 2) {
+        for (int useMutex = 0; useMutex < 2; ++useMutex) {
+            ConcurrentMultilevelTree concurrentTree(0);
+            std::vector<MultilevelTreeNode*> nodes(numNodes);
+            nodes[0] = new MultilevelTreeNode(0);
+            std::mutex treeLock;
+
+            for (int i = 1; i < numPrebuilt; ++i) {
+                if (useMutex) {
+                    nodes[i] = new MultilevelTreeNode(i);
+                    nodes[parents[i]]->add_leaf(nodes[i]);
+                } else {
+                    concurrentTree.add_leaf(parents[i], i);
+                }
+            }
+
+            std::atomic<bool> done(false);
+            std::atomic<long long> numQueries(0);
+            int numDone = 0;
+
+            auto t0 = high_resolution_clock::now();
+            std::thread writer([&]() {
+                for (int i = numPrebuilt; i < numNodes; ++i) {
+                    if (high_resolution_clock::now() - t0 > std::chrono::seconds(1)) {
+                        break;
+                    }
+                    if (useMutex) {
+                        std::lock_guard<std::mutex> guard(treeLock);
+                        nodes[i] = new MultilevelTreeNode(i);
+                        nodes[parents[i]]->add_leaf(nodes[i]);
+                    } else {
+                        concurrentTree.add_leaf(parents[i], i);
+                    }
+                    numDone++;
+                }
+                done.store(true);
+            });
+
+            std::vector<std::thread> readers;
+            for (int r = 0; r < numReaders; ++r) {
+                readers.push_back(std::thread([&, r]() {
+                    unsigned int seed = r;
+                    long long count = 0;
+                    while (!done.load()) {
+                        NodeId x = rand_r(&seed) % numPrebuilt;
+                        NodeId y = rand_r(&seed) % numPrebuilt;
+                        if (useMutex) {
+                            std::lock_guard<std::mutex> guard(treeLock);
+                            MultilevelTreeNode::lca(nodes[x], nodes[y]);
+                        } else {
+                            concurrentTree.lca(x, y);
+                        }
+                        count++;
+                    }
+                    numQueries.fetch_add(count);
+                }));
+            }
+
+            writer.join();
+            for (std::thread& reader : readers) {
+                reader.join();
+            }
+            auto t1 = high_resolution_clock::now();
+            double seconds = duration_cast<nanoseconds>(t1 - t0).count() * 1e-9;
+
+            std::cout << (useMutex ? "Global mutex" : "Left-Right  ") << ", " << numReaders << " readers: "
+                      << numQueries.load() / seconds << " queries/s, "
+                      << numDone / seconds << " inserts/s" << std::endl;
+
+            if (useMutex) {
+                nodes[0]->deleteNode();
+            } else {
+                delete nodes[0];
+            }
+        }
+    }
+    std::cout << "-------" << std::endl;
+}
+
+/* Static preprocessing time of a random recursive tree for increasing thread counts */
+void timeParallelPreprocess() {
+    int numNodes = 30000; // static fat preorder intervals stay within a long long
+    int numIter = 10;
+
+    std::vector<int> parents(numNodes, -1);
+    for (int i = 1; i < numNodes; ++i) {
+        parents[i] = rand() % i;
+    }
+
+    std::cout << "-------" << std::endl;
+    double sequentialTime = 0;
+    for (int numThreads = 0; numThreads <= 8; numThreads = (numThreads == 0) ? 1 : numThreads * 2) {
+        // numThreads == 0 runs the sequential passes
+        TaskScheduler scheduler(numThreads);
+        ExpensiveTreeNode::setScheduler(numThreads == 0 ? NULL : &scheduler);
+
+        unsigned long long total = 0;
+        for (int j = 0; j < numIter; ++j) {
+            std::vector<ExpensiveTreeNode*> nodes(numNodes);
+            nodes[0] = new ExpensiveTreeNode(0);
+            for (int i = 1; i < numNodes; ++i) {
+                nodes[i] = new ExpensiveTreeNode(i);
+                nodes[parents[i]]->addLeafNoPreprocessing(nodes[i]);
+            }
+
+            auto t0 = high_resolution_clock::now();
+            nodes[0]->preprocess();
+            auto t1 = high_resolution_clock::now();
+            total += duration_cast<microseconds>(t1 - t0).count();
+
+            nodes[0]->deleteNode();
+        }
+        ExpensiveTreeNode::setScheduler(NULL);
+
+        double average = total * 1.0 / numIter;
+        if (numThreads == 0) {
+            sequentialTime = average;
+            std::cout << "Sequential preprocess: " << average << std::endl;
+        } else {
+            std::cout << "Parallel preprocess, " << numThreads << " threads: " << average
+                      << " (speedup " << sequentialTime / average << ")" << std::endl;
+        }
+    }
+    std::cout << "-------" << std::endl;
+}
+
+/*
+ * Construction and query times on deep trees: a path, and a caterpillar
+ * whose spine nodes each carry a leg of two nodes. Trees without
+ * indirection stay at 30k nodes (their static fat preorder intervals must
+ * fit in a long long); the multilevel tree is a million nodes deep.
+ */
+void timeDeepTrees() {
+    int numNodes = 30000;
+    int numMultilevelNodes = 1000000;
+    int numQueries = 100000;
+
+    std::cout << "-------" << std::endl;
+    for (int legLength = 0; legLength <= 2; legLength += 2) {
+        const char* shape = (legLength == 0) ? "Path" : "Caterpillar";
+
+        std::vector<std::vector<int>> sequences = caterpillarInsertionSeq(numNodes / (legLength + 1), legLength);
+        treeAndTiming<ExpensiveTreeNode> deepStatic = seqToStaticTree(sequences[0], sequences[1]);
+        treeAndTiming<ExpensiveTreeNode> deepIncr = seqToIncrementalTree(sequences[0], sequences[1]);
+        arenaAndTiming deepArena = seqToArenaTrees(sequences[0], sequences[1]);
+        int size = sequences[0].size() + 1;
+
+        sequences = caterpillarInsertionSeq(numMultilevelNodes / (legLength + 1), legLength);
+        treeAndTiming<MultilevelTreeNode> deepMultilevel = seqToIncrementalMultilevelTree(sequences[0], sequences[1]);
+        int multilevelSize = sequences[0].size() + 1;
+
+        std::vector<std::pair<int, int>> queries(numQueries);
+        std::vector<std::pair<int, int>> multilevelQueries(numQueries);
+        for (int k = 0; k < numQueries; ++k) {
+            queries[k] = std::make_pair(rand() % size, rand() % size);
+            multilevelQueries[k] = std::make_pair(rand() % multilevelSize, rand() % multilevelSize);
+        }
+
+        // Sum the answers so that the queries cannot be optimized away
+        long long checksum = 0;
+        auto t0 = high_resolution_clock::now();
+        for (const std::pair<int, int>& q : queries) {
+            checksum += ExpensiveTreeNode::lca(deepStatic.nodes[q.first], deepStatic.nodes[q.second])->payload();
+        }
+        auto t1 = high_resolution_clock::now();
+        for (const std::pair<int, int>& q : queries) {
+            checksum += ExpensiveTreeNode::lca(deepIncr.nodes[q.first], deepIncr.nodes[q.second])->payload();
+        }
+        auto t2 = high_resolution_clock::now();
+        for (const std::pair<int, int>& q : queries) {
+            checksum += deepArena.staticTree->lca(q.first, q.second);
+        }
+        auto t3 = high_resolution_clock::now();
+        for (const std::pair<int, int>& q : multilevelQueries) {
+            checksum += MultilevelTreeNode::lca(deepMultilevel.nodes[q.first], deepMultilevel.nodes[q.second])->payload();
+        }
+        auto t4 = high_resolution_clock::now();
+
+        std::cout << shape << " Static (" << size << " nodes): " << deepStatic.staticTotal << std::endl;
+        std::cout << shape << " Incr: " << deepIncr.incrementalTotal << std::endl;
+        std::cout << shape << " Arena Static: " << deepArena.staticTotal << std::endl;
+        std::cout << shape << " Arena Incr: " << deepArena.incrementalTotal << std::endl;
+        std::cout << shape << " Multilevel (" << multilevelSize << " nodes): " << deepMultilevel.multilevelTotal << std::endl;
+        std::cout << shape << " Static Query: " << duration_cast<nanoseconds>(t1 - t0).count() * 1.0 / numQueries << std::endl;
+        std::cout << shape << " Incr Query: " << duration_cast<nanoseconds>(t2 - t1).count() * 1.0 / numQueries << std::endl;
+        std::cout << shape << " Arena Static Query: " << duration_cast<nanoseconds>(t3 - t2).count() * 1.0 / numQueries << std::endl;
+        std::cout << shape << " Multilevel Query: " << duration_cast<nanoseconds>(t4 - t3).count() * 1.0 / numQueries
+                  << " (checksum " << checksum << ")" << std::endl;
+
+        deepStatic.tree->deleteNode();
+        deepIncr.tree->deleteNode();
+        deepMultilevel.tree->deleteNode();
+        delete deepArena.staticTree;
+        delete deepArena.incrTree;
+    }
+    std::cout << "-------" << std::endl;
+}
+
+/* Compares building a MultilevelTreeNode tree with add_leaf and with buildFromParents */
+void timeBulkLoad() {
+    int numNodes = 1000000;
+    int numIter = 5;
+
+    std::vector<int> parents(numNodes, -1);
+    for (int i = 1; i < numNodes; ++i) {
+        parents[i] = rand() % i;
+    }
+
+    unsigned long long incrementalTotal = 0;
+    unsigned long long bulkTotal = 0;
+    for (int j = 0; j < numIter; ++j) {
+        auto t0 = high_resolution_clock::now();
+        std::vector<MultilevelTreeNode*> nodes(numNodes);
+        nodes[0] = new MultilevelTreeNode(0);
+        for (int i = 1; i < numNodes; ++i) {
+            nodes[i] = new MultilevelTreeNode(i);
+            nodes[parents[i]]->add_leaf(nodes[i]);
+        }
+        auto t1 = high_resolution_clock::now();
+        nodes[0]->deleteNode();
+
+        auto t2 = high_resolution_clock::now();
+        MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, nodes);
+        auto t3 = high_resolution_clock::now();
+        root->deleteNode();
+
+        incrementalTotal += duration_cast<microseconds>(t1 - t0).count();
+        bulkTotal += duration_cast<microseconds>(t3 - t2).count();
+    }
+
+    std::cout << "-------" << std::endl;
+    std::cout << "Multilevel add_leaf build (" << numNodes << " nodes): " << incrementalTotal * 1.0 / numIter << std::endl;
+    std::cout << "Multilevel bulk build: " << bulkTotal * 1.0 / numIter << std::endl;
+    std::cout << "-------" << std::endl;
+}
+
+/* Compares rebuilding a MultilevelTreeNode tree with loading its snapshot, and their queries */
+void timeSnapshot() {
+    const char* path = "lca_timing_snapshot.bin";
+    int numNodes = 1000000;
+    int numQueries = 1000000;
+
+    std::vector<int> parents(numNodes, -1);
+    for (int i = 1; i < numNodes; ++i) {
+        parents[i] = rand() % i;
+    }
+
+    auto t0 = high_resolution_clock::now();
+    std::vector<MultilevelTreeNode*> nodes;
+    MultilevelTreeNode* root = MultilevelTreeNode::buildFromParents(parents, nodes);
+    auto t1 = high_resolution_clock::now();
+    LcaSnapshot::save(root, path);
+    auto t2 = high_resolution_clock::now();
+    LcaSnapshot snapshot;
+    snapshot.load(path);
+    auto t3 = high_resolution_clock::now();
+
+    std::vector<std::pair<int, int>> queries(numQueries);
+    for (int k = 0; k < numQueries; ++k) {
+        queries[k] = std::make_pair(rand() % numNodes, rand() % numNodes);
+    }
+
+    // Sum the answers so that the queries cannot be optimized away
+    long long checksum = 0;
+    auto t4 = high_resolution_clock::now();
+    for (const std::pair<int, int>& q : queries) {
+        checksum += MultilevelTreeNode::lca(nodes[q.first], nodes[q.second])->payload();
+    }
+    auto t5 = high_resolution_clock::now();
+    for (const std::pair<int, int>& q : queries) {
+        checksum -= snapshot.lca(q.first, q.second);
+    }
+    auto t6 = high_resolution_clock::now();
+
+    std::cout << "-------" << std::endl;
+    std::cout << "Multilevel bulk build (" << numNodes << " nodes): " << duration_cast<microseconds>(t1 - t0).count() << std::endl;
+    std::cout << "Snapshot save: " << duration_cast<microseconds>(t2 - t1).count() << std::endl;
+    std::cout << "Snapshot load: " << duration_cast<microseconds>(t3 - t2).count() << std::endl;
+    std::cout << "Multilevel Query: " << duration_cast<nanoseconds>(t5 - t4).count() * 1.0 / numQueries << std::endl;
+    std::cout << "Snapshot Query: " << duration_cast<nanoseconds>(t6 - t5).count() * 1.0 / numQueries
+              << " (difference " << checksum << ")" << std::endl;
+    std::cout << "-------" << std::endl;
+
+    root->deleteNode();
+    snapshot.unload();
+    remove(path);
+}
+
 int main()
 {
     int numNodes = 10000;
@@ -126,16 +542,20 @@ int main()
     unsigned long long avgStatic = 0;
     unsigned long long avgIncremental = 0;
     unsigned long long avgMultilevel = 0;
+    unsigned long long avgArenaStatic = 0;
+    unsigned long long avgArenaIncremental = 0;
 
     unsigned long long avgNaiveQuery = 0;
     unsigned long long avgStaticQuery = 0;
     unsigned long long avgIncrementalQuery = 0;
     unsigned long long avgMultilevelQuery = 0;
+    unsigned long long avgArenaStaticQuery = 0;
+    unsigned long long avgArenaIncrementalQuery = 0;
 
     for (int i = 0; i < numRandTrees; ++i)
     {
         std::cout << "Generating random tree " << i << std::endl;
-        std::vector<std::vector<int>> sequences = randInsertionSeq(numNodes);
+        std::vector<std::vector<int>> sequences = randInsertionSeq(numNodes, i);
         std::vector<int> leaves = sequences[0];
         std::vector<int> parents = sequences[1];
 
@@ -144,11 +564,14 @@ int main()
             treeAndTiming<ExpensiveTreeNode> randStatic = seqToStaticTree(leaves, parents);
             treeAndTiming<ExpensiveTreeNode> randIncr = seqToIncrementalTree(leaves, parents);
             treeAndTiming<MultilevelTreeNode> randMultilevel = seqToIncrementalMultilevelTree(leaves, parents);
+            arenaAndTiming randArena = seqToArenaTrees(leaves, parents);
     
             avgCreation += randStatic.staticCreation;
             avgStatic += randStatic.staticTotal;
             avgIncremental += randIncr.incrementalTotal;
             avgMultilevel += randMultilevel.multilevelTotal;
+            avgArenaStatic += randArena.staticTotal;
+            avgArenaIncremental += randArena.incrementalTotal;
 
             for (int k = 0; k < numQueries; ++k)
             {
@@ -167,21 +590,34 @@ int main()
                 auto t3 = high_resolution_clock::now();
                 lcaMultilevel = MultilevelTreeNode::lca(randMultilevel.nodes[nodeX], randMultilevel.nodes[nodeY]);
                 auto t4 = high_resolution_clock::now();
+                ArenaTree::index lcaArena = randArena.staticTree->lca(nodeX, nodeY);
+                auto t5 = high_resolution_clock::now();
+                lcaArena = randArena.incrTree->lca(nodeX, nodeY);
+                auto t6 = high_resolution_clock::now();
+                (void) lcaExpensive;
+                (void) lcaMultilevel;
+                (void) lcaArena;
 
                 auto naiveQ = duration_cast<nanoseconds>(t1 - t0);
                 auto staticQ = duration_cast<nanoseconds>(t2 - t1);
                 auto incrQ = duration_cast<nanoseconds>(t3 - t2);
                 auto multiQ = duration_cast<nanoseconds>(t4 - t3);
+                auto arenaStaticQ = duration_cast<nanoseconds>(t5 - t4);
+                auto arenaIncrQ = duration_cast<nanoseconds>(t6 - t5);
 
                 avgNaiveQuery += naiveQ.count();
                 avgStaticQuery += staticQ.count();
                 avgIncrementalQuery += incrQ.count();
                 avgMultilevelQuery += multiQ.count();
+                avgArenaStaticQuery += arenaStaticQ.count();
+                avgArenaIncrementalQuery += arenaIncrQ.count();
             }
 
             randStatic.tree->deleteNode();
             randIncr.tree->deleteNode();
             randMultilevel.tree->deleteNode();
+            delete randArena.staticTree;
+            delete randArena.incrTree;
 
         }
     }
@@ -191,13 +627,23 @@ int main()
     std::cout << "Average Static:" << avgStatic  * 1.0/(numIter * numRandTrees)<< std::endl;
     std::cout << "Average Incr:" << avgIncremental  * 1.0/(numIter * numRandTrees)<< std::endl;
     std::cout << "Average Multilevel:" << avgMultilevel  * 1.0/(numIter * numRandTrees)<< std::endl;
+    std::cout << "Average Arena Static:" << avgArenaStatic  * 1.0/(numIter * numRandTrees)<< std::endl;
+    std::cout << "Average Arena Incr:" << avgArenaIncremental  * 1.0/(numIter * numRandTrees)<< std::endl;
     std::cout << std::endl;
     std::cout << "Average Naive Query: " << avgNaiveQuery * 1.0/(numIter * numRandTrees * numQueries) << std::endl;
     std::cout << "Average Static Query: " << avgStaticQuery* 1.0/(numIter * numRandTrees * numQueries) << std::endl;
     std::cout << "Average Incr Query: " << avgIncrementalQuery* 1.0/(numIter * numRandTrees * numQueries) << std::endl;
     std::cout << "Average Multilevel Query: " << avgMultilevelQuery * 1.0/(numIter * numRandTrees * numQueries)<< std::endl;
+    std::cout << "Average Arena Static Query: " << avgArenaStaticQuery * 1.0/(numIter * numRandTrees * numQueries)<< std::endl;
+    std::cout << "Average Arena Incr Query: " << avgArenaIncrementalQuery * 1.0/(numIter * numRandTrees * numQueries)<< std::endl;
     std::cout << "-------" << std::endl;
 
+    timeBatchQueries();
+    timeConcurrentQueries();
+    timeParallelPreprocess();
+    timeDeepTrees();
+    timeBulkLoad();
+    timeSnapshot();
 
     return 0;
 }
\ No newline at end of file